@@ -17,6 +17,15 @@
 #include "pcode.h"
 #include "parse.h"
 #include "strlist.h"
+#include "object.h"
+#include "project.h"
+#include "stats.h"
+#include "sizes.h"
+#include "disasm.h"
+#include "vm.h"
+#include "profile.h"
+#include "cost.h"
+#include "opt.h"
 
 using std::set_new_handler;
 
@@ -38,6 +47,17 @@ static void DisplayBanner();
 static void DisplayUsage();
 static void OpenDebugFile(string name);
 static void ProcessArgs();
+static void WriteLibraryInterface();
+static void WriteDependencies();
+static void WriteTrace();
+static void WriteCounters();
+static void WriteLineMap();
+static void WriteSizeReport();
+static void LoadObjects(vector<acsObject_t> &objects);
+static void Disassemble();
+static void RunObjects();
+static void ReportCosts();
+static void ConvertCounters();
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
@@ -48,6 +68,7 @@ bool acs_VerboseMode;
 bool acs_DebugMode;
 ofstream acs_DebugFile;
 string acs_SourceFileName;
+string acs_ObjectFileName;
 string acs_ErrorFileName;		// User defined error file name
 								// TODO: Maybe add the ability to add a path?
 								// TODO: Add error checking.
@@ -56,7 +77,26 @@ string acs_ErrorFileName;		// User defined error file name
 
 static int ArgCount;
 static char **ArgVector;
-static string ObjectFileName;
+static bool MakeInterface;
+static bool ProjectMode;
+static int ProjectJobs;
+static VecStr ProjectSources;
+static bool MakeDepFile;
+static string DepFileName;
+static string StatsFileName;
+static string TraceFileName;
+static bool AllocReport;
+static string SizeReportFile;
+static bool DisassembleMode;
+static bool RunMode;
+static bool CostMode;
+static bool CountsMode;
+static int RunTics;
+static int RunPlayers;
+static VecStr InputObjects;
+static string ProfileFileName;
+static bool LineMap;
+static string LineMapFile;
 
 // CODE --------------------------------------------------------------------
 
@@ -81,10 +121,59 @@ int main(int argc, char **argv)
 
 	DisplayBanner();
 	Init();
+	if (DisassembleMode)
+	{
+		Disassemble();
+	}
+	if (RunMode)
+	{
+		RunObjects();
+	}
+	if (CostMode)
+	{
+		ReportCosts();
+	}
+	if (CountsMode)
+	{
+		ConvertCounters();
+	}
+	if (ProjectMode)
+	{
+		int result = PJ_Build(ArgVector[0], ProjectJobs);
+
+		WriteTrace();
+		exit(result);
+	}
 	TK_OpenSource(acs_SourceFileName);
-	PC_OpenObject(ObjectFileName, DEFAULT_OBJECT_SIZE, 0);
+	PC_OpenObject(acs_ObjectFileName, DEFAULT_OBJECT_SIZE, 0);
+	if (!ProfileFileName.empty() && !PF_Load(ProfileFileName))
+	{
+		ERR_Exit(ERR_CANT_READ_FILE, false, ProfileFileName);
+	}
+	ST_StartPhase(PHASE_PARSE);
+	ST_TraceBegin("PA_Parse", ST_TraceArg("file", acs_SourceFileName));
 	PA_Parse();
+	ST_TraceEnd();
+	ST_EndPhase(PHASE_PARSE);
+	ST_TraceBegin("PC_CloseObject", ST_TraceArg("file", acs_ObjectFileName));
 	PC_CloseObject();
+	ST_TraceEnd();
+	if (pf_Instrument)
+	{
+		WriteCounters();
+	}
+	if (LineMap)
+	{
+		WriteLineMap();
+	}
+	if (MakeInterface && ImportMode == IMPORT_Exporting)
+	{
+		WriteLibraryInterface();
+	}
+	if (MakeDepFile)
+	{
+		WriteDependencies();
+	}
 	TK_CloseSource();
 
 	line();
@@ -110,7 +199,18 @@ int main(int argc, char **argv)
 		<< "  " << pa_MapVarCount << " map variable" << (pa_MapVarCount == 1 ? "" : "s") << endl
 		<< "  " << pa_GlobalArrayCount << " global array" << (pa_GlobalArrayCount == 1 ? "" : "s") << endl
 		<< "  " << pa_WorldArrayCount << " world array" << (pa_WorldArrayCount == 1 ? "" : "s") << endl;
-	cerr << "  object \"" << ObjectFileName << "\": " << pCode_Buffer.size() << " bytes" << endl;
+	cerr << "  object \"" << acs_ObjectFileName << "\": " << pCode_Buffer.size() << " bytes" << endl;
+	ST_Report();
+	if (AllocReport)
+	{
+		ST_AllocReport();
+	}
+	WriteSizeReport();
+	WriteTrace();
+	if (!StatsFileName.empty() && !ST_WriteJson(StatsFileName))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, StatsFileName);
+	}
 	ERR_RemoveErrorFile();
 	return 0;
 }
@@ -181,6 +281,58 @@ static void ProcessArgs()
 		text = ArgVector[i];
 		auto iter = text.begin();
 
+		if (text == "-dis")
+		{
+			DisassembleMode = true;
+			i++;
+			continue;
+		}
+		if (text == "-run")
+		{
+			RunMode = true;
+			i++;
+			continue;
+		}
+		if (text == "-cost")
+		{
+			CostMode = true;
+			i++;
+			continue;
+		}
+		if (text == "-counts")
+		{
+			CountsMode = true;
+			i++;
+			continue;
+		}
+		if ((text == "-tics" || text == "-players") && i + 1 < ArgCount)
+		{
+			int value = atoi(ArgVector[i + 1]);
+
+			if (value <= 0)
+				DisplayUsage();
+			if (text == "-tics")
+				RunTics = value;
+			else
+				RunPlayers = value;
+			i += 2;
+			continue;
+		}
+		if (text == "-instrument")
+		{
+			pf_Instrument = true;
+			PJ_AddOption(text);
+			i++;
+			continue;
+		}
+		if (text == "-profile" && i + 1 < ArgCount)
+		{
+			ProfileFileName = ArgVector[i + 1];
+			PJ_AddOption(text);
+			PJ_AddOption(ProfileFileName);
+			i += 2;
+			continue;
+		}
 		if(*iter == '-')
 		{
 			// If incorrect or ends, display usage
@@ -195,6 +347,8 @@ static void ProcessArgs()
 					if((i + 1) < ArgCount)
 					{
 						TK_AddIncludePath(ArgVector[++i]);
+						PJ_AddOption(text);
+						PJ_AddOption(ArgVector[i]);
 					}
 					break;
 					
@@ -212,6 +366,7 @@ static void ProcessArgs()
 					pCode_HexenCase = true;
 					pCode_EnforceHexen = toupper(*iter) != 'H';
 					pCode_WarnNotHexen = toupper(*iter) == 'H';
+					PJ_AddOption(text);
 					break;
 				case 'F':
 					grabErrorFile = true;
@@ -220,6 +375,51 @@ static void ProcessArgs()
 						acs_ErrorFileName = text.substr(2, text.length(-2));
 					}
 					break;
+				case 'L':
+					MakeInterface = true;
+					break;
+				case 'M':
+					MakeDepFile = true;
+					if (text.length() > 2)
+					{
+						DepFileName = text.substr(2);
+					}
+					break;
+				case 'T':
+					st_Enabled = true;
+					if (text.length() > 2 && tolower(text[2]) == 'j')
+					{
+						StatsFileName = text.length() > 3 ? text.substr(3) : "acc-stats.json";
+					}
+					break;
+				case 'A':
+					AllocReport = true;
+					break;
+				case 'R':
+					st_Tracing = true;
+					TraceFileName = text.length() > 2 ? text.substr(2) : "acc-trace.json";
+					ST_SetTrack(0, "main");
+					break;
+				case 'G':
+					LineMap = true;
+					LineMapFile = text.substr(2);
+					if (LineMapFile.empty())
+					{
+						PJ_AddOption(text);
+					}
+					break;
+				case 'S':
+					sz_Enabled = true;
+					SizeReportFile = text.substr(2);
+					break;
+				case 'O':
+					opt_Enabled = true;
+					PJ_AddOption(text);
+					break;
+				case 'P':
+					ProjectMode = true;
+					ProjectJobs = atoi(text.c_str() + 2);
+					break;
 				default:
 					DisplayUsage();
 					break;
@@ -229,6 +429,18 @@ static void ProcessArgs()
 		{
 			// Input/output file
 			count++;
+			if (DisassembleMode || RunMode || CostMode || CountsMode)
+			{
+				InputObjects.add(text);
+				i++;
+				continue;
+			}
+			if (ProjectMode)
+			{
+				ProjectSources.add(text);
+				i++;
+				continue;
+			}
 			switch(count)
 			{
 				case 1:
@@ -237,8 +449,8 @@ static void ProcessArgs()
 					break;
 					
 				case 2:
-					ObjectFileName = text;
-					MS_SuggestFileExt(ObjectFileName, ".o");
+					acs_ObjectFileName = text;
+					MS_SuggestFileExt(acs_ObjectFileName, ".o");
 					break;
 					
 				default:
@@ -255,18 +467,47 @@ static void ProcessArgs()
 	{
 		DisplayUsage();
 	}
+	pCode_RecordLines = LineMap || pf_Instrument;
+
+	// The counters are global array pcodes, which Hexen doesn't have
+	if (pf_Instrument && pCode_EnforceHexen)
+	{
+		ERR_Exit(ERR_HEXEN_COMPAT, false);
+	}
+	if (pf_Instrument && pCode_WarnNotHexen)
+	{
+		line();
+		line("-instrument counts in a global array, which Hexen doesn't have.");
+		line("These scripts will not be compatible with Hexen.");
+	}
+	if (DisassembleMode || RunMode || CostMode || CountsMode)
+	{
+		if (DisassembleMode + RunMode + CostMode + CountsMode > 1)
+			DisplayUsage();
+		if ((CountsMode ? count != 3 : count > 2) || (CostMode && count != 1))
+			DisplayUsage();
+		if (!ProfileFileName.empty() && (!RunMode || count != 1))
+			DisplayUsage();
+		return;
+	}
 
 	TK_AddIncludePath(".");
 #ifdef unix
 	TK_AddIncludePath("/usr/local/share/acc/");
 #endif
 	TK_AddProgramIncludePath(ArgVector[0]);
+
+	// Sources are scanned for their includes, so the paths must be set
+	for (string &source : ProjectSources)
+	{
+		PJ_AddSource(source);
+	}
 	
-	if(count == 1)
+	if(count == 1 && !ProjectMode)
 	{
-		ObjectFileName = acs_SourceFileName;
-		MS_StripFileExt(ObjectFileName);
-		MS_SuggestFileExt(ObjectFileName, ".o");
+		acs_ObjectFileName = acs_SourceFileName;
+		MS_StripFileExt(acs_ObjectFileName);
+		MS_SuggestFileExt(acs_ObjectFileName, ".o");
 	}
 }
 
@@ -279,6 +520,12 @@ static void DisplayUsage()
 {
 	line();
 	line("Usage: ACC [options] source[.acs] [object[.o]]");
+	line("       ACC -p[jobs] [options] source[.acs]...");
+	line("       ACC -dis object [object2]");
+	line("       ACC -run [-tics n] [-players n] object [object2]");
+	line("       ACC -run -profile file [-tics n] [-players n] object");
+	line("       ACC -cost object");
+	line("       ACC -counts counters log profile");
 	line();
 	line("-i [path]  Add include path to find include files");
 	line("-d[file]   Output debugging information");
@@ -286,6 +533,47 @@ static void DisplayUsage()
 	line("-hh        Like -h, but use of new features is only a warning");
 	line("-e         Use single line error and warning messages");
 	line("-f[file]   Output error information to the specified file");
+	line("-l         Write an interface file (.acsi) for a #library");
+	line("-m[file]   Write the included and imported files as a make rule");
+	line("-t         Print time spent in each phase and file, and counters");
+	line("-tj[file]  Also write them as JSON, to acc-stats.json by default");
+	line("-a         Print allocations by subsystem and the peak memory used");
+	line("-r[file]   Write a trace for chrome://tracing, to acc-trace.json by default");
+	line("-g[file]   Write which source line and script or function each range of");
+	line("           pcodes is from, next to the object (.lines) by default");
+	line("-s[file]   Report what every byte of the object is, and the pcodes in");
+	line("           each script and function (to the console by default)");
+	line("-dis       List an object's scripts and functions, or compare two");
+	line("           objects and exit with 1 if they differ");
+	line("-run       Run an object's open and enter scripts and report what they");
+	line("           did and the pcodes executed, or run two objects and exit with");
+	line("           1 if they behave differently");
+	line("-cost      Report the most pcodes each script and function can run in");
+	line("           a tic, and exit with 1 if a loop that doesn't wait can't be");
+	line("           counted or runs over 1000 times, or a tic is too long for ZDoom");
+	line("-tics n    Stop -run after n tics, 35 to a second (60 seconds by default)");
+	line("-players n Run the enter scripts for n players in -run (1 by default)");
+	line("-profile f With -run, write how often each block and call ran to f.");
+	line("           When compiling, read f to inline hot calls, test hot switch");
+	line("           cases first and lay out the common path to fall through.");
+	line("           Profile an object built without -o or -profile, or nothing");
+	line("           in f will match");
+	line("-instrument");
+	line("           Count how often each block is entered in global array 63,");
+	line("           and write the source line of each counter to a .cnt file");
+	line("-counts    Write a profile from an object's .cnt file and a log of its");
+	line("           counters from Headers/Counters.acs (build it without -o)");
+	line("-o         Optimize each script and function: what a loop computes the");
+	line("           same way every time is computed before it, values computed");
+	line("           again in a block are kept in a spare local, multiplying and");
+	line("           dividing by powers of two become shifts and masks, x = x + e");
+	line("           is stored as x += e would be, negations and comparisons with");
+	line("           constants are folded into the jumps that test them, jumps");
+	line("           to jumps go straight to the end of the chain, and loops are");
+	line("           tested at the bottom, with blocks laid out so the path");
+	line("           through the innermost loops falls through");
+	line("-p[jobs]   Build every source given, and the libraries they import,");
+	line("           with up to [jobs] compiles at once (before the sources)");
 	line("-w0        Ignore all warnings"); //TODO: add warnings
 	line("-w#        Sets the desired warning level, where '#' is 1-4");
 	line("-we        Treat all warnings as errors");
@@ -293,6 +581,242 @@ static void DisplayUsage()
 	exit(1);
 }
 
+//==========================================================================
+//
+// WriteLibraryInterface
+//
+// Writes the exports of a #library next to its object, so #import can
+// read them without tokenizing the library's source. The hash covers
+// every file the library was built from, so changing one of its
+// includes makes the interface stale.
+//
+//==========================================================================
+static void WriteLibraryInterface()
+{
+	libInterface_t library;
+	string name = acs_ObjectFileName;
+
+	MS_StripFileExt(name);
+	MS_SuggestFileExt(name, ".acsi");
+	PC_GetInterface(library);
+	library.sources = TK_GetDependencies();
+	library.sourceHash = MS_HashFiles(library.sources);
+
+	if (!OBJ_WriteInterface(name, library))
+	{
+		ERR_Exit(ERR_SAVE_INTERFACE_FAILED, false, name);
+	}
+	Message(MSG_VERBOSE, "Wrote interface \"" + name + "\"");
+}
+
+//==========================================================================
+//
+// WriteDependencies
+//
+// Writes a make rule for the object, by default to <object>.d.
+//
+//==========================================================================
+static void WriteDependencies()
+{
+	string name = DepFileName;
+
+	if (name.empty())
+	{
+		name = acs_ObjectFileName;
+		MS_StripFileExt(name);
+		MS_SuggestFileExt(name, ".d");
+	}
+	if (!TK_WriteDepFile(name, acs_ObjectFileName))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, name);
+	}
+	Message(MSG_VERBOSE, "Wrote dependencies \"" + name + "\"");
+}
+
+//==========================================================================
+//
+// WriteTrace
+//
+//==========================================================================
+static void WriteTrace()
+{
+	if (!st_Tracing)
+	{
+		return;
+	}
+	if (!ST_WriteTrace(TraceFileName))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, TraceFileName);
+	}
+	Message(MSG_VERBOSE, "Wrote trace \"" + TraceFileName + "\"");
+}
+
+//==========================================================================
+//
+// WriteCounters
+//
+//==========================================================================
+static void WriteCounters()
+{
+	string name = acs_ObjectFileName;
+
+	MS_StripFileExt(name);
+	MS_SuggestFileExt(name, ".cnt");
+	if (!PF_WriteCounters(name))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, name);
+	}
+}
+
+//==========================================================================
+//
+// WriteLineMap
+//
+//==========================================================================
+static void WriteLineMap()
+{
+	string name = LineMapFile;
+
+	if (name.empty())
+	{
+		name = acs_ObjectFileName;
+		MS_StripFileExt(name);
+		MS_SuggestFileExt(name, ".lines");
+	}
+	if (!pCode_WriteLines(name))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, name);
+	}
+}
+
+//==========================================================================
+//
+// WriteSizeReport
+//
+//==========================================================================
+static void WriteSizeReport()
+{
+	if (!sz_Enabled)
+	{
+		return;
+	}
+	if (!SZ_WriteReport(acs_ObjectFileName, SizeReportFile))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, SizeReportFile.empty() ? acs_ObjectFileName : SizeReportFile);
+	}
+}
+
+//==========================================================================
+//
+// LoadObjects
+//
+// Loads the objects given to -dis or -run.
+//
+//==========================================================================
+static void LoadObjects(vector<acsObject_t> &objects)
+{
+	objects.resize(InputObjects.size());
+	for (int i = 0; i < InputObjects.size(); i++)
+	{
+		if (!OBJ_Load(InputObjects[i], objects[i]))
+		{
+			ERR_Exit(ERR_NOT_AN_OBJECT, false, InputObjects[i]);
+		}
+	}
+}
+
+//==========================================================================
+//
+// Disassemble
+//
+// Lists one object, or compares two, and exits.
+//
+//==========================================================================
+static void Disassemble()
+{
+	vector<acsObject_t> objects;
+
+	LoadObjects(objects);
+	if (objects.size() == 1)
+	{
+		DA_Disassemble(objects[0], std::cout);
+		exit(0);
+	}
+	exit(DA_Diff(objects[0], objects[1], std::cout) ? 0 : 1);
+}
+
+//==========================================================================
+//
+// RunObjects
+//
+// Runs one object and reports on it, or runs two and compares them, and
+// exits. Specials and host functions are only recorded, so the report
+// shows what the map would have been asked to do. Each run plays the
+// map at 35 tics a second, so the report also shows how the scripts'
+// work is spread over the tics.
+//
+//==========================================================================
+static void RunObjects()
+{
+	vector<acsObject_t> objects;
+	vector<vmState_t> states;
+
+	LoadObjects(objects);
+	states.resize(objects.size());
+	for (int i = 0; i < objects.size(); i++)
+	{
+		VM_Load(states[i], objects[i]);
+		if (RunTics > 0)
+			states[i].maxTics = RunTics;
+		if (RunPlayers > 0)
+			states[i].players = RunPlayers;
+		VM_RunMap(states[i]);
+	}
+	if (!ProfileFileName.empty() && !PF_Write(states[0], ProfileFileName))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, ProfileFileName);
+	}
+	if (states.size() == 1)
+	{
+		VM_Report(states[0], std::cout);
+		exit(0);
+	}
+	exit(VM_Compare(states[0], states[1], std::cout) ? 0 : 1);
+}
+
+//==========================================================================
+//
+// ReportCosts
+//
+// Exits with 1 if there were any warnings, so a build can be stopped
+// before a slow loop reaches the game.
+//
+//==========================================================================
+static void ReportCosts()
+{
+	vector<acsObject_t> objects;
+
+	LoadObjects(objects);
+	exit(CO_Report(objects[0], std::cout) ? 0 : 1);
+}
+
+//==========================================================================
+//
+// ConvertCounters
+//
+// Writes a profile from the counters an instrumented map logged, and
+// exits.
+//
+//==========================================================================
+static void ConvertCounters()
+{
+	if (!PF_ConvertCounters(InputObjects[0], InputObjects[1], InputObjects[2]))
+	{
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, InputObjects[0] + "\", \"" + InputObjects[1] + "\", \"" + InputObjects[2]);
+	}
+	exit(0);
+}
+
 //==========================================================================
 //
 // OpenDebugFile
@@ -304,4 +828,4 @@ static void OpenDebugFile(string name)
 
 	if(!acs_DebugFile.is_open)
 		ERR_Exit(ERR_CANT_OPEN_DBGFILE, false, "File: \"%s\".", name);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,436 @@
+//**************************************************************************
+//**
+//** acsgen.cpp
+//**
+//** Writes a synthetic ACS source tree for benchmarking acc. The output
+//** only depends on the options, so the same options always produce
+//** the same files.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+using std::string;
+using std::ofstream;
+using std::endl;
+using std::to_string;
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+struct genOptions_t
+{
+	string name;		// Base name of the main file
+	string dir;			// Output directory
+	int scripts;
+	int functions;
+	int depth;			// Nesting of if/while inside each body
+	int switchSize;		// Cases per switch
+	int strings;		// String literals per body
+	int arraySize;		// Entries in each initialized map array
+	int arrays;
+	int includes;		// Files included by the main file
+	bool zcommon;		// #include "zcommon.acs"
+	int enterScripts;	// Short enter scripts that delay and wait
+	int openScripts;	// Open scripts that loop forever with a delay
+	unsigned int seed;
+};
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static void ParseArgs(int argc, char **argv);
+static void Usage();
+static int Random(int range);
+static void WriteMain();
+static void WriteInclude(int index);
+static void WriteFunction(ofstream &file, const string &name, int fileIndex);
+static void WriteBody(ofstream &file, int depth, const string &indent, int budget);
+static void WriteStatement(ofstream &file, const string &indent);
+static void WriteEnterScript(ofstream &file, int number, int first);
+static void WriteOpenScript(ofstream &file, int number);
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static genOptions_t Options =
+{
+	"corpus",
+	".",
+	100,		// scripts
+	50,			// functions
+	3,			// depth
+	16,			// switchSize
+	8,			// strings
+	64,			// arraySize
+	4,			// arrays
+	4,			// includes
+	false,		// zcommon
+	0,			// enterScripts
+	0,			// openScripts
+	1			// seed
+};
+static unsigned int RandomState;
+static int StringCount;		// Keeps every literal distinct
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// main
+//
+//==========================================================================
+int main(int argc, char **argv)
+{
+	ParseArgs(argc, argv);
+	RandomState = Options.seed;
+
+	for (int i = 0; i < Options.includes; i++)
+	{
+		WriteInclude(i);
+	}
+	WriteMain();
+	return 0;
+}
+
+//==========================================================================
+//
+// ParseArgs
+//
+//==========================================================================
+static void ParseArgs(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if (arg == "-zcommon")
+		{
+			Options.zcommon = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			Usage();
+		}
+
+		string value = argv[++i];
+		int number = atoi(value.c_str());
+
+		if (arg == "-name")				Options.name = value;
+		else if (arg == "-dir")			Options.dir = value;
+		else if (arg == "-scripts")		Options.scripts = number;
+		else if (arg == "-functions")	Options.functions = number;
+		else if (arg == "-depth")		Options.depth = number;
+		else if (arg == "-switch")		Options.switchSize = number;
+		else if (arg == "-strings")		Options.strings = number;
+		else if (arg == "-arraysize")	Options.arraySize = number;
+		else if (arg == "-arrays")		Options.arrays = number;
+		else if (arg == "-includes")	Options.includes = number;
+		else if (arg == "-enter")		Options.enterScripts = number;
+		else if (arg == "-open")		Options.openScripts = number;
+		else if (arg == "-seed")		Options.seed = number;
+		else							Usage();
+	}
+}
+
+//==========================================================================
+//
+// Usage
+//
+//==========================================================================
+static void Usage()
+{
+	fprintf(stderr,
+		"Usage: acsgen [options]\n"
+		"-name <name>       Main file is <dir>/<name>.acs (corpus)\n"
+		"-dir <dir>         Output directory (.)\n"
+		"-scripts <n>       Scripts in the main file (100)\n"
+		"-functions <n>     Functions, split over the includes (50)\n"
+		"-depth <n>         Nesting of if/while/switch in bodies (3)\n"
+		"-switch <n>        Cases per switch (16)\n"
+		"-strings <n>       String literals per body (8)\n"
+		"-arrays <n>        Initialized map arrays (4)\n"
+		"-arraysize <n>     Entries per array (64)\n"
+		"-includes <n>      Files included by the main file (4)\n"
+		"-zcommon           Include zcommon.acs\n"
+		"-enter <n>         Enter scripts that delay and wait, for acc -run (0)\n"
+		"-open <n>          Open scripts that loop with a delay, for acc -run (0)\n"
+		"-seed <n>          Random seed (1)\n");
+	exit(1);
+}
+
+//==========================================================================
+//
+// Random
+//
+// A fixed LCG, so output doesn't depend on the C library.
+//
+//==========================================================================
+static int Random(int range)
+{
+	RandomState = RandomState * 1103515245u + 12345u;
+	return range > 0 ? (int)((RandomState >> 16) % (unsigned int)range) : 0;
+}
+
+//==========================================================================
+//
+// WriteMain
+//
+//==========================================================================
+static void WriteMain()
+{
+	string path = Options.dir + "/" + Options.name + ".acs";
+	ofstream file(path);
+
+	if (!file.is_open())
+	{
+		fprintf(stderr, "Couldn't write %s\n", path.c_str());
+		exit(1);
+	}
+
+	file << "// Generated by acsgen; do not edit" << endl << endl;
+	if (Options.zcommon)
+	{
+		file << "#include \"zcommon.acs\"" << endl;
+	}
+
+	// The includes use these, so they come first
+	for (int i = 0; i < Options.arrays; i++)
+	{
+		file << "int Table" << i << "[" << Options.arraySize << "] = {";
+		for (int j = 0; j < Options.arraySize; j++)
+		{
+			file << (j ? ", " : " ") << Random(10000);
+		}
+		file << " };" << endl;
+	}
+	file << "int Counter;" << endl << endl;
+
+	for (int i = 0; i < Options.includes; i++)
+	{
+		file << "#include \"" << Options.name << "_" << i << ".acs\"" << endl;
+	}
+	file << endl;
+
+	// Functions not placed in an include go here
+	for (int i = Options.includes > 0 ? Options.functions : 0; i < Options.functions; i++)
+	{
+		WriteFunction(file, "Func" + to_string(i), -1);
+	}
+
+	for (int i = 1; i <= Options.scripts; i++)
+	{
+		file << "script " << i << " (int a, int b)" << endl << "{" << endl;
+		file << "\tint x = a;" << endl << "\tint y = b;" << endl;
+		WriteBody(file, Options.depth, "\t", 4);
+		file << "}" << endl << endl;
+	}
+
+	int first = Options.scripts + 1;
+
+	for (int i = 0; i < Options.enterScripts; i++)
+	{
+		WriteEnterScript(file, first + i, first);
+	}
+	for (int i = 0; i < Options.openScripts; i++)
+	{
+		WriteOpenScript(file, first + Options.enterScripts + i);
+	}
+}
+
+//==========================================================================
+//
+// WriteInclude
+//
+// Each include gets an equal share of the functions and a few defines.
+//
+//==========================================================================
+static void WriteInclude(int index)
+{
+	string path = Options.dir + "/" + Options.name + "_" + to_string(index) + ".acs";
+	ofstream file(path);
+	int first = Options.functions * index / Options.includes;
+	int last = Options.functions * (index + 1) / Options.includes;
+
+	if (!file.is_open())
+	{
+		fprintf(stderr, "Couldn't write %s\n", path.c_str());
+		exit(1);
+	}
+
+	file << "// Generated by acsgen; do not edit" << endl << endl;
+	for (int i = 0; i < 8; i++)
+	{
+		file << "#define DEF_" << index << "_" << i << " " << Random(1000) << endl;
+	}
+	file << endl;
+	for (int i = first; i < last; i++)
+	{
+		WriteFunction(file, "Func" + to_string(i), index);
+	}
+}
+
+//==========================================================================
+//
+// WriteFunction
+//
+//==========================================================================
+static void WriteFunction(ofstream &file, const string &name, int fileIndex)
+{
+	file << "function int " << name << " (int a, int b)" << endl << "{" << endl;
+	file << "\tint x = a;" << endl << "\tint y = b;" << endl;
+	if (fileIndex >= 0)
+	{
+		file << "\tx += DEF_" << fileIndex << "_" << Random(8) << ";" << endl;
+	}
+	WriteBody(file, Options.depth, "\t", 4);
+	file << "\treturn x + y;" << endl << "}" << endl << endl;
+}
+
+//==========================================================================
+//
+// WriteBody
+//
+// Writes a mix of statements, nesting control flow up to depth levels.
+//
+//==========================================================================
+static void WriteBody(ofstream &file, int depth, const string &indent, int budget)
+{
+	string inner = indent + "\t";
+
+	for (int s = 0; s < Options.strings; s++)
+	{
+		file << indent << "Log(s:\"Message " << StringCount++ << "\", d:x);" << endl;
+	}
+	for (int i = 0; i < budget; i++)
+	{
+		WriteStatement(file, indent);
+	}
+	if (depth <= 0)
+	{
+		return;
+	}
+
+	file << indent << "if (x > " << Random(100) << " && y != " << Random(100) << ")" << endl;
+	file << indent << "{" << endl;
+	WriteBody(file, depth - 1, inner, budget / 2 + 1);
+	file << indent << "}" << endl << indent << "else" << endl << indent << "{" << endl;
+	WriteStatement(file, inner);
+	file << indent << "}" << endl;
+
+	file << indent << "while (y < " << 10 + Random(100) << ")" << endl;
+	file << indent << "{" << endl;
+	file << inner << "y += " << 1 + Random(5) << ";" << endl;
+	WriteBody(file, depth - 1, inner, budget / 2);
+	file << indent << "}" << endl;
+
+	if (Options.switchSize > 0)
+	{
+		file << indent << "switch (x % " << Options.switchSize << ")" << endl;
+		file << indent << "{" << endl;
+		for (int c = 0; c < Options.switchSize; c++)
+		{
+			file << indent << "case " << c << ":" << endl;
+			WriteStatement(file, inner);
+			file << inner << "break;" << endl;
+		}
+		file << indent << "default:" << endl << inner << "x = 0;" << endl;
+		file << indent << "}" << endl;
+	}
+}
+
+//==========================================================================
+//
+// WriteStatement
+//
+//==========================================================================
+static void WriteStatement(ofstream &file, const string &indent)
+{
+	switch (Random(6))
+	{
+	case 0:
+		file << indent << "x = x * " << 1 + Random(9) << " + y;" << endl;
+		break;
+	case 1:
+		file << indent << "y = (x << " << Random(4) << ") / " << 1 + Random(7) << ";" << endl;
+		break;
+	case 2:
+		file << indent << "x += y % " << 1 + Random(13) << ";" << endl;
+		break;
+	case 3:
+		file << indent << "Counter++;" << endl;
+		break;
+	case 4:
+		if (Options.arrays > 0)
+		{
+			file << indent << "y = Table" << Random(Options.arrays) << "[x % " << Options.arraySize << "];" << endl;
+			break;
+		}
+		// Fall through
+	default:
+		if (Options.functions > 0)
+		{
+			file << indent << "x = Func" << Random(Options.functions) << "(x, y);" << endl;
+		}
+		else
+		{
+			file << indent << "x = -y;" << endl;
+		}
+		break;
+	}
+}
+
+//==========================================================================
+//
+// WriteEnterScript
+//
+// Does a little work, then delays for up to a second. Some also wait on
+// a tag or for an earlier enter script, numbered from first, to finish.
+//
+//==========================================================================
+static void WriteEnterScript(ofstream &file, int number, int first)
+{
+	file << "script " << number << " ENTER" << endl << "{" << endl;
+	file << "\tint x = " << Random(100) << ";" << endl << "\tint y = " << Random(100) << ";" << endl;
+	WriteStatement(file, "\t");
+	WriteStatement(file, "\t");
+	file << "\tdelay(" << 1 + Random(35) << ");" << endl;
+	switch (Random(4))
+	{
+	case 0:
+		file << "\ttagwait(" << 1 + Random(16) << ");" << endl;
+		break;
+	case 1:
+		if (number > first)
+		{
+			file << "\tscriptwait(" << first + Random(number - first) << ");" << endl;
+		}
+		break;
+	}
+	WriteStatement(file, "\t");
+	file << "}" << endl << endl;
+}
+
+//==========================================================================
+//
+// WriteOpenScript
+//
+//==========================================================================
+static void WriteOpenScript(ofstream &file, int number)
+{
+	file << "script " << number << " OPEN" << endl << "{" << endl;
+	file << "\tint x = " << Random(100) << ";" << endl << "\tint y = " << Random(100) << ";" << endl;
+	file << "\twhile (1)" << endl << "\t{" << endl;
+	for (int i = 0; i < 3; i++)
+	{
+		WriteStatement(file, "\t\t");
+	}
+	file << "\t\tdelay(" << 1 + Random(8) << ");" << endl;
+	file << "\t}" << endl << "}" << endl << endl;
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+#
+# bench.sh - Compiles each generated corpus and compares against a baseline
+#
+# Usage: bench.sh <acc> <corpus dir> <baseline file> [update]
+#
+# Each corpus is <corpus dir>/<name>/<name>.acs. For each one this records
+# the best wall time of BENCH_RUNS compiles, the peak RSS (if /usr/bin/time
+# is available) and the object size. With "update" the results replace the
+# baseline; otherwise any result more than BENCH_TOLERANCE percent worse
+# than the baseline fails the run. Wall time differences under 5 ms are
+# treated as noise.
+#
+
+ACC=$1
+CORPUS=$2
+BASELINE=$3
+MODE=$4
+RUNS=${BENCH_RUNS:-3}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+HEADERS=$(dirname "$0")/../Headers
+RESULTS=$CORPUS/results.txt
+
+if [ -z "$ACC" ] || [ -z "$CORPUS" ] || [ -z "$BASELINE" ]; then
+	echo "Usage: $0 <acc> <corpus dir> <baseline file> [update]" >&2
+	exit 1
+fi
+
+now_ms() {
+	echo $(( $(date +%s%N) / 1000000 ))
+}
+
+: > "$RESULTS"
+for dir in "$CORPUS"/*/; do
+	name=$(basename "$dir")
+	source=$dir$name.acs
+	object=$dir$name.o
+	[ -f "$source" ] || continue
+
+	best=
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		start=$(now_ms)
+		if ! "$ACC" -I "$HEADERS" "$source" "$object" > /dev/null 2>&1; then
+			echo "$name: compile failed" >&2
+			exit 1
+		fi
+		wall=$(( $(now_ms) - start ))
+		if [ -z "$best" ] || [ "$wall" -lt "$best" ]; then
+			best=$wall
+		fi
+		i=$((i + 1))
+	done
+
+	rss=0
+	if [ -x /usr/bin/time ]; then
+		/usr/bin/time -f "%M" -o "$CORPUS/rss.txt" "$ACC" -I "$HEADERS" "$source" "$object" > /dev/null 2>&1
+		rss=$(tail -n 1 "$CORPUS/rss.txt")
+	fi
+	bytes=$(wc -c < "$object" | tr -d ' ')
+
+	echo "$name $best $rss $bytes" >> "$RESULTS"
+done
+
+if [ "$MODE" = "update" ]; then
+	cp "$RESULTS" "$BASELINE"
+	echo "Baseline written to $BASELINE"
+	cat "$BASELINE"
+	exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+	echo "No baseline at $BASELINE; run 'make bench-baseline' first." >&2
+	cat "$RESULTS"
+	exit 1
+fi
+
+# Compare each result with its baseline line
+awk -v tol="$TOLERANCE" '
+	function check(what, old, new, slack) {
+		if (old > 0 && new > old * (1 + tol / 100) && new - old > slack) {
+			printf "  REGRESSION: %s %s %d -> %d\n", name, what, old, new
+			failed = 1
+		}
+	}
+	NR == FNR { wall[$1] = $2; rss[$1] = $3; bytes[$1] = $4; next }
+	{
+		name = $1
+		printf "%-10s wall %6d ms (base %6d)  rss %7d kB (base %7d)  object %8d (base %8d)\n",
+			name, $2, wall[name], $3, rss[name], $4, bytes[name]
+		if (!(name in wall)) { print "  no baseline for " name; next }
+		check("wall ms", wall[name], $2, 5)
+		check("rss kB", rss[name], $3, 0)
+		if ($4 != bytes[name]) printf "  note: %s object size changed %d -> %d\n", name, bytes[name], $4
+	}
+	END { exit failed }
+' "$BASELINE" "$RESULTS"
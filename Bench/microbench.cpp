@@ -0,0 +1,306 @@
+//**************************************************************************
+//**
+//** microbench.cpp
+//**
+//** Times the compiler's subsystems on their own. Links against every
+//** object but acc.o, so it defines the globals acc.cpp would.
+//** Allocations are counted by the operator new in stats.cpp.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../common.h"
+#include "../error.h"
+#include "../misc.h"
+#include "../token.h"
+#include "../symbol.h"
+#include "../strlist.h"
+#include "../pcode.h"
+#include "../parse.h"
+#include "../stats.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define MIN_SECONDS 0.25		// Repeat each benchmark for at least this long
+#define SCRATCH_SOURCE "microbench.acs"
+#define SCRATCH_OBJECT "microbench.o"
+
+// TYPES -------------------------------------------------------------------
+
+struct benchmark_t
+{
+	const char *name;
+	void (*setup)();		// Untimed, run before each repetition
+	int (*run)();			// Returns the number of operations done
+};
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static void RunBenchmark(const benchmark_t &bench);
+static void WriteLexerSource();
+static void SetupLexer();
+static int BenchLexer();
+static void SetupSymbols();
+static int BenchSymbolInsert();
+static int BenchSymbolLookup();
+static int BenchSymbolScope();
+static void SetupStrings();
+static int BenchStringFind();
+static void SetupEmitter();
+static int BenchEmitShrink();
+static int BenchEmitNoShrink();
+static void SetupCloseNew();
+static int BenchCloseNew();
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool acs_BigEndianHost;
+bool acs_VerboseMode;
+bool acs_DebugMode;
+ofstream acs_DebugFile;
+string acs_SourceFileName;
+string acs_ErrorFileName;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static const int SymbolCount = 2000;
+static const int StringCount = 5000;
+static const int EmitCount = 100000;
+static const int ScriptCount = 900;
+
+static VecStr Names;
+
+static const benchmark_t Benchmarks[] =
+{
+	{ "lexer: TK_NextToken",			SetupLexer,		BenchLexer },
+	{ "symbols: insert",				SetupSymbols,	BenchSymbolInsert },
+	{ "symbols: lookup",				NULL,			BenchSymbolLookup },
+	{ "symbols: scope open/close",		SetupSymbols,	BenchSymbolScope },
+	{ "strings: STR_Find",				SetupStrings,	BenchStringFind },
+	{ "emitter: shrink",				SetupEmitter,	BenchEmitShrink },
+	{ "emitter: no shrink",				SetupEmitter,	BenchEmitNoShrink },
+	{ "chunks: CloseNew",				SetupCloseNew,	BenchCloseNew },
+};
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// main
+//
+//==========================================================================
+int main(int argc, char **argv)
+{
+	acs_VerboseMode = false;
+	acs_DebugMode = false;
+
+	for (int i = 0; i < StringCount || i < SymbolCount; i++)
+		Names.add("name" + to_string(i));
+
+	WriteLexerSource();
+	TK_Init();
+	sym_Init();
+	STR_Init();
+
+	printf("%-30s %12s %12s %12s\n", "benchmark", "ops", "ns/op", "allocs/op");
+	for (const benchmark_t &bench : Benchmarks)
+	{
+		if (argc > 1 && strstr(bench.name, argv[1]) == NULL)
+			continue;
+		RunBenchmark(bench);
+	}
+
+	remove(SCRATCH_SOURCE);
+	remove(SCRATCH_OBJECT);
+	return 0;
+}
+
+//==========================================================================
+//
+// RunBenchmark
+//
+// Repeats a benchmark until it has run for MIN_SECONDS, not counting
+// its setup, and prints the time and allocations per operation.
+//
+//==========================================================================
+static void RunBenchmark(const benchmark_t &bench)
+{
+	using namespace std::chrono;
+
+	double seconds = 0;
+	long long ops = 0;
+	long long allocs = 0;
+
+	while (seconds < MIN_SECONDS)
+	{
+		if (bench.setup != NULL)
+			bench.setup();
+
+		long long startAllocs = ST_AllocCount();
+		steady_clock::time_point start = steady_clock::now();
+
+		ops += bench.run();
+		seconds += duration<double>(steady_clock::now() - start).count();
+		allocs += ST_AllocCount() - startAllocs;
+	}
+
+	printf("%-30s %12lld %12.1f %12.2f\n", bench.name, ops,
+		seconds * 1e9 / ops, (double)allocs / ops);
+}
+
+//==========================================================================
+//
+// WriteLexerSource
+//
+// Writes input shaped like zdefs.acs: mostly #defines, with comments.
+//
+//==========================================================================
+static void WriteLexerSource()
+{
+	ofstream file(SCRATCH_SOURCE);
+
+	for (int i = 0; i < 20000; i++)
+	{
+		if (i % 10 == 0)
+			file << "// Group " << i / 10 << endl;
+		file << "#define " << Names[i % SymbolCount] << "_" << i << "\t\t" << i * 7
+			<< "\t// " << "value" << endl;
+	}
+}
+
+//==========================================================================
+//
+// Lexer
+//
+//==========================================================================
+static void SetupLexer()
+{
+	TK_OpenSource(SCRATCH_SOURCE);
+}
+
+static int BenchLexer()
+{
+	int tokens = 0;
+
+	while (TK_NextToken() != TK_EOF)
+		tokens++;
+	return tokens;
+}
+
+//==========================================================================
+//
+// Symbols
+//
+//==========================================================================
+static void SetupSymbols()
+{
+	sym_Init();
+}
+
+static int BenchSymbolInsert()
+{
+	for (int i = 0; i < SymbolCount; i++)
+		sym_InsertGlobal(Names[i], NODE_VARIABLE);
+	return SymbolCount;
+}
+
+// Uses the table left by the last insert run
+static int BenchSymbolLookup()
+{
+	for (int i = 0; i < SymbolCount; i++)
+		sym_Find(Names[(i * 7919) % SymbolCount]);
+	return SymbolCount;
+}
+
+// One op is a scope with ten locals, each looked up once
+static int BenchSymbolScope()
+{
+	for (int i = 0; i < 100; i++)
+	{
+		for (int j = 0; j < 10; j++)
+			sym_InsertLocal(Names[j], NODE_SCRIPTVAR);
+		for (int j = 0; j < 10; j++)
+			sym_FindLocal(Names[j]);
+		sym_ClearAtDepth(pa_CurrentDepth);
+	}
+	return 100;
+}
+
+//==========================================================================
+//
+// Strings
+//
+//==========================================================================
+static void SetupStrings()
+{
+	STR_Init();
+}
+
+// Half new literals, half repeats
+static int BenchStringFind()
+{
+	for (int i = 0; i < StringCount; i++)
+		STR_Find(Names[i / 2]);
+	return StringCount;
+}
+
+//==========================================================================
+//
+// Emitter
+//
+//==========================================================================
+static void SetupEmitter()
+{
+	PC_OpenObject(SCRATCH_OBJECT, 0, 0);
+}
+
+static int BenchEmitShrink()
+{
+	pCode_NoShrink = false;
+	for (int i = 0; i < EmitCount; i += 2)
+	{
+		pCode_AppendCommand(PCD_PUSHNUMBER);
+		pCode_AppendPushVal(i & 255);
+	}
+	return EmitCount;
+}
+
+static int BenchEmitNoShrink()
+{
+	pCode_NoShrink = true;
+	for (int i = 0; i < EmitCount; i += 2)
+	{
+		pCode_AppendCommand(PCD_PUSHNUMBER);
+		pCode_AppendPushVal(i & 255);
+	}
+	return EmitCount;
+}
+
+//==========================================================================
+//
+// CloseNew
+//
+// One op is closing an object with ScriptCount scripts.
+//
+//==========================================================================
+static void SetupCloseNew()
+{
+	PC_OpenObject(SCRATCH_OBJECT, 0, 0);
+	pCode_NoShrink = false;
+	for (int i = 1; i <= ScriptCount; i++)
+	{
+		pCode_AddScript(i, ST_CLOSED, (ScriptFlag)0, 0);
+		pCode_AppendCommand(PCD_TERMINATE);
+	}
+}
+
+static int BenchCloseNew()
+{
+	PC_CloseObject();
+	return 1;
+}
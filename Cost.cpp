@@ -0,0 +1,880 @@
+//**************************************************************************
+//**
+//** cost.cpp
+//**
+//** The -cost report: how many pcodes each script and function can run
+//** in one tic, between the latent pcodes that make it wait. A call to a
+//** function with a latent pcode in it, or in what it calls, makes the
+//** caller wait as well. ZDoom stops
+//** a script that runs too long without waiting, and every pcode before
+//** that is frame time.
+//**
+//** Each stretch between latent pcodes gets a worst cost, along its
+//** longest path, and a typical one, taking each branch half the time.
+//** A loop with no latent pcode in it is counted as many times as its
+//** counter says it runs. If it has no counter there is no telling, and
+//** it is reported.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <iomanip>
+#include "common.h"
+#include "cost.h"
+#include "opt.h"
+#include "pcode.h"
+#include "object.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define UNBOUNDED (1LL << 60)	// A cost there is no telling
+
+// TYPES -------------------------------------------------------------------
+
+// A block, or the part of one up to and including a latent pcode
+struct coPiece_t
+{
+	int block;
+	int first;			// First pcode of the block in it
+	int count;
+	long long cost;		// Pcodes, and the worst cost of the functions called
+	bool latent;		// What follows runs in a later tic
+	VecInt next;
+	VecInt back;		// 1 for each of next that goes back around a loop
+};
+
+// A loop with no latent pcode in it
+struct coLoop_t
+{
+	int header;
+	VecInt pieces;		// 1 for each piece in the loop
+	int size;
+	VecInt exits;		// Pieces outside it that it goes on to
+	long long trips;	// -1 if unknown
+};
+
+// What the report says about a body
+struct coResult_t
+{
+	string name;
+	long long worst;	// -1 if it can't be decoded
+	long long typical;
+	int waits;			// Latent pcodes and calls to functions that wait
+};
+
+// A body being looked at
+struct coBody_t
+{
+	const objBody_t *found;
+	optBody_t body;
+	vector<coPiece_t> pieces;
+	VecInt pieceOf;		// First piece of each block
+	VecInt starts;		// Pieces a tic can start at
+	vector<VecInt> preds;
+	vector<coLoop_t> loops;
+	VecInt loopAt;		// The loop each piece is the header of, or -1
+	vector<long long> extra[2];		// Worst and typical cost of the loops at each header
+};
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static void FindWaits();
+static void Analyze(int index);
+static void SplitPieces(coBody_t &cb, coResult_t &result);
+static void FindBackEdges(coBody_t &cb);
+static void Visit(coBody_t &cb, int piece, VecInt &state);
+static void FindLoops(coBody_t &cb);
+static long long TripCount(const coBody_t &cb, const coLoop_t &loop);
+static long long CountTrips(const coBody_t &cb, const coLoop_t &loop, int var, int cmp, int limit);
+static bool FindInit(const coBody_t &cb, const coLoop_t &loop, int var, int &init);
+static long long PathCost(const coBody_t &cb, int piece, const coLoop_t *loop, int mode, vector<long long> &memo);
+static long long FunctionCost(int function);
+static int FindFunction(int function);
+static bool IsLatentCall(const optInstr_t &instr);
+static int Negate(int cmp);
+static bool IsLatent(int cmd);
+static bool IsPush(const optInstr_t &instr);
+static bool WritesScriptVar(int cmd);
+static long long Add(long long a, long long b);
+static long long Multiply(long long a, long long b);
+static string CostText(long long cost);
+static int Address(const coBody_t &cb, int piece);
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static const acsObject_t *Object;
+static vector<objBody_t> Bodies;
+static vector<coResult_t> Results;
+static VecInt Done;			// 1 while a body is being looked at, 2 after
+static VecInt Waits;		// 1 for each body that can wait
+static bool Compact;
+static ostream *Out;
+static int Warnings;
+
+// Pcodes that make a script wait until a later tic
+static const int LatentCommands[] =
+{
+	PCD_SUSPEND, PCD_DELAY, PCD_DELAYDIRECT, PCD_DELAYDIRECTB, PCD_TAGWAIT,
+	PCD_TAGWAITDIRECT, PCD_POLYWAIT, PCD_POLYWAITDIRECT, PCD_SCRIPTWAIT,
+	PCD_SCRIPTWAITDIRECT, PCD_SCRIPTWAITNAMED
+};
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// CO_Report
+//
+// Prints a warning for each loop that can't be counted or runs more than
+// CO_LARGE_TRIP_COUNT times, and each body that can go over the runaway
+// limit, then the costs of every body, worst first. Returns false if
+// there were any warnings.
+//
+//==========================================================================
+bool CO_Report(const acsObject_t &object, ostream &out)
+{
+	Object = &object;
+	Out = &out;
+	Warnings = 0;
+	Compact = object.format == OBJ_FORMAT_ACSe;
+	Bodies.clear();
+	OBJ_FindBodies(object, Bodies);
+	Results.clear();
+	Results.resize(Bodies.size());
+	Done.clear();
+	Done.resize(Bodies.size());
+	FindWaits();
+
+	for (int i = 0; i < Bodies.size(); i++)
+		Analyze(i);
+
+	VecInt order;
+
+	for (int i = 0; i < Results.size(); i++)
+		order.add(i);
+	std::stable_sort(order.begin(), order.end(),
+		[&](int a, int b) { return Results[a].worst > Results[b].worst; });
+
+	if (Warnings > 0)
+		out << endl;
+	out << "\"" << object.name << "\": " << Bodies.size() << " scripts and functions, "
+		<< Warnings << " warning" << (Warnings == 1 ? "" : "s") << endl;
+	out << "      worst    typical  waits  body" << endl;
+	for (int i : order)
+	{
+		coResult_t &result = Results[i];
+
+		out << std::setw(11) << CostText(result.worst) << std::setw(11) << CostText(result.typical)
+			<< std::setw(7) << result.waits << "  " << result.name << endl;
+	}
+	return Warnings == 0;
+}
+
+//==========================================================================
+//
+// FindWaits
+//
+// Marks the bodies with a latent pcode in them, then those that call a
+// marked function, until there are no more. Functions from libraries
+// are taken not to wait.
+//
+//==========================================================================
+static void FindWaits()
+{
+	vector<VecInt> calls;
+	bool changed = true;
+
+	Waits.clear();
+	Waits.resize(Bodies.size());
+	calls.resize(Bodies.size());
+	for (int i = 0; i < Bodies.size(); i++)
+	{
+		const objBody_t &found = Bodies[i];
+		optBody_t body;
+
+		if (!OPT_Decode((const byte *)Object->data.data() + found.address, found.size,
+			found.address, Compact, body))
+		{
+			continue;
+		}
+		for (optBlock_t &block : body.blocks)
+		{
+			for (optInstr_t &instr : block.code)
+			{
+				if (IsLatent(instr.cmd))
+					Waits[i] = 1;
+				else if (instr.cmd == PCD_CALL || instr.cmd == PCD_CALLDISCARD)
+					calls[i].add(FindFunction(instr.operands[0]));
+			}
+		}
+	}
+	while (changed)
+	{
+		changed = false;
+		for (int i = 0; i < Bodies.size(); i++)
+		{
+			for (int called : calls[i])
+			{
+				if (Waits[i] == 0 && called >= 0 && Waits[called] != 0)
+				{
+					Waits[i] = 1;
+					changed = true;
+				}
+			}
+		}
+	}
+}
+
+//==========================================================================
+//
+// Analyze
+//
+// Works out the costs of a body, after those of the functions it calls.
+//
+//==========================================================================
+static void Analyze(int index)
+{
+	if (Done[index] != 0)
+		return;
+	Done[index] = 1;
+
+	const objBody_t &found = Bodies[index];
+	coResult_t &result = Results[index];
+	coBody_t cb;
+
+	result.name = found.name;
+	result.worst = -1;
+	result.typical = -1;
+	result.waits = 0;
+	cb.found = &found;
+	if (!OPT_Decode((const byte *)Object->data.data() + found.address, found.size,
+		found.address, Compact, cb.body))
+	{
+		Done[index] = 2;
+		return;
+	}
+
+	SplitPieces(cb, result);
+	FindBackEdges(cb);
+	FindLoops(cb);
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		vector<long long> memo;
+		long long cost = 0;
+
+		memo.assign(cb.pieces.size(), -1);
+		for (int start : cb.starts)
+			cost = std::max(cost, PathCost(cb, start, NULL, mode, memo));
+		if (mode == 0)
+			result.worst = cost;
+		else
+			result.typical = cost;
+	}
+	if (result.worst >= CO_RUNAWAY_LIMIT && result.worst < UNBOUNDED)
+	{
+		*Out << found.name << ": can run " << result.worst
+			<< " pcodes in one tic, more than ZDoom allows" << endl;
+		Warnings++;
+	}
+	Done[index] = 2;
+}
+
+//==========================================================================
+//
+// SplitPieces
+//
+// Splits the blocks after their latent pcodes and calls to functions
+// that wait. A tic can start at the entry and after each of them.
+// PCD_RESTART goes back to the entry in the same tic.
+//
+//==========================================================================
+static void SplitPieces(coBody_t &cb, coResult_t &result)
+{
+	VecInt lastPiece;
+
+	for (int b = 0; b < cb.body.blocks.size(); b++)
+	{
+		optBlock_t &block = cb.body.blocks[b];
+		coPiece_t piece;
+
+		piece.block = b;
+		piece.first = 0;
+		piece.cost = 0;
+		piece.latent = false;
+		cb.pieceOf.add(cb.pieces.size());
+		for (int i = 0; i < block.code.size(); i++)
+		{
+			optInstr_t &instr = block.code[i];
+
+			piece.cost = Add(piece.cost, 1);
+			if (instr.cmd == PCD_CALL || instr.cmd == PCD_CALLDISCARD)
+				piece.cost = Add(piece.cost, FunctionCost(instr.operands[0]));
+			if (!IsLatent(instr.cmd) && !IsLatentCall(instr))
+				continue;
+
+			result.waits++;
+			piece.latent = true;
+			if (i + 1 == block.code.size())
+				break;
+			piece.count = i + 1 - piece.first;
+			piece.next.add(cb.pieces.size() + 1);
+			cb.pieces.add(piece);
+			piece.next.clear();
+			piece.first = i + 1;
+			piece.cost = 0;
+			piece.latent = false;
+		}
+		piece.count = block.code.size() - piece.first;
+		lastPiece.add(cb.pieces.size());
+		cb.pieces.add(piece);
+	}
+
+	for (int b = 0; b < cb.body.blocks.size(); b++)
+	{
+		optBlock_t &block = cb.body.blocks[b];
+		coPiece_t &piece = cb.pieces[lastPiece[b]];
+
+		for (int next : OPT_Successors(block))
+			piece.next.add(cb.pieceOf[next]);
+		if (block.code.back().cmd == PCD_RESTART)
+			piece.next.add(0);
+	}
+
+	cb.starts.add(0);
+	for (coPiece_t &piece : cb.pieces)
+	{
+		piece.back.resize(piece.next.size());
+		for (int next : piece.next)
+		{
+			if (piece.latent && std::find(cb.starts.begin(), cb.starts.end(), next) == cb.starts.end())
+				cb.starts.add(next);
+		}
+	}
+}
+
+//==========================================================================
+//
+// FindBackEdges
+//
+// Follows the pieces from every start without waiting. Any way back to
+// a piece still being followed closes a loop with no latent pcode.
+//
+//==========================================================================
+static void FindBackEdges(coBody_t &cb)
+{
+	VecInt state;
+
+	state.resize(cb.pieces.size());
+	for (int start : cb.starts)
+	{
+		if (state[start] == 0)
+			Visit(cb, start, state);
+	}
+}
+
+//==========================================================================
+//
+// Visit
+//
+//==========================================================================
+static void Visit(coBody_t &cb, int piece, VecInt &state)
+{
+	coPiece_t &p = cb.pieces[piece];
+
+	state[piece] = 1;
+	for (int k = 0; !p.latent && k < p.next.size(); k++)
+	{
+		int next = p.next[k];
+
+		if (state[next] == 1)
+			p.back[k] = 1;
+		else if (state[next] == 0)
+			Visit(cb, next, state);
+	}
+	state[piece] = 2;
+}
+
+//==========================================================================
+//
+// FindLoops
+//
+// Each loop is the pieces that get back to its header without waiting.
+// Inner loops are costed first, so the outer ones can count them.
+//
+//==========================================================================
+static void FindLoops(coBody_t &cb)
+{
+	int count = cb.pieces.size();
+
+	cb.preds.resize(count);
+	for (int p = 0; p < count; p++)
+	{
+		for (int next : cb.pieces[p].next)
+		{
+			if (!cb.pieces[p].latent)
+				cb.preds[next].add(p);
+		}
+	}
+
+	for (int p = 0; p < count; p++)
+	{
+		coPiece_t &piece = cb.pieces[p];
+
+		for (int k = 0; k < piece.next.size(); k++)
+		{
+			if (!piece.back[k])
+				continue;
+
+			int header = piece.next[k];
+			int l = 0;
+
+			while (l < cb.loops.size() && cb.loops[l].header != header)
+				l++;
+			if (l == cb.loops.size())
+			{
+				coLoop_t loop;
+
+				loop.header = header;
+				loop.pieces.resize(count);
+				loop.pieces[header] = 1;
+				loop.size = 1;
+				loop.trips = -1;
+				cb.loops.add(loop);
+			}
+
+			coLoop_t &loop = cb.loops[l];
+			VecInt stack;
+
+			if (!loop.pieces[p])
+			{
+				loop.pieces[p] = 1;
+				loop.size++;
+				stack.add(p);
+			}
+			while (!stack.empty())
+			{
+				int n = stack.back();
+
+				stack.pop_back();
+				for (int pred : cb.preds[n])
+				{
+					if (!loop.pieces[pred])
+					{
+						loop.pieces[pred] = 1;
+						loop.size++;
+						stack.add(pred);
+					}
+				}
+			}
+		}
+	}
+	std::stable_sort(cb.loops.begin(), cb.loops.end(),
+		[](const coLoop_t &a, const coLoop_t &b) { return a.size < b.size; });
+
+	cb.loopAt.assign(count, -1);
+	for (int mode = 0; mode < 2; mode++)
+		cb.extra[mode].assign(count, 0);
+	for (int l = 0; l < cb.loops.size(); l++)
+	{
+		coLoop_t &loop = cb.loops[l];
+
+		cb.loopAt[loop.header] = l;
+		for (int p = 0; p < count; p++)
+		{
+			for (int next : cb.pieces[p].next)
+			{
+				if (loop.pieces[p] && !loop.pieces[next]
+					&& std::find(loop.exits.begin(), loop.exits.end(), next) == loop.exits.end())
+				{
+					loop.exits.add(next);
+				}
+			}
+		}
+		loop.trips = TripCount(cb, loop);
+		if (loop.trips < 0 || loop.trips > CO_LARGE_TRIP_COUNT)
+		{
+			*Out << cb.found->name << ": loop at " << Address(cb, loop.header) << " has no latent pcode and ";
+			if (loop.trips < 0)
+				*Out << "no known trip count" << endl;
+			else
+				*Out << "runs " << loop.trips << " times" << endl;
+			Warnings++;
+		}
+		for (int mode = 0; mode < 2; mode++)
+		{
+			vector<long long> memo;
+
+			memo.assign(count, -1);
+			cb.extra[mode][loop.header] = loop.trips < 0 ? UNBOUNDED
+				: Multiply(loop.trips, PathCost(cb, loop.header, &loop, mode, memo));
+		}
+	}
+}
+
+//==========================================================================
+//
+// TripCount
+//
+// Looks for a test that leaves the loop when a local compared with a
+// constant, such as "i < 10", stops being true. Returns -1 if there is
+// none, or the local isn't a counter.
+//
+//==========================================================================
+static long long TripCount(const coBody_t &cb, const coLoop_t &loop)
+{
+	for (int p = 0; p < cb.pieces.size(); p++)
+	{
+		const coPiece_t &piece = cb.pieces[p];
+		const optBlock_t &block = cb.body.blocks.at(piece.block);
+
+		if (!loop.pieces.at(p) || piece.count < 4 || piece.first + piece.count != block.code.size())
+			continue;
+
+		const optInstr_t &var = block.code.at(piece.first + piece.count - 4);
+		const optInstr_t &limit = block.code.at(piece.first + piece.count - 3);
+		int cmp = block.code.at(piece.first + piece.count - 2).cmd;
+		const optInstr_t &jump = block.code.back();
+
+		if ((jump.cmd != PCD_IFGOTO && jump.cmd != PCD_IFNOTGOTO)
+			|| var.cmd != PCD_PUSHSCRIPTVAR || !IsPush(limit))
+		{
+			continue;
+		}
+
+		bool targetIn = loop.pieces.at(cb.pieceOf.at(jump.operands.at(0)));
+		bool fallIn = block.next >= 0 && loop.pieces.at(cb.pieceOf.at(block.next));
+
+		if (targetIn == fallIn)
+			continue;
+		if ((jump.cmd == PCD_IFGOTO) != targetIn)
+			cmp = Negate(cmp);
+		return CountTrips(cb, loop, var.operands.at(0), cmp, limit.operands.at(0));
+	}
+	return -1;
+}
+
+//==========================================================================
+//
+// CountTrips
+//
+// How often the loop goes around while var cmp limit holds. The loop
+// must change var once, by a constant, and it must be set to a constant
+// just before the loop.
+//
+//==========================================================================
+static long long CountTrips(const coBody_t &cb, const coLoop_t &loop, int var, int cmp, int limit)
+{
+	long long step = 0;
+	int writes = 0;
+	int init;
+
+	for (int p = 0; p < cb.pieces.size(); p++)
+	{
+		const coPiece_t &piece = cb.pieces[p];
+		const optBlock_t &block = cb.body.blocks.at(piece.block);
+
+		for (int i = piece.first; loop.pieces.at(p) && i < piece.first + piece.count; i++)
+		{
+			const optInstr_t &instr = block.code.at(i);
+			bool constant = i > piece.first && IsPush(block.code.at(i - 1));
+
+			if (!WritesScriptVar(instr.cmd) || instr.operands.at(0) != var)
+				continue;
+
+			writes++;
+			if (instr.cmd == PCD_INCSCRIPTVAR)
+				step = 1;
+			else if (instr.cmd == PCD_DECSCRIPTVAR)
+				step = -1;
+			else if (instr.cmd == PCD_ADDSCRIPTVAR && constant)
+				step = block.code.at(i - 1).operands.at(0);
+			else if (instr.cmd == PCD_SUBSCRIPTVAR && constant)
+				step = -(long long)block.code.at(i - 1).operands.at(0);
+			else
+				return -1;
+		}
+	}
+	if (writes != 1 || step == 0 || !FindInit(cb, loop, var, init))
+		return -1;
+
+	long long distance = (long long)limit - init;
+
+	switch (cmp)
+	{
+	case PCD_LT:
+		return step < 0 ? -1 : distance <= 0 ? 0 : (distance + step - 1) / step;
+	case PCD_LE:
+		return step < 0 ? -1 : distance < 0 ? 0 : distance / step + 1;
+	case PCD_GT:
+		return step > 0 ? -1 : distance >= 0 ? 0 : (-distance - step - 1) / -step;
+	case PCD_GE:
+		return step > 0 ? -1 : distance > 0 ? 0 : -distance / -step + 1;
+	case PCD_NE:
+		return distance % step != 0 || distance / step < 0 ? -1 : distance / step;
+	default:
+		return -1;
+	}
+}
+
+//==========================================================================
+//
+// FindInit
+//
+// The constant var is set to in the one piece the loop is entered from.
+//
+//==========================================================================
+static bool FindInit(const coBody_t &cb, const coLoop_t &loop, int var, int &init)
+{
+	int entry = -1;
+
+	for (int p = 0; p < cb.pieces.size(); p++)
+	{
+		const VecInt &next = cb.pieces[p].next;
+
+		if (loop.pieces.at(p) || std::find(next.begin(), next.end(), loop.header) == next.end())
+			continue;
+		if (entry >= 0)
+			return false;
+		entry = p;
+	}
+	if (entry < 0)
+		return false;
+
+	const coPiece_t &piece = cb.pieces[entry];
+	const optBlock_t &block = cb.body.blocks.at(piece.block);
+
+	for (int i = piece.first + piece.count - 1; i >= piece.first; i--)
+	{
+		const optInstr_t &instr = block.code.at(i);
+
+		if (!WritesScriptVar(instr.cmd) || instr.operands.at(0) != var)
+			continue;
+		if (instr.cmd != PCD_ASSIGNSCRIPTVAR || i == piece.first || !IsPush(block.code.at(i - 1)))
+			return false;
+		init = block.code.at(i - 1).operands.at(0);
+		return true;
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// PathCost
+//
+// The cost from piece to the next wait or the end of the body: along
+// the costliest way (mode 0), or taking each way as often (mode 1).
+// With a loop, the cost of going around it once from its header.
+// Going around the loops inside is already in the cost of their headers,
+// so from a header the way on is out of its loop.
+//
+//==========================================================================
+static long long PathCost(const coBody_t &cb, int piece, const coLoop_t *loop, int mode, vector<long long> &memo)
+{
+	if (memo[piece] >= 0)
+		return memo[piece];
+
+	const coPiece_t &p = cb.pieces[piece];
+	int inner = cb.loopAt.at(piece);
+	bool exits = inner >= 0 && &cb.loops.at(inner) != loop;
+	const VecInt &way = exits ? cb.loops.at(inner).exits : p.next;
+	long long rest = 0;
+	long long total = 0;
+	int ways = 0;
+
+	for (int k = 0; !p.latent && k < way.size(); k++)
+	{
+		int next = way.at(k);
+
+		if ((!exits && p.back.at(k)) || (loop != NULL && (!loop->pieces.at(next) || next == loop->header)))
+			continue;
+
+		long long cost = PathCost(cb, next, loop, mode, memo);
+
+		rest = std::max(rest, cost);
+		total = Add(total, cost);
+		ways++;
+	}
+	if (mode == 1 && ways > 0)
+		rest = total >= UNBOUNDED ? UNBOUNDED : total / ways;
+	memo[piece] = Add(Add(p.cost, cb.extra[mode].at(piece)), rest);
+	return memo[piece];
+}
+
+//==========================================================================
+//
+// FunctionCost
+//
+// The worst cost of a call. Functions from libraries and calls back into
+// a function still being looked at count as nothing.
+//
+//==========================================================================
+static long long FunctionCost(int function)
+{
+	int i = FindFunction(function);
+
+	if (i < 0)
+		return 0;
+	Analyze(i);
+	return Done[i] == 2 ? std::max(Results[i].worst, 0LL) : 0;
+}
+
+//==========================================================================
+//
+// FindFunction
+//
+// The body of a function, or -1 if it is from a library.
+//
+//==========================================================================
+static int FindFunction(int function)
+{
+	for (int i = 0; i < Bodies.size(); i++)
+	{
+		if (Bodies[i].function == function)
+			return i;
+	}
+	return -1;
+}
+
+//==========================================================================
+//
+// IsLatentCall
+//
+// A call to a function that can wait. Its worst cost is still charged
+// before the call, which covers the part it runs before waiting.
+//
+//==========================================================================
+static bool IsLatentCall(const optInstr_t &instr)
+{
+	if (instr.cmd != PCD_CALL && instr.cmd != PCD_CALLDISCARD)
+		return false;
+
+	int i = FindFunction(instr.operands[0]);
+
+	return i >= 0 && Waits[i] != 0;
+}
+
+//==========================================================================
+//
+// Negate
+//
+// The comparison that holds when cmp doesn't, or -1 if there isn't one
+// CountTrips can use.
+//
+//==========================================================================
+static int Negate(int cmp)
+{
+	switch (cmp)
+	{
+	case PCD_LT: return PCD_GE;
+	case PCD_LE: return PCD_GT;
+	case PCD_GT: return PCD_LE;
+	case PCD_GE: return PCD_LT;
+	case PCD_EQ: return PCD_NE;
+	default: return -1;
+	}
+}
+
+//==========================================================================
+//
+// IsLatent
+//
+//==========================================================================
+static bool IsLatent(int cmd)
+{
+	for (int latent : LatentCommands)
+	{
+		if (cmd == latent)
+			return true;
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// IsPush
+//
+// Pushes a constant.
+//
+//==========================================================================
+static bool IsPush(const optInstr_t &instr)
+{
+	return instr.cmd == PCD_PUSHBYTE || instr.cmd == PCD_PUSHNUMBER;
+}
+
+//==========================================================================
+//
+// WritesScriptVar
+//
+//==========================================================================
+static bool WritesScriptVar(int cmd)
+{
+	switch (cmd)
+	{
+	case PCD_ASSIGNSCRIPTVAR:
+	case PCD_ADDSCRIPTVAR:
+	case PCD_SUBSCRIPTVAR:
+	case PCD_MULSCRIPTVAR:
+	case PCD_DIVSCRIPTVAR:
+	case PCD_MODSCRIPTVAR:
+	case PCD_INCSCRIPTVAR:
+	case PCD_DECSCRIPTVAR:
+	case PCD_ANDSCRIPTVAR:
+	case PCD_EORSCRIPTVAR:
+	case PCD_ORSCRIPTVAR:
+	case PCD_LSSCRIPTVAR:
+	case PCD_RSSCRIPTVAR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// Add
+//
+//==========================================================================
+static long long Add(long long a, long long b)
+{
+	return std::min(a + b, UNBOUNDED);
+}
+
+//==========================================================================
+//
+// Multiply
+//
+//==========================================================================
+static long long Multiply(long long a, long long b)
+{
+	if (a == 0 || b == 0)
+		return 0;
+	return a > UNBOUNDED / b ? UNBOUNDED : a * b;
+}
+
+//==========================================================================
+//
+// CostText
+//
+//==========================================================================
+static string CostText(long long cost)
+{
+	if (cost < 0)
+		return string("?");
+	if (cost >= UNBOUNDED)
+		return string("unbounded");
+	return std::to_string(cost);
+}
+
+//==========================================================================
+//
+// Address
+//
+//==========================================================================
+static int Address(const coBody_t &cb, int piece)
+{
+	const coPiece_t &p = cb.pieces.at(piece);
+
+	return cb.body.blocks.at(p.block).code.at(p.first).address;
+}
@@ -0,0 +1,574 @@
+//**************************************************************************
+//**
+//** disasm.cpp
+//**
+//** The -dis mode: lists the scripts and functions in an object, or
+//** compares two objects body by body.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <iomanip>
+#include <sstream>
+#include "common.h"
+#include "disasm.h"
+#include "pcode.h"
+#include "object.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define DIFF_CONTEXT	2		// Unchanged lines shown around a change
+
+// TYPES -------------------------------------------------------------------
+
+// An object and what the listing needs from its chunks
+struct disObject_t
+{
+	const acsObject_t *object;
+	bool compact;
+	VecStr strings;
+	VecStr functionNames;
+	VecInt functionArgs;
+	VecInt functionReturns;
+	vector<objBody_t> bodies;
+};
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static void Prepare(const acsObject_t &object, disObject_t &dis);
+static VecStr ListBody(const disObject_t &dis, const objBody_t &body, bool addresses);
+static string Operands(const disObject_t &dis, const objInstr_t &instr, const objInstr_t *next, VecInt &labels);
+static string Label(VecInt &labels, int address);
+static string StackEffect(const disObject_t &dis, const objInstr_t &instr);
+static bool TakesString(int cmd);
+static string Quote(const string &text);
+static string Address(int address);
+static string FormatName(const acsObject_t &object);
+static void DiffLines(const VecStr &before, const VecStr &after, ostream &out);
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static const char *ScriptTypes[ST_COUNT] =
+{
+	"closed", "open", "respawn", "death", "enter", "pickup",
+	"bluereturn", "redreturn", "whitereturn", "9", "10", "11",
+	"lightning", "unloading", "disconnect", "return"
+};
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// DA_Disassemble
+//
+// Lists the object's chunks, then every body with its address, pcodes,
+// operands and stack effect. Jump targets become labels local to the
+// body; string and function operands are followed by their names.
+//
+//==========================================================================
+void DA_Disassemble(const acsObject_t &object, ostream &out)
+{
+	disObject_t dis;
+
+	Prepare(object, dis);
+
+	out << "; \"" << object.name << "\": " << FormatName(object) << ", "
+		<< object.data.size() << " bytes" << endl;
+	if (object.format == OBJ_FORMAT_ACS0)
+		out << "; directory at " << Address(object.dirOffset) << endl;
+	for (const objChunk_t &chunk : object.chunks)
+	{
+		std::string id((const char *)&object.data[chunk.offset - 8], 4);
+
+		out << "; chunk " << id << " at " << Address(chunk.offset - 8)
+			<< ", " << chunk.size << " bytes" << endl;
+	}
+
+	for (objBody_t &body : dis.bodies)
+	{
+		out << endl;
+		for (string &text : ListBody(dis, body, true))
+			out << text << endl;
+	}
+}
+
+//==========================================================================
+//
+// DA_Diff
+//
+// Compares two objects: their chunk sizes, their string tables and each
+// body, matched by name. Bodies are compared without addresses, so code
+// that only moved isn't reported. Returns true if nothing differs.
+//
+//==========================================================================
+bool DA_Diff(const acsObject_t &before, const acsObject_t &after, ostream &out)
+{
+	disObject_t a, b;
+	bool same = true;
+	VecInt ids;
+
+	Prepare(before, a);
+	Prepare(after, b);
+
+	out << "--- \"" << before.name << "\": " << FormatName(before) << ", " << before.data.size() << " bytes" << endl;
+	out << "+++ \"" << after.name << "\": " << FormatName(after) << ", " << after.data.size() << " bytes" << endl;
+	if (before.format != after.format)
+		same = false;
+
+	// Chunks, by id. STRL and AINI can appear more than once, so sizes
+	// are totalled.
+	for (const objChunk_t &chunk : before.chunks)
+		ids.add(chunk.id);
+	for (const objChunk_t &chunk : after.chunks)
+		ids.add(chunk.id);
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	for (int id : ids)
+	{
+		int sizeA = 0, sizeB = 0;
+
+		for (const objChunk_t &chunk : before.chunks)
+			sizeA += chunk.id == id ? chunk.size : 0;
+		for (const objChunk_t &chunk : after.chunks)
+			sizeB += chunk.id == id ? chunk.size : 0;
+		if (sizeA != sizeB)
+		{
+			string name;
+
+			for (int i = 0; i < 4; i++)
+				name += (char)((id >> (i * 8)) & 255);
+			out << "chunk " << name << ": " << sizeA << " -> " << sizeB << " bytes" << endl;
+			same = false;
+		}
+	}
+
+	for (int i = 0; i < a.strings.size() || i < b.strings.size(); i++)
+	{
+		if (i >= b.strings.size())
+			out << "string " << i << ": " << Quote(a.strings[i]) << " removed" << endl;
+		else if (i >= a.strings.size())
+			out << "string " << i << ": " << Quote(b.strings[i]) << " added" << endl;
+		else if (a.strings[i] != b.strings[i])
+			out << "string " << i << ": " << Quote(a.strings[i]) << " -> " << Quote(b.strings[i]) << endl;
+		else
+			continue;
+		same = false;
+	}
+
+	// Bodies in the order of the first object, then new ones
+	for (objBody_t &body : a.bodies)
+	{
+		const objBody_t *match = NULL;
+
+		for (objBody_t &other : b.bodies)
+		{
+			if (other.name == body.name)
+				match = &other;
+		}
+		if (match == NULL)
+		{
+			out << "only in \"" << before.name << "\": " << body.name << endl;
+			same = false;
+			continue;
+		}
+
+		VecStr linesA = ListBody(a, body, false);
+		VecStr linesB = ListBody(b, *match, false);
+
+		if (linesA != linesB)
+		{
+			out << "@@ " << body.name << ": " << body.size << " -> " << match->size << " bytes" << endl;
+			DiffLines(linesA, linesB, out);
+			same = false;
+		}
+	}
+	for (objBody_t &body : b.bodies)
+	{
+		bool found = false;
+
+		for (objBody_t &other : a.bodies)
+			found |= other.name == body.name;
+		if (!found)
+		{
+			out << "only in \"" << after.name << "\": " << body.name << endl;
+			same = false;
+		}
+	}
+	return same;
+}
+
+//==========================================================================
+//
+// Prepare
+//
+//==========================================================================
+static void Prepare(const acsObject_t &object, disObject_t &dis)
+{
+	const objChunk_t *chunk = OBJ_FindChunk(object, MAKE4CC('F', 'U', 'N', 'C'));
+
+	dis.object = &object;
+	dis.compact = object.format == OBJ_FORMAT_ACSe;
+	dis.strings = OBJ_ReadStrings(object);
+	dis.functionNames = OBJ_ReadStringList(object, OBJ_FindChunk(object, MAKE4CC('F', 'N', 'A', 'M')));
+	for (int i = 0; chunk != NULL && i < chunk->size / 8; i++)
+	{
+		dis.functionArgs.add(OBJ_ReadByte(object, chunk->offset + i * 8));
+		dis.functionReturns.add(OBJ_ReadByte(object, chunk->offset + i * 8 + 2));
+	}
+	OBJ_FindBodies(object, dis.bodies);
+}
+
+//==========================================================================
+//
+// ListBody
+//
+// Decodes a body twice: once to find its jump targets, so they can be
+// numbered in address order, then to write it out. Without addresses
+// the lines can be compared between objects.
+//
+//==========================================================================
+static VecStr ListBody(const disObject_t &dis, const objBody_t &body, bool addresses)
+{
+	VecStr lines;
+	VecInt labels;
+	vector<objInstr_t> code;
+	int end = body.address + body.size;
+	int pos = body.address;
+	string header = body.name;
+
+	while (pos < end)
+	{
+		objInstr_t instr;
+		bool valid = OBJ_DecodeInstr((const byte *)dis.object->data.data(), end, pos, 0, dis.compact, instr);
+
+		code.add(instr);
+		pos += instr.size;
+		if (!valid)
+			break;
+
+		switch (instr.cmd)
+		{
+		case PCD_GOTO:
+		case PCD_IFGOTO:
+		case PCD_IFNOTGOTO:
+			labels.add(instr.operands[0]);
+			break;
+		case PCD_CASEGOTO:
+			labels.add(instr.operands[1]);
+			break;
+		case PCD_CASEGOTOSORTED:
+			for (int i = 2; i < instr.operands.size(); i += 2)
+				labels.add(instr.operands[i]);
+			break;
+		}
+	}
+	std::sort(labels.begin(), labels.end());
+	labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+
+	if (body.function < 0)
+	{
+		header = header + " (" + (body.type >= 0 && body.type < ST_COUNT ? string(ScriptTypes[body.type]) : string(body.type))
+			+ ", " + string(body.argCount) + " args)";
+	}
+	else
+	{
+		header = "function " + header + " (" + string(body.argCount) + " args" +
+			(body.function < dis.functionReturns.size() && dis.functionReturns[body.function] ? ", returns)" : ")");
+	}
+	if (addresses)
+		header += " at " + Address(body.address);
+	lines.add(header + ", " + string(body.size) + " bytes");
+
+	for (int i = 0; i < code.size(); i++)
+	{
+		objInstr_t &instr = code[i];
+		string text = addresses ? "  " + Address(instr.address) + "  " : "  ";
+
+		if (std::binary_search(labels.begin(), labels.end(), instr.address))
+			lines.add(Label(labels, instr.address) + ":");
+
+		if (instr.cmd < 0)
+		{
+			lines.add(text + "?? unknown or cut off pcode");
+			break;
+		}
+		text += string(pCode_Names[instr.cmd]).substr(4);
+		text += Operands(dis, instr, i + 1 < code.size() ? &code[i + 1] : NULL, labels);
+
+		string effect = StackEffect(dis, instr);
+
+		if (!effect.empty())
+		{
+			while (text.length() < (addresses ? 48 : 40))
+				text += " ";
+			text += " ; " + effect;
+		}
+		lines.add(text);
+
+		if (instr.cmd == PCD_CASEGOTOSORTED)
+		{
+			for (int j = 1; j + 1 < instr.operands.size(); j += 2)
+				lines.add("      case " + string(instr.operands[j]) + ": " + Label(labels, instr.operands[j + 1]));
+		}
+	}
+	return lines;
+}
+
+//==========================================================================
+//
+// Operands
+//
+//==========================================================================
+static string Operands(const disObject_t &dis, const objInstr_t &instr, const objInstr_t *next, VecInt &labels)
+{
+	string text;
+
+	switch (instr.cmd)
+	{
+	case PCD_GOTO:
+	case PCD_IFGOTO:
+	case PCD_IFNOTGOTO:
+		return " " + Label(labels, instr.operands[0]);
+
+	case PCD_CASEGOTO:
+		return " " + string(instr.operands[0]) + ", " + Label(labels, instr.operands[1]);
+
+	case PCD_CASEGOTOSORTED:
+		return " " + string(instr.operands[0]) + " cases";
+
+	case PCD_CALL:
+	case PCD_CALLDISCARD:
+	case PCD_PUSHFUNCTION:
+		text = " " + string(instr.operands[0]);
+		if (instr.operands[0] < dis.functionNames.size())
+			text += " " + dis.functionNames[instr.operands[0]];
+		return text;
+
+	case PCD_SETFONTDIRECT:
+		text = " " + string(instr.operands[0]);
+		if (instr.operands[0] >= 0 && instr.operands[0] < dis.strings.size())
+			text += " " + Quote(dis.strings[instr.operands[0]]);
+		return text;
+	}
+
+	for (int i = 0; i < instr.operands.size(); i++)
+		text += (i ? ", " : " ") + string(instr.operands[i]);
+
+	// A string is pushed as its index
+	if ((instr.cmd == PCD_PUSHNUMBER || instr.cmd == PCD_PUSHBYTE) && next != NULL && TakesString(next->cmd) &&
+		instr.operands[0] >= 0 && instr.operands[0] < dis.strings.size())
+	{
+		text += " " + Quote(dis.strings[instr.operands[0]]);
+	}
+	return text;
+}
+
+//==========================================================================
+//
+// Label
+//
+// Targets outside the body are shown as addresses.
+//
+//==========================================================================
+static string Label(VecInt &labels, int address)
+{
+	auto found = std::lower_bound(labels.begin(), labels.end(), address);
+
+	if (found == labels.end() || *found != address)
+		return Address(address);
+	return "L" + string((int)(found - labels.begin()) + 1);
+}
+
+//==========================================================================
+//
+// StackEffect
+//
+// Values popped and pushed, e.g. "-2 +1". Empty if the stack is left
+// alone.
+//
+//==========================================================================
+static string StackEffect(const disObject_t &dis, const objInstr_t &instr)
+{
+	int pops = pCode_Info[instr.cmd].pops;
+	int pushes = pCode_Info[instr.cmd].pushes;
+	int function = instr.operands.empty() ? -1 : instr.operands[0];
+
+	switch (instr.cmd)
+	{
+	case PCD_CALL:
+	case PCD_CALLDISCARD:
+		if (function < 0 || function >= dis.functionArgs.size())
+			return "-? +?";
+		pops = dis.functionArgs[function];
+		pushes = instr.cmd == PCD_CALL ? dis.functionReturns[function] != 0 : 0;
+		break;
+	case PCD_CALLFUNC:
+		pops = instr.operands[0];
+		break;
+	case PCD_PUSHBYTES:
+		pushes = instr.operands[0];
+		break;
+	case PCD_CALLSTACK:
+		return "-? +?";
+	}
+	if (pops == 0 && pushes == 0)
+		return "";
+	return "-" + string(pops) + " +" + string(pushes);
+}
+
+//==========================================================================
+//
+// TakesString
+//
+// Pcodes whose argument on top of the stack is a string index.
+//
+//==========================================================================
+static bool TakesString(int cmd)
+{
+	switch (cmd)
+	{
+	case PCD_PRINTSTRING:
+	case PCD_PRINTLOCALIZED:
+	case PCD_PRINTBIND:
+	case PCD_TAGSTRING:
+	case PCD_SETFONT:
+	case PCD_PLAYMOVIE:
+	case PCD_STRLEN:
+	case PCD_SCRIPTWAITNAMED:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// Quote
+//
+//==========================================================================
+static string Quote(const string &text)
+{
+	string quoted = "\"";
+
+	for (char c : text)
+	{
+		if (c == '\n')
+			quoted += "\\n";
+		else if (c == '"' || c == '\\')
+		{
+			quoted += '\\';
+			quoted += c;
+		}
+		else
+		{
+			quoted += c;
+		}
+	}
+	return quoted + "\"";
+}
+
+//==========================================================================
+//
+// Address
+//
+// Zero padded to six digits, like the debug log.
+//
+//==========================================================================
+static string Address(int address)
+{
+	std::ostringstream text;
+
+	text << std::setw(6) << std::setfill('0') << address;
+	return text.str();
+}
+
+//==========================================================================
+//
+// FormatName
+//
+//==========================================================================
+static string FormatName(const acsObject_t &object)
+{
+	switch (object.format)
+	{
+	case OBJ_FORMAT_ACS0:
+		return "ACS0 (Hexen)";
+	case OBJ_FORMAT_ACSE:
+		return string(object.data[3] == 0 ? "ACSE in ACS0" : "ACSE");
+	case OBJ_FORMAT_ACSe:
+		return string(object.data[3] == 0 ? "ACSe in ACS0" : "ACSe");
+	default:
+		return "unknown";
+	}
+}
+
+//==========================================================================
+//
+// DiffLines
+//
+// A line diff from the longest common subsequence, showing DIFF_CONTEXT
+// unchanged lines around each change.
+//
+//==========================================================================
+static void DiffLines(const VecStr &before, const VecStr &after, ostream &out)
+{
+	int n = before.size();
+	int m = after.size();
+	vector<VecInt> common;
+	VecStr lines;
+	VecInt changed;
+
+	common.resize(n + 1);
+	for (int i = 0; i <= n; i++)
+		common[i].resize(m + 1);
+	for (int i = n - 1; i >= 0; i--)
+	{
+		for (int j = m - 1; j >= 0; j--)
+		{
+			common[i][j] = before[i] == after[j] ? common[i + 1][j + 1] + 1 :
+				std::max(common[i + 1][j], common[i][j + 1]);
+		}
+	}
+
+	for (int i = 0, j = 0; i < n || j < m; )
+	{
+		if (i < n && j < m && before[i] == after[j])
+		{
+			lines.add(" " + before[i++]);
+			j++;
+			changed.add(0);
+		}
+		else if (i < n && (j == m || common[i + 1][j] >= common[i][j + 1]))
+		{
+			lines.add("-" + before[i++]);
+			changed.add(1);
+		}
+		else
+		{
+			lines.add("+" + after[j++]);
+			changed.add(1);
+		}
+	}
+
+	bool skipped = false;
+
+	for (int i = 0; i < lines.size(); i++)
+	{
+		bool near = false;
+
+		for (int j = std::max(0, i - DIFF_CONTEXT); j <= i + DIFF_CONTEXT && j < lines.size(); j++)
+			near |= changed[j] != 0;
+		if (near)
+		{
+			if (skipped)
+				out << " ..." << endl;
+			out << lines[i] << endl;
+			skipped = false;
+		}
+		else
+		{
+			skipped = true;
+		}
+	}
+}
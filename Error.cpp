@@ -86,6 +86,10 @@ static struct ErrorName
 	{ ERR_TOO_MANY_SCRIPTS, "Too many scripts." },
 	{ ERR_TOO_MANY_FUNCTIONS, "Too many functions." },
 	{ ERR_SAVE_OBJECT_FAILED, "Couldn't save object file." },
+	{ ERR_SAVE_INTERFACE_FAILED, "Couldn't save interface file.\nFile: \"%s\"" },
+	{ ERR_IMPORT_CYCLE, "Import cycle through \"%s\"." },
+	{ ERR_NOT_AN_OBJECT, "\"%s\" is not an ACS object." },
+	{ ERR_COUNTER_ARRAY_USED, "Global array %d holds the counters of -instrument." },
 	{ ERR_MISSING_LPAREN_SCR, "Missing '(' in script definition." },
 	{ ERR_INVALID_IDENTIFIER, "Invalid identifier." },
 	{ ERR_REDEFINED_IDENTIFIER, "%s : Redefined identifier." },
@@ -17,6 +17,13 @@
 #endif
 #ifdef _WIN32
 #include <sys/stat.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 #endif
 #include "common.h"
 #include "misc.h"
@@ -92,6 +99,7 @@ void MS_LoadFile(const string & name, vector<char>& DataReference)
 		ERR_Exit(ERR_CANT_OPEN_FILE, false, name);
 
 	struct stat fileInfo;
+	stat(name.c_str(), &fileInfo);
 	int size = fileInfo.st_size;
 
 	DataReference.resize(size);
@@ -119,6 +127,165 @@ bool MS_FileExists(const string & name)
 	return (ret == NULL);
 }
 
+//==========================================================================
+//
+// MS_FileTime
+//
+// Returns the last modification time of a file, or 0 if it doesn't exist.
+//
+//==========================================================================
+time_t MS_FileTime(const string & name)
+{
+	struct stat info;
+
+	if (stat(name.c_str(), &info) != 0)
+		return 0;
+
+	return info.st_mtime;
+}
+
+//==========================================================================
+//
+// MS_MapFile
+//
+// Maps a whole file read-only. Returns NULL if it can't be opened or is
+// empty. The mapping must be released with MS_UnmapFile.
+//
+//==========================================================================
+const char *MS_MapFile(const string &name, int &size)
+{
+	void *data;
+
+	size = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	size = GetFileSize(file, NULL);
+	HANDLE mapping = size > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+
+	CloseHandle(file);
+	if (mapping == NULL)
+		return NULL;
+
+	// The view keeps the mapping alive
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+#else
+	struct stat info;
+	int file = open(name.c_str(), O_RDONLY);
+
+	if (file < 0)
+		return NULL;
+
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		close(file);
+		return NULL;
+	}
+	size = info.st_size;
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (data == MAP_FAILED)
+		data = NULL;
+#endif
+	return (const char *)data;
+}
+
+//==========================================================================
+//
+// MS_UnmapFile
+//
+//==========================================================================
+void MS_UnmapFile(const char *data, int size)
+{
+	if (data == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+}
+
+//==========================================================================
+//
+// MS_HashFile
+//
+// 32 bit FNV-1a hash of a file's contents, for spotting stale outputs.
+// Returns 0 if the file can't be read.
+//
+//==========================================================================
+unsigned int MS_HashFile(const string &name)
+{
+	int size;
+	const char *data = MS_MapFile(name, size);
+	unsigned int hash = 2166136261u;
+
+	if (data == NULL)
+		return 0;
+
+	for (int i = 0; i < size; i++)
+	{
+		hash ^= (byte)data[i];
+		hash *= 16777619u;
+	}
+	MS_UnmapFile(data, size);
+	return hash;
+}
+
+//==========================================================================
+//
+// MS_HashFiles
+//
+// Combines the MS_HashFile of each file, in order, so changing any of
+// them changes the result.
+//
+//==========================================================================
+unsigned int MS_HashFiles(const VecStr &names)
+{
+	unsigned int hash = 2166136261u;
+
+	for (const string &name : names)
+	{
+		hash ^= MS_HashFile(name);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+//==========================================================================
+//
+// MS_PeakMemory
+//
+// Returns the most memory the process has had resident, in bytes.
+//
+//==========================================================================
+long long MS_PeakMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return usage.ru_maxrss * 1024LL;
+#endif
+#endif
+}
+
 //==========================================================================
 //
 // MS_SaveFile
@@ -176,6 +343,9 @@ bool MS_IsDirectoryDelimiter(char foo)
 //
 // MS_StripFileExt
 //
+// Removes the extension and its dot, so MS_SuggestFileExt can add
+// another.
+//
 //==========================================================================
 void MS_StripFileExt(string &name)
 {
@@ -185,7 +355,7 @@ void MS_StripFileExt(string &name)
 	{
 		if(name[c] == '.')
 		{
-			name = name.substr(0, c + 1);
+			name = name.substr(0, c);
 			return;
 		}
 	}
@@ -211,6 +381,34 @@ bool MS_StripFilename(string &name)
 	return true;
 }
 
+//==========================================================================
+//
+// MS_EscapeMakePath
+//
+// Escapes a path for use in a make rule.
+//
+//==========================================================================
+string MS_EscapeMakePath(const string &path)
+{
+	string escaped;
+
+	for (char c : path)
+	{
+		switch (c)
+		{
+		case ' ':
+		case '#':
+			escaped += '\\';
+			break;
+		case '$':
+			escaped += '$';
+			break;
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
 //==========================================================================
 //
 // Message_X [JRT]
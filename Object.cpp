@@ -0,0 +1,901 @@
+//**************************************************************************
+//**
+//** object.cpp
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+#include "object.h"
+#include "pcode.h"
+#include "misc.h"
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+// EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static bool ReadChunks(acsObject_t &object, int start, int end);
+static int ReadInt(const char *data, int size, int offset);
+static string ReadString(const char *data, int size, int offset);
+static void PutInt(vector<char> &data, int value);
+static void AddBody(vector<objBody_t> &bodies, const string &name, int address, int type, int argCount, int function);
+static int ReadOperand(const byte *data, int size);
+
+// EXTERNAL DATA DECLARATIONS ----------------------------------------------
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// OBJ_Load
+//
+// Loads an object and finds its chunks. Returns false if the file is
+// missing or isn't something acc could have written.
+//
+//==========================================================================
+bool OBJ_Load(const string &name, acsObject_t &object)
+{
+	if (!MS_FileExists(name))
+		return false;
+
+	object.name = name;
+	MS_LoadFile(name, object.data);
+	return OBJ_Parse(object);
+}
+
+//==========================================================================
+//
+// OBJ_Parse
+//
+// See CloseNew for the layout. A new format object is a Hexen object
+// whose directory offset points just past the chunk list, with the
+// "ACSE" or "ACSe" marker and the offset of the first chunk in front of it.
+//
+//==========================================================================
+bool OBJ_Parse(acsObject_t &object)
+{
+	int size = object.data.size();
+
+	object.format = OBJ_FORMAT_NONE;
+	object.chunks.clear();
+
+	if (size < 8 || object.data[0] != 'A' || object.data[1] != 'C' || object.data[2] != 'S')
+		return false;
+
+	object.dirOffset = OBJ_ReadInt(object, 4);
+
+	if (object.dirOffset < 8 || object.dirOffset > size)
+		return false;
+
+	switch (object.data[3])
+	{
+	case 0:
+		if (object.dirOffset >= 16 && object.data[object.dirOffset - 4] == 'A' &&
+			object.data[object.dirOffset - 3] == 'C' &&
+			object.data[object.dirOffset - 2] == 'S')
+		{
+			switch (object.data[object.dirOffset - 1])
+			{
+			case 'E':
+				object.format = OBJ_FORMAT_ACSE;
+				break;
+			case 'e':
+				object.format = OBJ_FORMAT_ACSe;
+				break;
+			default:
+				object.format = OBJ_FORMAT_ACS0;
+				return true;
+			}
+			return ReadChunks(object, OBJ_ReadInt(object, object.dirOffset - 8), object.dirOffset - 8);
+		}
+		object.format = OBJ_FORMAT_ACS0;
+		return true;
+
+	case 'E':
+		object.format = OBJ_FORMAT_ACSE;
+		return ReadChunks(object, object.dirOffset, size);
+
+	case 'e':
+		object.format = OBJ_FORMAT_ACSe;
+		return ReadChunks(object, object.dirOffset, size);
+
+	default:
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// ReadChunks
+//
+//==========================================================================
+static bool ReadChunks(acsObject_t &object, int start, int end)
+{
+	if (start < 8 || start > end)
+		return false;
+
+	while (start + 8 <= end)
+	{
+		objChunk_t chunk;
+
+		chunk.id = OBJ_ReadInt(object, start);
+		chunk.size = OBJ_ReadInt(object, start + 4);
+		chunk.offset = start + 8;
+
+		if (chunk.size < 0 || chunk.offset + chunk.size > end)
+			return false;
+
+		object.chunks.add(chunk);
+		start = chunk.offset + chunk.size;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// OBJ_FindChunk
+//
+// Finds the first chunk with the given id that comes after the chunk
+// "after". Chunks such as STRL and AINI can appear more than once.
+//
+//==========================================================================
+const objChunk_t *OBJ_FindChunk(const acsObject_t &object, int id, const objChunk_t *after)
+{
+	for (const objChunk_t &chunk : object.chunks)
+	{
+		if (after != NULL)
+		{
+			if (&chunk == after)
+				after = NULL;
+		}
+		else if (chunk.id == id)
+		{
+			return &chunk;
+		}
+	}
+	return NULL;
+}
+
+//==========================================================================
+//
+// OBJ_IsLibrary
+//
+//==========================================================================
+bool OBJ_IsLibrary(const acsObject_t &object)
+{
+	return OBJ_FindChunk(object, MAKE4CC('A', 'L', 'I', 'B')) != NULL;
+}
+
+//==========================================================================
+//
+// OBJ_ReadInt
+//
+// Objects are always little endian. Reads past the end return 0.
+//
+//==========================================================================
+int OBJ_ReadInt(const acsObject_t &object, int offset)
+{
+	return ReadInt(object.data.data(), object.data.size(), offset);
+}
+
+//==========================================================================
+//
+// ReadInt
+//
+//==========================================================================
+static int ReadInt(const char *data, int size, int offset)
+{
+	if (offset < 0 || offset + 4 > size)
+		return 0;
+
+	return (byte)data[offset] | ((byte)data[offset + 1] << 8) |
+		((byte)data[offset + 2] << 16) | ((byte)data[offset + 3] << 24);
+}
+
+//==========================================================================
+//
+// OBJ_ReadWord
+//
+//==========================================================================
+int OBJ_ReadWord(const acsObject_t &object, int offset)
+{
+	if (offset < 0 || offset + 2 > (int)object.data.size())
+		return 0;
+
+	return (short)((byte)object.data[offset] | ((byte)object.data[offset + 1] << 8));
+}
+
+//==========================================================================
+//
+// OBJ_ReadByte
+//
+//==========================================================================
+int OBJ_ReadByte(const acsObject_t &object, int offset)
+{
+	if (offset < 0 || offset >= (int)object.data.size())
+		return 0;
+
+	return (byte)object.data[offset];
+}
+
+//==========================================================================
+//
+// OBJ_ReadString
+//
+//==========================================================================
+string OBJ_ReadString(const acsObject_t &object, int offset)
+{
+	return ReadString(object.data.data(), object.data.size(), offset);
+}
+
+//==========================================================================
+//
+// ReadString
+//
+//==========================================================================
+static string ReadString(const char *data, int size, int offset)
+{
+	string text;
+
+	if (offset < 0)
+		return text;
+
+	for (int i = offset; i < size && data[i] != 0; i++)
+		text.append(1, data[i]);
+
+	return text;
+}
+
+//==========================================================================
+//
+// OBJ_ReadStringList
+//
+// Reads a chunk written by STR_WriteListChunk (FNAM, MEXP, SNAM...).
+// Unnamed entries come back as empty strings so indices still line up.
+//
+//==========================================================================
+VecStr OBJ_ReadStringList(const acsObject_t &object, const objChunk_t *chunk)
+{
+	VecStr list;
+
+	if (chunk == NULL)
+		return list;
+
+	int count = OBJ_ReadInt(object, chunk->offset);
+
+	for (int i = 0; i < count && 4 + i * 4 < chunk->size; i++)
+	{
+		int ofs = OBJ_ReadInt(object, chunk->offset + 4 + i * 4);
+
+		if (ofs > 0 && ofs < chunk->size)
+			list.add(OBJ_ReadString(object, chunk->offset + ofs));
+		else
+			list.add(string());
+	}
+	return list;
+}
+
+//==========================================================================
+//
+// OBJ_ReadStrings
+//
+// Reads the string table that PCD_PUSHNUMBER operands index: the first
+// STRL or STRE chunk, or a Hexen object's string list. STRE strings are
+// decrypted as STR_WriteChunk encrypted them.
+//
+//==========================================================================
+VecStr OBJ_ReadStrings(const acsObject_t &object)
+{
+	VecStr list;
+
+	if (object.format == OBJ_FORMAT_ACS0)
+	{
+		int ofs = object.dirOffset + 4 + OBJ_ReadInt(object, object.dirOffset) * 12;
+		int count = OBJ_ReadInt(object, ofs);
+
+		for (int i = 0; i < count && ofs + 8 + i * 4 <= (int)object.data.size(); i++)
+			list.add(OBJ_ReadString(object, OBJ_ReadInt(object, ofs + 4 + i * 4)));
+		return list;
+	}
+
+	const objChunk_t *chunk = OBJ_FindChunk(object, MAKE4CC('S', 'T', 'R', 'L'));
+	bool encrypted = false;
+
+	if (chunk == NULL)
+	{
+		chunk = OBJ_FindChunk(object, MAKE4CC('S', 'T', 'R', 'E'));
+		encrypted = true;
+	}
+	if (chunk == NULL)
+		return list;
+
+	int count = OBJ_ReadInt(object, chunk->offset + 4);
+
+	for (int i = 0; i < count && 12 + i * 4 < chunk->size; i++)
+	{
+		int ofs = OBJ_ReadInt(object, chunk->offset + 12 + i * 4);
+		string text;
+
+		if (ofs > 0 && ofs < chunk->size)
+		{
+			int key = (byte)(ofs * 157135);
+
+			for (int j = chunk->offset + ofs; j < (int)object.data.size(); j++)
+			{
+				char c = encrypted ? object.data[j] ^ (byte)(key + ((j - chunk->offset - ofs) >> 1)) : object.data[j];
+
+				if (c == 0)
+					break;
+				text.append(1, c);
+			}
+		}
+		list.add(text);
+	}
+	return list;
+}
+
+//==========================================================================
+//
+// OBJ_FindBodies
+//
+// Finds every script and function with code in the object, in address
+// order. Nothing records where a body ends, so each one runs up to
+// whatever comes next: another body, the strings of a Hexen object, or
+// the first chunk. Functions imported from a library have an address
+// of 0 and are left out.
+//
+//==========================================================================
+void OBJ_FindBodies(const acsObject_t &object, vector<objBody_t> &bodies)
+{
+	int size = object.data.size();
+	int end = size;
+	int i;
+
+	bodies.clear();
+	if (object.format == OBJ_FORMAT_ACS0)
+	{
+		int count = OBJ_ReadInt(object, object.dirOffset);
+
+		for (i = 0; i < count && object.dirOffset + 16 + i * 12 <= size; i++)
+		{
+			int entry = object.dirOffset + 4 + i * 12;
+			int number = OBJ_ReadInt(object, entry);
+
+			AddBody(bodies, "script " + string(number % 1000), OBJ_ReadInt(object, entry + 4),
+				number / 1000, OBJ_ReadInt(object, entry + 8), -1);
+		}
+
+		int ofs = object.dirOffset + 4 + count * 12;
+
+		end = object.dirOffset;
+		count = OBJ_ReadInt(object, ofs);
+		for (i = 0; i < count && ofs + 8 + i * 4 <= size; i++)
+		{
+			int str = OBJ_ReadInt(object, ofs + 4 + i * 4);
+
+			if (str >= 8)
+				end = std::min(end, str);
+		}
+	}
+	else
+	{
+		VecStr scriptNames = OBJ_ReadStringList(object, OBJ_FindChunk(object, MAKE4CC('S', 'N', 'A', 'M')));
+		VecStr functionNames = OBJ_ReadStringList(object, OBJ_FindChunk(object, MAKE4CC('F', 'N', 'A', 'M')));
+		const objChunk_t *chunk = OBJ_FindChunk(object, MAKE4CC('S', 'P', 'T', 'R'));
+
+		for (i = 0; chunk != NULL && i < chunk->size / 8; i++)
+		{
+			int entry = chunk->offset + i * 8;
+			int number = OBJ_ReadWord(object, entry);
+			string name = "script " + string(number);
+
+			if (number < 0 && -1 - number < scriptNames.size())
+				name = "script \"" + scriptNames[-1 - number] + "\"";
+			AddBody(bodies, name, OBJ_ReadInt(object, entry + 4),
+				OBJ_ReadByte(object, entry + 2), OBJ_ReadByte(object, entry + 3), -1);
+		}
+
+		chunk = OBJ_FindChunk(object, MAKE4CC('F', 'U', 'N', 'C'));
+		for (i = 0; chunk != NULL && i < chunk->size / 8; i++)
+		{
+			int entry = chunk->offset + i * 8;
+
+			AddBody(bodies, i < functionNames.size() && !functionNames[i].empty() ?
+				functionNames[i] : "function " + string(i), OBJ_ReadInt(object, entry + 4),
+				0, OBJ_ReadByte(object, entry), i);
+		}
+
+		for (const objChunk_t &item : object.chunks)
+			end = std::min(end, item.offset - 8);
+		if (object.data[3] == 0)
+		{ // WadAuthor's dummy scripts come after the real ones
+			int count = OBJ_ReadInt(object, object.dirOffset);
+
+			for (i = 0; i < count && object.dirOffset + 16 + i * 12 <= size; i++)
+			{
+				int address = OBJ_ReadInt(object, object.dirOffset + 8 + i * 12);
+
+				if (address >= 8)
+					end = std::min(end, address);
+			}
+		}
+	}
+
+	std::sort(bodies.begin(), bodies.end(),
+		[](const objBody_t &a, const objBody_t &b) { return a.address < b.address; });
+
+	// Drop anything outside the code, and bodies listed twice
+	vector<objBody_t> found;
+
+	for (objBody_t &body : bodies)
+	{
+		if (body.address >= 8 && body.address < end &&
+			(found.empty() || found.lastAdded().address != body.address))
+		{
+			found.add(body);
+		}
+	}
+	for (i = 0; i < found.size(); i++)
+		found[i].size = (i + 1 < found.size() ? found[i + 1].address : end) - found[i].address;
+	bodies = found;
+}
+
+//==========================================================================
+//
+// AddBody
+//
+//==========================================================================
+static void AddBody(vector<objBody_t> &bodies, const string &name, int address, int type, int argCount, int function)
+{
+	objBody_t body;
+
+	body.name = name;
+	body.address = address;
+	body.size = 0;
+	body.type = type;
+	body.argCount = argCount;
+	body.function = function;
+	bodies.add(body);
+}
+
+//==========================================================================
+//
+// OBJ_OperandSize
+//
+// Bytes an operand takes, by its letter in pCode_Info. Compact objects
+// write 'c' as a byte and 'w' as a word.
+//
+//==========================================================================
+int OBJ_OperandSize(char op, bool compact)
+{
+	switch (op)
+	{
+	case 'c':
+	case 'b':
+		return op == 'b' || compact ? 1 : 4;
+	case 'w':
+		return compact ? 2 : 4;
+	default:
+		return 4;
+	}
+}
+
+//==========================================================================
+//
+// OBJ_DecodeInstr
+//
+// Reads the pcode at pos in code, which was read from address start.
+// Compact objects write pcodes below 240 as one byte. The 16 values
+// above select a page, and the next byte is the pcode in that page;
+// see pCode_AppendCommand. Other objects use an int for every pcode.
+// The sorted case table is aligned to the address in the object, not
+// in code. Returns false, with cmd -1, if the pcode is unknown or runs
+// past size.
+//
+//==========================================================================
+bool OBJ_DecodeInstr(const byte *code, int size, int pos, int start, bool compact, objInstr_t &instr)
+{
+	int first = pos;
+
+	instr.address = start + pos;
+	instr.cmd = -1;
+	instr.size = 0;
+	instr.operands.clear();
+
+	int cmd;
+
+	if (compact)
+	{
+		if (pos + 1 > size)
+			return false;
+		cmd = code[pos++];
+		if (cmd >= 256 - 16)
+		{
+			if (pos + 1 > size)
+				return false;
+			cmd = (256 - 16) + ((cmd - (256 - 16)) << 8) + code[pos++];
+		}
+	}
+	else
+	{
+		if (pos + 4 > size)
+			return false;
+		cmd = ReadOperand(code + pos, 4);
+		pos += 4;
+	}
+	instr.size = pos - first;
+	if (cmd < 0 || cmd >= PCODE_COMMAND_COUNT)
+		return false;
+
+	for (const char *op = pCode_Info[cmd].operands; *op != 0; op++)
+	{
+		int count, width;
+
+		switch (*op)
+		{
+		case 'n':
+			if (pos + 1 > size || pos + 1 + code[pos] > size)
+				return false;
+			count = code[pos++];
+			instr.operands.add(count);
+			for (int i = 0; i < count; i++)
+				instr.operands.add(code[pos++]);
+			break;
+		case 's':
+			pos = ((start + pos + 3) & ~3) - start;
+			if (pos + 4 > size)
+				return false;
+			count = ReadOperand(code + pos, 4);
+			pos += 4;
+			if (count < 0 || count > (size - pos) / 8)
+				return false;
+			instr.operands.add(count);
+			for (int i = 0; i < count * 2; i++, pos += 4)
+				instr.operands.add(ReadOperand(code + pos, 4));
+			break;
+		default:
+			width = OBJ_OperandSize(*op, compact);
+			if (pos + width > size)
+				return false;
+			instr.operands.add(ReadOperand(code + pos, width));
+			pos += width;
+			break;
+		}
+	}
+	instr.cmd = cmd;
+	instr.size = pos - first;
+	return true;
+}
+
+//==========================================================================
+//
+// ReadOperand
+//
+// Little endian, as the object is. Bytes and words are unsigned.
+//
+//==========================================================================
+static int ReadOperand(const byte *data, int size)
+{
+	int value = 0;
+
+	for (int i = 0; i < size; i++)
+		value |= data[i] << (i * 8);
+	return value;
+}
+
+//==========================================================================
+//
+// OBJ_ReadLibrary
+//
+// Collects a library's exports from its object: functions from FUNC and
+// FNAM, map variables from MEXP and MSTR, arrays from ARAY and ASTR,
+// the files it was built from from LDEP, and the rest from LDEF.
+// Returns false if the object isn't a library or has no LDEF, which
+// older compilers didn't write.
+//
+//==========================================================================
+bool OBJ_ReadLibrary(const acsObject_t &object, libInterface_t &library)
+{
+	const objChunk_t *chunk;
+	const objChunk_t *defs = OBJ_FindChunk(object, MAKE4CC('L', 'D', 'E', 'F'));
+	int i, ofs, count;
+
+	if (!OBJ_IsLibrary(object) || defs == NULL)
+		return false;
+
+	ofs = defs->offset;
+	library.name = OBJ_ReadString(object, ofs);
+	ofs += library.name.length() + 1;
+
+	// Files the library was built from
+	chunk = OBJ_FindChunk(object, MAKE4CC('L', 'D', 'E', 'P'));
+	for (i = 0; chunk != NULL && i < chunk->size; )
+	{
+		string source = OBJ_ReadString(object, chunk->offset + i);
+
+		library.sources.add(source);
+		i += source.length() + 1;
+	}
+
+	// Functions. The ones without an address are imported by the library
+	// itself, and aren't visible when importing its source either.
+	chunk = OBJ_FindChunk(object, MAKE4CC('F', 'U', 'N', 'C'));
+	if (chunk != NULL)
+	{
+		VecStr names = OBJ_ReadStringList(object, OBJ_FindChunk(object, MAKE4CC('F', 'N', 'A', 'M')));
+
+		for (i = 0; i < chunk->size / 8 && i < names.size(); i++)
+		{
+			int entry = chunk->offset + i * 8;
+
+			if (OBJ_ReadInt(object, entry + 4) != 0)
+				library.functions.add({ names[i], OBJ_ReadByte(object, entry), OBJ_ReadByte(object, entry + 2) != 0 });
+		}
+	}
+
+	// Map variables, indexed as in the library. Unnamed ones are
+	// imported by the library itself and are left out at the end.
+	VecStr names = OBJ_ReadStringList(object, OBJ_FindChunk(object, MAKE4CC('M', 'E', 'X', 'P')));
+	vector<libVariable_t> vars;
+
+	for (i = 0; i < names.size(); i++)
+		vars.add({ names[i], false, 0, VecInt() });
+
+	chunk = OBJ_FindChunk(object, MAKE4CC('A', 'R', 'A', 'Y'));
+	for (i = 0; chunk != NULL && i < chunk->size / 8; i++)
+	{
+		int index = OBJ_ReadInt(object, chunk->offset + i * 8);
+
+		if (index >= 0 && index < vars.size())
+		{
+			vars[index].size = OBJ_ReadInt(object, chunk->offset + i * 8 + 4);
+			vars[index].dims.add(vars[index].size);
+		}
+	}
+
+	chunk = OBJ_FindChunk(object, MAKE4CC('M', 'S', 'T', 'R'));
+	for (i = 0; chunk != NULL && i < chunk->size / 4; i++)
+	{
+		int index = OBJ_ReadInt(object, chunk->offset + i * 4);
+
+		if (index >= 0 && index < vars.size())
+			vars[index].isString = true;
+	}
+
+	chunk = OBJ_FindChunk(object, MAKE4CC('A', 'S', 'T', 'R'));
+	for (i = 0; chunk != NULL && i < chunk->size / 4; i++)
+	{
+		int index = OBJ_ReadInt(object, chunk->offset + i * 4);
+
+		if (index >= 0 && index < vars.size())
+			vars[index].isString = true;
+	}
+
+	// #libdefines
+	count = OBJ_ReadInt(object, ofs);
+	ofs += 4;
+	for (i = 0; i < count; i++)
+	{
+		libDefine_t def;
+
+		def.value = OBJ_ReadInt(object, ofs);
+		def.name = OBJ_ReadString(object, ofs + 4);
+		ofs += 5 + def.name.length();
+		library.defines.add(def);
+	}
+
+	// Dimensions of multidimensional arrays
+	count = OBJ_ReadInt(object, ofs);
+	ofs += 4;
+	for (i = 0; i < count; i++)
+	{
+		int index = OBJ_ReadInt(object, ofs);
+		int ndim = OBJ_ReadInt(object, ofs + 4);
+
+		ofs += 8;
+		if (ndim < 0 || ofs + ndim * 4 > defs->offset + defs->size)
+			break;
+		if (index >= 0 && index < vars.size())
+		{
+			vars[index].dims.clear();
+			for (int d = 0; d < ndim; d++)
+				vars[index].dims.add(OBJ_ReadInt(object, ofs + d * 4));
+		}
+		ofs += ndim * 4;
+	}
+
+	for (libVariable_t &var : vars)
+	{
+		if (!var.name.empty())
+			library.variables.add(var);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// OBJ_WriteInterface
+//
+// Writes a library interface file. Everything is a little endian int at
+// a 4 byte aligned offset, and all references are file offsets, so the
+// file can be used straight from a mapping.
+//
+//   0   "ACSI"
+//   4   INTERFACE_VERSION
+//   8   Hash of the files the library was built from, from MS_HashFiles
+//   12  Offset of the #library name
+//   16  Function count, offset of function table
+//   24  Variable count, offset of variable table
+//   32  #libdefine count, offset of #libdefine table
+//   40  Source count, offset of source table
+//
+//   Source:   name offset
+//   Function: name offset, arg count, 1 if it returns a value
+//   Variable: name offset, 1 if it holds strings, array size (0 for
+//             plain variables), dimension count, offset of dimensions
+//   Define:   name offset, value
+//
+// The array dimensions follow the tables, then the names.
+//
+//==========================================================================
+bool OBJ_WriteInterface(const string &name, const libInterface_t &library)
+{
+	vector<char> data;
+	vector<char> names;
+	int dimOfs, nameOfs;
+	int i;
+
+	int funcOfs = 48 + library.sources.size() * 4;
+
+	dimOfs = funcOfs + library.functions.size() * 12 + library.variables.size() * 20 +
+		library.defines.size() * 8;
+	nameOfs = dimOfs;
+	for (const libVariable_t &var : library.variables)
+		nameOfs += var.dims.size() * 4;
+
+	auto AddName = [&](const string &text)
+	{
+		int ofs = nameOfs + names.size();
+
+		names.insert(names.end(), text.begin(), text.end());
+		names.push_back(0);
+		return ofs;
+	};
+
+	PutInt(data, MAKE4CC('A', 'C', 'S', 'I'));
+	PutInt(data, INTERFACE_VERSION);
+	PutInt(data, library.sourceHash);
+	PutInt(data, AddName(library.name));
+	PutInt(data, library.functions.size());
+	PutInt(data, funcOfs);
+	PutInt(data, library.variables.size());
+	PutInt(data, funcOfs + library.functions.size() * 12);
+	PutInt(data, library.defines.size());
+	PutInt(data, funcOfs + library.functions.size() * 12 + library.variables.size() * 20);
+	PutInt(data, library.sources.size());
+	PutInt(data, 48);
+
+	for (const string &source : library.sources)
+		PutInt(data, AddName(source));
+
+	for (const libFunction_t &func : library.functions)
+	{
+		PutInt(data, AddName(func.name));
+		PutInt(data, func.argCount);
+		PutInt(data, func.hasReturnValue ? 1 : 0);
+	}
+	for (const libVariable_t &var : library.variables)
+	{
+		PutInt(data, AddName(var.name));
+		PutInt(data, var.isString ? 1 : 0);
+		PutInt(data, var.size);
+		PutInt(data, var.dims.size());
+		PutInt(data, dimOfs);
+		dimOfs += var.dims.size() * 4;
+	}
+	for (const libDefine_t &def : library.defines)
+	{
+		PutInt(data, AddName(def.name));
+		PutInt(data, def.value);
+	}
+	for (const libVariable_t &var : library.variables)
+	{
+		for (i = 0; i < var.dims.size(); i++)
+			PutInt(data, var.dims[i]);
+	}
+	data.insert(data.end(), names.begin(), names.end());
+
+	return MS_SaveFile(name, data);
+}
+
+//==========================================================================
+//
+// OBJ_LoadInterface
+//
+// Reads a file written by OBJ_WriteInterface in place from a mapping.
+// Returns false if it is missing or not a current interface file.
+//
+//==========================================================================
+bool OBJ_LoadInterface(const string &name, libInterface_t &library)
+{
+	int size;
+	const char *data = MS_MapFile(name, size);
+
+	if (data == NULL)
+		return false;
+
+	if (ReadInt(data, size, 0) != MAKE4CC('A', 'C', 'S', 'I') ||
+		ReadInt(data, size, 4) != INTERFACE_VERSION || size < 48)
+	{
+		MS_UnmapFile(data, size);
+		return false;
+	}
+
+	library.sourceHash = ReadInt(data, size, 8);
+	library.name = ReadString(data, size, ReadInt(data, size, 12));
+
+	int count = ReadInt(data, size, 40);
+	int ofs = ReadInt(data, size, 44);
+
+	for (int i = 0; i < count && ofs + 4 <= size; i++, ofs += 4)
+		library.sources.add(ReadString(data, size, ReadInt(data, size, ofs)));
+
+	count = ReadInt(data, size, 16);
+	ofs = ReadInt(data, size, 20);
+	for (int i = 0; i < count && ofs + 12 <= size; i++, ofs += 12)
+	{
+		library.functions.add({ ReadString(data, size, ReadInt(data, size, ofs)),
+			ReadInt(data, size, ofs + 4), ReadInt(data, size, ofs + 8) != 0 });
+	}
+
+	count = ReadInt(data, size, 24);
+	ofs = ReadInt(data, size, 28);
+	for (int i = 0; i < count && ofs + 20 <= size; i++, ofs += 20)
+	{
+		libVariable_t var;
+		int ndim = ReadInt(data, size, ofs + 12);
+		int dims = ReadInt(data, size, ofs + 16);
+
+		var.name = ReadString(data, size, ReadInt(data, size, ofs));
+		var.isString = ReadInt(data, size, ofs + 4) != 0;
+		var.size = ReadInt(data, size, ofs + 8);
+		for (int d = 0; d < ndim && dims + d * 4 < size; d++)
+			var.dims.add(ReadInt(data, size, dims + d * 4));
+		library.variables.add(var);
+	}
+
+	count = ReadInt(data, size, 32);
+	ofs = ReadInt(data, size, 36);
+	for (int i = 0; i < count && ofs + 8 <= size; i++, ofs += 8)
+	{
+		library.defines.add({ ReadString(data, size, ReadInt(data, size, ofs)),
+			ReadInt(data, size, ofs + 4) });
+	}
+
+	MS_UnmapFile(data, size);
+	return true;
+}
+
+//==========================================================================
+//
+// PutInt
+//
+//==========================================================================
+static void PutInt(vector<char> &data, int value)
+{
+	data.push_back(value & 255);
+	data.push_back((value >> 8) & 255);
+	data.push_back((value >> 16) & 255);
+	data.push_back((value >> 24) & 255);
+}
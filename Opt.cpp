@@ -0,0 +1,2836 @@
+//**************************************************************************
+//**
+//** opt.cpp
+//**
+//** Reworks each script and function once it has been emitted. The body
+//** is read back from the pcode buffer and split into basic blocks, so
+//** they can be moved around and joined by new jumps; a body is only
+//** written back if something changed.
+//**
+//** With a profile from -run, hot calls to functions defined earlier
+//** are inlined, the hottest switch cases are tested first, and blocks
+//** are laid out so the common path falls through. With -instrument,
+//** every block counts how often it is entered.
+//**
+//** With -o, what a loop computes the same way on every trip is
+//** computed once before it, values computed more than once in a
+//** block are kept in a spare local the first time, and multiplying
+//** and dividing by powers of two become shifts and masks. Stores of
+//** an operation on the variable stored to become compound assignments,
+//** conditions are tested without computing a negation or comparing
+//** with a constant first, and jumps to jumps are threaded through.
+//** Short loop tests are copied to the bottom of the loop, and without
+//** a profile, blocks are laid out as if each loop ran many times.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <cstring>
+#include "common.h"
+#include "opt.h"
+#include "pcode.h"
+#include "object.h"
+#include "profile.h"
+
+// MACROS ------------------------------------------------------------------
+
+// Columns of VarCommands, and its rows that matter
+#define VAR_PUSH		0
+#define VAR_ASSIGN		1
+#define VAR_FIRST_OP	2
+#define VAR_INC			12
+#define VAR_DEC			13
+#define VAR_COMMANDS	14
+#define VAR_SCRIPT		0
+#define VAR_FIRST_ARRAY	4
+
+// What a pcode in PureCommands does besides compute its result
+#define PURE_READS		1		// Reads map, world or global variables
+#define PURE_BUILTIN	2		// Asks the game
+#define PURE_TRAPS		4		// Ends the script if an operand is bad
+
+// TYPES -------------------------------------------------------------------
+
+// Where an instruction went when its body was written back
+struct optMove_t
+{
+	int from;
+	int to;
+	int size;
+};
+
+// A function that can be inlined: compiled earlier, with every call in
+// it filled in
+struct optFunction_t
+{
+	int number;
+	int argCount;
+	optBody_t body;
+};
+
+// A call the profile says is worth inlining
+struct optSite_t
+{
+	int block;
+	int index;
+	long long count;
+	const optFunction_t *callee;
+};
+
+// The value an instruction leaves on the stack
+struct optValue_t
+{
+	int start;		// First of the instructions that compute it, or -1 if they aren't a run of their own
+	int number;		// Values known to be equal have the same number, or -1
+	int flags;		// PURE_ flags of those instructions
+};
+
+// A value computed earlier in the block: its pcode and operands, then
+// the numbers of the values it pops
+struct optKnown_t
+{
+	VecInt key;
+	int number;
+};
+
+// A loop: its header, which dominates the rest of its blocks
+struct optLoop_t
+{
+	int header;
+	VecInt blocks;
+};
+
+struct optPure_t
+{
+	int cmd;
+	int flags;
+};
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static int WriteInstr(vector<byte> *out, const optInstr_t &instr, int address, bool compact, const VecInt *blockAddress);
+static void Put(vector<byte> *out, int &pos, int value, int size);
+static vector<byte> Encode(const optBody_t &body, vector<optMove_t> &moves);
+static bool NeedsJump(const optBody_t &body, int position);
+static bool InlineCalls(optBody_t &body, const pfBody_t &profile);
+static void Inline(optBody_t &body, const optSite_t &site, int base);
+static bool Simplify(optBody_t &body);
+static void SplitPushes(optBody_t &body);
+static void JoinPushes(optBody_t &body);
+static bool HoistInvariants(optBody_t &body);
+static int Hoist(optBody_t &body, const optLoop_t &loop);
+static bool Invariant(const vector<optInstr_t> &code, int start, int end, const VecInt &written, bool barrier);
+static bool ReuseValues(optBody_t &body);
+static bool ReuseValue(optBlock_t &block, int temp);
+static vector<optValue_t> Values(const vector<optInstr_t> &code);
+static bool ReduceStrength(optBody_t &body);
+static bool ReduceOne(vector<optInstr_t> &code, const VecInt &locals, bool compact);
+static bool Reduce(int cmd, int value, bool positive, bool compact, vector<optInstr_t> &with);
+static VecInt NonNegativeLocals(const optBody_t &body);
+static VecInt NonNegative(const vector<optInstr_t> &code, const VecInt &locals);
+static bool FuseAssignments(optBody_t &body);
+static bool FuseOne(vector<optInstr_t> &code);
+static bool LowerConditions(optBody_t &body);
+static bool FoldTest(vector<optInstr_t> &code);
+static bool CaseTest(optBody_t &body, int block);
+static bool ThreadJumps(optBody_t &body);
+static bool RotateLoops(optBody_t &body);
+static void GuessCounts(optBody_t &body);
+static bool OrderCases(optBody_t &body);
+static bool SortCaseChain(optBody_t &body, int head, const VecInt &preds, VecInt &seen);
+static bool PeelCases(optBody_t &body, int block);
+static bool Layout(optBody_t &body);
+static VecInt CallBlocks(const optBody_t &body);
+static void Instrument(const string &name, unsigned int hash, int blockCount, const VecInt &callBlocks, optBody_t &body);
+static VecInt Predecessors(const optBody_t &body);
+static void InsertAfter(optBody_t &body, int block, const VecInt &blocks);
+static vector<optLoop_t> FindLoops(const optBody_t &body);
+static void Retarget(optBlock_t &block, int from, int to);
+static optInstr_t MakeInstr(int cmd, int operand1 = 0, int operand2 = 0);
+static optInstr_t MakeConstant(int value, bool compact);
+static int InstrCount(const optBody_t &body);
+static int TargetCount(const optInstr_t &instr);
+static int TargetIndex(int cmd, int target);
+static bool FallsThrough(int cmd);
+static bool EndsBlock(int cmd);
+static int InverseCompare(int cmd);
+static bool IsScriptVar(int cmd);
+static int VarKind(int cmd);
+static bool VarWrite(int cmd);
+static bool StackEffect(const optInstr_t &instr, int &pops, int &pushes);
+static int PureFlags(int cmd);
+static bool IsPure(int cmd);
+static bool IsConstant(const optInstr_t &instr, int &value);
+static bool Contains(const VecInt &list, int value);
+static bool HasPending(const optBody_t &body, const optInstr_t &instr);
+static int PowerOfTwo(int value);
+static int MaxLocals();
+static bool MayUse(int cmd);
+static const optFunction_t *FindFunction(int number);
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool opt_Enabled;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static vector<optMove_t> Moves;
+static vector<optFunction_t> Functions;
+static optBody_t LastBody;
+static bool LastBodyValid;
+
+// The pcodes that work on each kind of variable: push, assign, the
+// compound assignments and increment and decrement. The variable is
+// the first operand; arrays pop an index before the value. Pcodes on
+// locals must be moved to the caller's spare locals when their function
+// is inlined.
+static const int VarCommands[][VAR_COMMANDS] =
+{
+	{ PCD_PUSHSCRIPTVAR, PCD_ASSIGNSCRIPTVAR, PCD_ADDSCRIPTVAR, PCD_SUBSCRIPTVAR,
+		PCD_MULSCRIPTVAR, PCD_DIVSCRIPTVAR, PCD_MODSCRIPTVAR, PCD_ANDSCRIPTVAR,
+		PCD_EORSCRIPTVAR, PCD_ORSCRIPTVAR, PCD_LSSCRIPTVAR, PCD_RSSCRIPTVAR,
+		PCD_INCSCRIPTVAR, PCD_DECSCRIPTVAR },
+	{ PCD_PUSHMAPVAR, PCD_ASSIGNMAPVAR, PCD_ADDMAPVAR, PCD_SUBMAPVAR,
+		PCD_MULMAPVAR, PCD_DIVMAPVAR, PCD_MODMAPVAR, PCD_ANDMAPVAR,
+		PCD_EORMAPVAR, PCD_ORMAPVAR, PCD_LSMAPVAR, PCD_RSMAPVAR,
+		PCD_INCMAPVAR, PCD_DECMAPVAR },
+	{ PCD_PUSHWORLDVAR, PCD_ASSIGNWORLDVAR, PCD_ADDWORLDVAR, PCD_SUBWORLDVAR,
+		PCD_MULWORLDVAR, PCD_DIVWORLDVAR, PCD_MODWORLDVAR, PCD_ANDWORLDVAR,
+		PCD_EORWORLDVAR, PCD_ORWORLDVAR, PCD_LSWORLDVAR, PCD_RSWORLDVAR,
+		PCD_INCWORLDVAR, PCD_DECWORLDVAR },
+	{ PCD_PUSHGLOBALVAR, PCD_ASSIGNGLOBALVAR, PCD_ADDGLOBALVAR, PCD_SUBGLOBALVAR,
+		PCD_MULGLOBALVAR, PCD_DIVGLOBALVAR, PCD_MODGLOBALVAR, PCD_ANDGLOBALVAR,
+		PCD_EORGLOBALVAR, PCD_ORGLOBALVAR, PCD_LSGLOBALVAR, PCD_RSGLOBALVAR,
+		PCD_INCGLOBALVAR, PCD_DECGLOBALVAR },
+	{ PCD_PUSHMAPARRAY, PCD_ASSIGNMAPARRAY, PCD_ADDMAPARRAY, PCD_SUBMAPARRAY,
+		PCD_MULMAPARRAY, PCD_DIVMAPARRAY, PCD_MODMAPARRAY, PCD_ANDMAPARRAY,
+		PCD_EORMAPARRAY, PCD_ORMAPARRAY, PCD_LSMAPARRAY, PCD_RSMAPARRAY,
+		PCD_INCMAPARRAY, PCD_DECMAPARRAY },
+	{ PCD_PUSHWORLDARRAY, PCD_ASSIGNWORLDARRAY, PCD_ADDWORLDARRAY, PCD_SUBWORLDARRAY,
+		PCD_MULWORLDARRAY, PCD_DIVWORLDARRAY, PCD_MODWORLDARRAY, PCD_ANDWORLDARRAY,
+		PCD_EORWORLDARRAY, PCD_ORWORLDARRAY, PCD_LSWORLDARRAY, PCD_RSWORLDARRAY,
+		PCD_INCWORLDARRAY, PCD_DECWORLDARRAY },
+	{ PCD_PUSHGLOBALARRAY, PCD_ASSIGNGLOBALARRAY, PCD_ADDGLOBALARRAY, PCD_SUBGLOBALARRAY,
+		PCD_MULGLOBALARRAY, PCD_DIVGLOBALARRAY, PCD_MODGLOBALARRAY, PCD_ANDGLOBALARRAY,
+		PCD_EORGLOBALARRAY, PCD_ORGLOBALARRAY, PCD_LSGLOBALARRAY, PCD_RSGLOBALARRAY,
+		PCD_INCGLOBALARRAY, PCD_DECGLOBALARRAY }
+};
+
+// The operators of the compound assignments, in VarCommands' order
+static const int FusedOperators[] =
+{
+	PCD_ADD, PCD_SUBTRACT, PCD_MULTIPLY, PCD_DIVIDE, PCD_MODULUS,
+	PCD_ANDBITWISE, PCD_EORBITWISE, PCD_ORBITWISE, PCD_LSHIFT, PCD_RSHIFT
+};
+
+// Pcodes whose result only depends on their operands and what they
+// read. Nothing but a write can change what they read, and a script
+// runs on its own until it waits, so builtins are in here too.
+static const optPure_t PureCommands[] =
+{
+	{ PCD_PUSHNUMBER, 0 }, { PCD_PUSHBYTE, 0 }, { PCD_PUSHSCRIPTVAR, 0 },
+	{ PCD_PUSHMAPVAR, PURE_READS }, { PCD_PUSHWORLDVAR, PURE_READS },
+	{ PCD_PUSHGLOBALVAR, PURE_READS }, { PCD_PUSHMAPARRAY, PURE_READS },
+	{ PCD_PUSHWORLDARRAY, PURE_READS }, { PCD_PUSHGLOBALARRAY, PURE_READS },
+	{ PCD_ADD, 0 }, { PCD_SUBTRACT, 0 }, { PCD_MULTIPLY, 0 },
+	{ PCD_DIVIDE, PURE_TRAPS }, { PCD_MODULUS, PURE_TRAPS },
+	{ PCD_EQ, 0 }, { PCD_NE, 0 }, { PCD_LT, 0 }, { PCD_GT, 0 }, { PCD_LE, 0 }, { PCD_GE, 0 },
+	{ PCD_ANDLOGICAL, 0 }, { PCD_ORLOGICAL, 0 }, { PCD_ANDBITWISE, 0 },
+	{ PCD_ORBITWISE, 0 }, { PCD_EORBITWISE, 0 }, { PCD_NEGATELOGICAL, 0 },
+	{ PCD_NEGATEBINARY, 0 }, { PCD_LSHIFT, 0 }, { PCD_RSHIFT, 0 }, { PCD_UNARYMINUS, 0 },
+	{ PCD_FIXEDMUL, 0 }, { PCD_FIXEDDIV, PURE_TRAPS },
+	{ PCD_SIN, 0 }, { PCD_COS, 0 }, { PCD_VECTORANGLE, 0 },
+	{ PCD_STRLEN, PURE_BUILTIN }, { PCD_GETACTORX, PURE_BUILTIN },
+	{ PCD_GETACTORY, PURE_BUILTIN }, { PCD_GETACTORZ, PURE_BUILTIN },
+	{ PCD_GETACTORFLOORZ, PURE_BUILTIN }, { PCD_GETACTORCEILINGZ, PURE_BUILTIN },
+	{ PCD_GETACTORANGLE, PURE_BUILTIN }, { PCD_GETACTORPITCH, PURE_BUILTIN },
+	{ PCD_GETACTORLIGHTLEVEL, PURE_BUILTIN }, { PCD_GETACTORPROPERTY, PURE_BUILTIN },
+	{ PCD_GETSECTORFLOORZ, PURE_BUILTIN }, { PCD_GETSECTORCEILINGZ, PURE_BUILTIN },
+	{ PCD_GETSECTORLIGHTLEVEL, PURE_BUILTIN }, { PCD_THINGCOUNT, PURE_BUILTIN },
+	{ PCD_THINGCOUNTNAME, PURE_BUILTIN }, { PCD_THINGCOUNTSECTOR, PURE_BUILTIN },
+	{ PCD_THINGCOUNTNAMESECTOR, PURE_BUILTIN }, { PCD_CHECKINVENTORY, PURE_BUILTIN },
+	{ PCD_CHECKACTORINVENTORY, PURE_BUILTIN }, { PCD_CLASSIFYACTOR, PURE_BUILTIN },
+	{ PCD_PLAYERCOUNT, PURE_BUILTIN }, { PCD_PLAYERNUMBER, PURE_BUILTIN },
+	{ PCD_PLAYERINGAME, PURE_BUILTIN }, { PCD_PLAYERISBOT, PURE_BUILTIN },
+	{ PCD_GETPLAYERINFO, PURE_BUILTIN }, { PCD_ACTIVATORTID, PURE_BUILTIN },
+	{ PCD_GAMETYPE, PURE_BUILTIN }, { PCD_GAMESKILL, PURE_BUILTIN },
+	{ PCD_SINGLEPLAYER, PURE_BUILTIN }, { PCD_TIMER, PURE_BUILTIN },
+	{ PCD_LINESIDE, PURE_BUILTIN }, { PCD_GETLEVELINFO, PURE_BUILTIN }
+};
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// OPT_Decode
+//
+// Splits a body into blocks: one starts at every jump target and after
+// every jump or return. Zeros and NOPs at the end are padding. Returns
+// false if the body can't be decoded, jumps somewhere that isn't an
+// instruction in it, or runs off its end.
+//
+//==========================================================================
+bool OPT_Decode(const byte *code, int size, int start, bool compact, optBody_t &body)
+{
+	vector<optInstr_t> instrs;
+	VecInt addresses;
+	int end = size;
+	int pos = 0;
+
+	body.start = start;
+	body.compact = compact;
+	body.argCount = 0;
+	body.varCount = 0;
+	body.blocks.clear();
+	body.order.clear();
+	body.pending.clear();
+
+	while (end > 0 && code[end - 1] == 0)
+		end--;
+	while (pos < end)
+	{
+		objInstr_t read;
+		optInstr_t instr;
+
+		if (!OBJ_DecodeInstr(code, size, pos, start, compact, read))
+			return false;
+		instr.cmd = read.cmd;
+		instr.operands = read.operands;
+		instr.address = read.address;
+		instr.size = read.size;
+		instrs.add(instr);
+		pos += instr.size;
+	}
+	while (!instrs.empty() && instrs.back().cmd == PCD_NOP)
+		instrs.pop_back();
+	if (instrs.empty() || FallsThrough(instrs.back().cmd))
+		return false;
+
+	int count = instrs.size();
+	VecInt blockOf;
+	VecInt leader;
+
+	leader.resize(count);
+	leader[0] = 1;
+	for (optInstr_t &instr : instrs)
+		addresses.add(instr.address);
+	for (int i = 0; i < count; i++)
+	{
+		optInstr_t &instr = instrs[i];
+
+		for (int t = 0; t < TargetCount(instr); t++)
+		{
+			int target = instr.operands[TargetIndex(instr.cmd, t)];
+			auto found = std::lower_bound(addresses.begin(), addresses.end(), target);
+
+			if (found == addresses.end() || *found != target)
+				return false;
+			leader[found - addresses.begin()] = 1;
+		}
+		if (EndsBlock(instr.cmd) && i + 1 < count)
+			leader[i + 1] = 1;
+	}
+
+	blockOf.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		if (leader[i])
+		{
+			optBlock_t block;
+
+			block.next = -1;
+			block.count = -1;
+			body.order.add(body.blocks.size());
+			body.blocks.add(block);
+		}
+		blockOf[i] = body.blocks.size() - 1;
+		body.blocks.back().code.add(instrs[i]);
+	}
+
+	for (int b = 0; b < body.blocks.size(); b++)
+	{
+		optBlock_t &block = body.blocks[b];
+
+		for (optInstr_t &instr : block.code)
+		{
+			for (int t = 0; t < TargetCount(instr); t++)
+			{
+				int &target = instr.operands[TargetIndex(instr.cmd, t)];
+
+				target = blockOf[std::lower_bound(addresses.begin(), addresses.end(), target) - addresses.begin()];
+			}
+		}
+		if (FallsThrough(block.code.back().cmd))
+			block.next = b + 1;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// OPT_Hash
+//
+// Identifies a body in a profile. Block numbers stand in for addresses,
+// so the body hashes the same wherever it is in the object, and function
+// numbers are left out, since they are still unknown while calls wait to
+// be filled in.
+//
+//==========================================================================
+unsigned int OPT_Hash(const optBody_t &body)
+{
+	unsigned int hash = 2166136261u;
+	auto mix = [&](int value)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			hash ^= (value >> (i * 8)) & 255;
+			hash *= 16777619u;
+		}
+	};
+
+	mix(body.compact);
+	for (const optBlock_t &block : body.blocks)
+	{
+		mix(block.code.size());
+		for (const optInstr_t &instr : block.code)
+		{
+			mix(instr.cmd);
+			if (instr.cmd == PCD_CALL || instr.cmd == PCD_CALLDISCARD)
+				continue;
+			for (int operand : instr.operands)
+				mix(operand);
+		}
+		mix(block.next);
+	}
+	return hash;
+}
+
+//==========================================================================
+//
+// OPT_Body
+//
+// Called when a script or function has been emitted from start to the
+// end of the buffer, with its argument and variable counts and the
+// operand addresses of the calls in it that are still to be filled in.
+// Returns its variable count, which grows if functions are inlined.
+// Afterwards, OPT_NewAddress finds where the instructions in it went.
+//
+//==========================================================================
+int OPT_Body(const string &name, int start, int argCount, int varCount, const VecInt &pending)
+{
+	Moves.clear();
+	LastBodyValid = false;
+	if (!PF_Loaded() && !pf_Instrument && !opt_Enabled)
+		return varCount;
+
+	vector<byte> code = pCode_ReadCode(start);
+	optBody_t body;
+
+	if (!OPT_Decode(code.data(), code.size(), start, !pCode_NoShrink, body))
+		return varCount;
+	body.argCount = argCount;
+	body.varCount = varCount;
+	body.pending = pending;
+
+	unsigned int hash = OPT_Hash(body);
+	int blockCount = body.blocks.size();
+	VecInt callBlocks;
+	const pfBody_t *profile = PF_FindBody(name, hash);
+	bool counted = profile != NULL && profile->blocks.size() == body.blocks.size();
+	bool changed = false;
+
+	if (pf_Instrument)
+		callBlocks = CallBlocks(body);
+	if (counted)
+	{
+		for (int b = 0; b < body.blocks.size(); b++)
+			body.blocks[b].count = profile->blocks.at(b);
+		changed |= InlineCalls(body, *profile);
+	}
+	if (opt_Enabled)
+		changed |= Simplify(body);
+	if (opt_Enabled && !counted)
+		GuessCounts(body);
+	if (counted)
+		changed |= OrderCases(body);
+	if (counted || opt_Enabled)
+		changed |= Layout(body);
+	LastBody = body;
+	LastBodyValid = true;
+	if (pf_Instrument)
+	{
+		Instrument(name, hash, blockCount, callBlocks, body);
+		changed = true;
+	}
+	if (changed)
+	{
+		VecInt from, to;
+
+		pCode_ReplaceCode(start, Encode(body, Moves));
+		for (optMove_t &move : Moves)
+		{
+			from.add(move.from);
+			to.add(move.to);
+		}
+		pCode_MoveLines(start, from, to);
+	}
+	return body.varCount;
+}
+
+//==========================================================================
+//
+// OPT_AddFunction
+//
+// Called after OPT_Body for a function's body. It can be inlined into
+// the bodies that follow if every call in it has been filled in.
+//
+//==========================================================================
+void OPT_AddFunction(int number, int argCount)
+{
+	if (!LastBodyValid || !LastBody.pending.empty())
+		return;
+
+	optFunction_t function;
+
+	function.number = number;
+	function.argCount = argCount;
+	function.body = LastBody;
+	Functions.add(function);
+}
+
+//==========================================================================
+//
+// OPT_NewAddress
+//
+// Where something emitted in the last body went, such as a call's
+// operand that is still to be filled in.
+//
+//==========================================================================
+int OPT_NewAddress(int address)
+{
+	for (optMove_t &move : Moves)
+	{
+		if (address >= move.from && address < move.from + move.size)
+			return move.to + address - move.from;
+	}
+	return address;
+}
+
+//==========================================================================
+//
+// OPT_Successors
+//
+// The blocks that can run after this one: the one it falls through to,
+// then the ones it jumps to.
+//
+//==========================================================================
+VecInt OPT_Successors(const optBlock_t &block)
+{
+	VecInt next;
+
+	if (block.next >= 0)
+		next.add(block.next);
+	if (block.code.empty())
+		return next;
+
+	const optInstr_t &last = block.code.back();
+
+	for (int t = 0; t < TargetCount(last); t++)
+		next.add(last.operands.at(TargetIndex(last.cmd, t)));
+	return next;
+}
+
+//==========================================================================
+//
+// Encode
+//
+// Lays the blocks out in order, adding a PCD_GOTO wherever a block's
+// fall through isn't the one after it. Jumps are resolved once every
+// block's address is known.
+//
+//==========================================================================
+static vector<byte> Encode(const optBody_t &body, vector<optMove_t> &moves)
+{
+	vector<byte> out;
+	VecInt blockAddress;
+	optInstr_t jump = MakeInstr(PCD_GOTO);
+	int pos = body.start;
+
+	blockAddress.resize(body.blocks.size());
+	for (int k = 0; k < body.order.size(); k++)
+	{
+		const optBlock_t &block = body.blocks.at(body.order.at(k));
+
+		blockAddress[body.order.at(k)] = pos;
+		for (const optInstr_t &instr : block.code)
+			pos += WriteInstr(NULL, instr, pos, body.compact, NULL);
+		if (NeedsJump(body, k))
+			pos += WriteInstr(NULL, jump, pos, body.compact, NULL);
+	}
+
+	moves.clear();
+	pos = body.start;
+	for (int k = 0; k < body.order.size(); k++)
+	{
+		const optBlock_t &block = body.blocks.at(body.order.at(k));
+
+		for (const optInstr_t &instr : block.code)
+		{
+			if (instr.address >= 0)
+				moves.add({ instr.address, pos, instr.size });
+			pos += WriteInstr(&out, instr, pos, body.compact, &blockAddress);
+		}
+		if (NeedsJump(body, k))
+		{
+			jump.operands[0] = block.next;
+			pos += WriteInstr(&out, jump, pos, body.compact, &blockAddress);
+		}
+	}
+	return out;
+}
+
+//==========================================================================
+//
+// NeedsJump
+//
+// Whether the block at position has to jump to the one it falls through
+// to. Blocks that are empty and go nowhere take no room in between.
+//
+//==========================================================================
+static bool NeedsJump(const optBody_t &body, int position)
+{
+	int next = body.blocks.at(body.order.at(position)).next;
+	int k = position + 1;
+
+	while (k < body.order.size() && body.blocks.at(body.order.at(k)).code.empty()
+		&& body.blocks.at(body.order.at(k)).next < 0)
+	{
+		k++;
+	}
+	return next >= 0 && (k == body.order.size() || body.order.at(k) != next);
+}
+
+//==========================================================================
+//
+// WriteInstr
+//
+// Writes an instruction at address, with its jumps resolved through
+// blockAddress, and returns its size. With no out, only the size is
+// worked out.
+//
+//==========================================================================
+static int WriteInstr(vector<byte> *out, const optInstr_t &instr, int address, bool compact, const VecInt *blockAddress)
+{
+	VecInt operands = instr.operands;
+	int pos = address;
+	int k = 0;
+
+	for (int t = 0; blockAddress != NULL && t < TargetCount(instr); t++)
+	{
+		int &target = operands[TargetIndex(instr.cmd, t)];
+
+		target = blockAddress->at(target);
+	}
+
+	if (!compact)
+	{
+		Put(out, pos, instr.cmd, 4);
+	}
+	else if (instr.cmd < 256 - 16)
+	{
+		Put(out, pos, instr.cmd, 1);
+	}
+	else
+	{
+		Put(out, pos, ((instr.cmd - (256 - 16)) >> 8) + (256 - 16), 1);
+		Put(out, pos, (instr.cmd - (256 - 16)) & 255, 1);
+	}
+
+	for (const char *op = pCode_Info[instr.cmd].operands; *op != 0; op++)
+	{
+		int count = operands[k];
+
+		switch (*op)
+		{
+		case 'n':
+			for (int i = 0; i <= count; i++)
+				Put(out, pos, operands[k + i], 1);
+			k += 1 + count;
+			break;
+		case 's':
+			while (pos & 3)
+				Put(out, pos, 0, 1);
+			for (int i = 0; i <= count * 2; i++)
+				Put(out, pos, operands[k + i], 4);
+			k += 1 + count * 2;
+			break;
+		default:
+			Put(out, pos, count, OBJ_OperandSize(*op, compact));
+			k++;
+			break;
+		}
+	}
+	return pos - address;
+}
+
+//==========================================================================
+//
+// Put
+//
+//==========================================================================
+static void Put(vector<byte> *out, int &pos, int value, int size)
+{
+	for (int i = 0; out != NULL && i < size; i++)
+		out->add((value >> (i * 8)) & 255);
+	pos += size;
+}
+
+//==========================================================================
+//
+// InlineCalls
+//
+// Inlines the calls the profile counts OPT_INLINE_MIN_CALLS or more
+// times, hottest first, until the body has grown by as much as it was
+// or by OPT_INLINE_MAX_SIZE pcodes. The copies are never running at the
+// same time, so they share the locals after the body's own.
+//
+//==========================================================================
+static bool InlineCalls(optBody_t &body, const pfBody_t &profile)
+{
+	vector<optSite_t> sites;
+	vector<optSite_t> chosen;
+	int budget = std::max(OPT_INLINE_MAX_SIZE, InstrCount(body));
+	int base = body.varCount;
+	int ordinal = 0;
+
+	for (int b = 0; b < body.blocks.size(); b++)
+	{
+		optBlock_t &block = body.blocks[b];
+
+		for (int i = 0; i < block.code.size(); i++)
+		{
+			optInstr_t &instr = block.code[i];
+
+			if (instr.cmd != PCD_CALL && instr.cmd != PCD_CALLDISCARD)
+				continue;
+
+			optSite_t site;
+
+			site.block = b;
+			site.index = i;
+			site.count = ordinal < profile.calls.size() ? profile.calls.at(ordinal) : 0;
+			site.callee = HasPending(body, instr) ? NULL : FindFunction(instr.operands[0]);
+			ordinal++;
+			if (site.callee != NULL && site.count >= OPT_INLINE_MIN_CALLS)
+				sites.add(site);
+		}
+	}
+	std::stable_sort(sites.begin(), sites.end(),
+		[](const optSite_t &a, const optSite_t &b) { return a.count > b.count; });
+
+	for (optSite_t &site : sites)
+	{
+		int size = InstrCount(site.callee->body);
+
+		if (size > OPT_INLINE_MAX_SIZE || size > budget
+			|| base + site.callee->body.varCount > MaxLocals())
+		{
+			continue;
+		}
+		budget -= size;
+		body.varCount = std::max(body.varCount, base + site.callee->body.varCount);
+		chosen.add(site);
+	}
+
+	// From the end of each block, so the sites before are left in place
+	std::sort(chosen.begin(), chosen.end(), [](const optSite_t &a, const optSite_t &b)
+		{ return a.block != b.block ? a.block > b.block : a.index > b.index; });
+	for (optSite_t &site : chosen)
+		Inline(body, site, base);
+	return !chosen.empty();
+}
+
+//==========================================================================
+//
+// Inline
+//
+// Splits the call's block after the call and puts a copy of the callee
+// between the halves. The copy starts by popping the arguments into its
+// locals and clearing the rest, as PCD_CALL would, and its returns go to
+// the second half. A value returned to PCD_CALLDISCARD is dropped.
+//
+//==========================================================================
+static void Inline(optBody_t &body, const optSite_t &site, int base)
+{
+	const optFunction_t &callee = *site.callee;
+	const optBody_t &code = callee.body;
+	bool discard = body.blocks[site.block].code[site.index].cmd == PCD_CALLDISCARD;
+	long long entryCount = code.blocks.at(0).count;
+	int first = body.blocks.size();
+	int prologue = first + code.blocks.size();
+	int rest = prologue + 1;
+	optBlock_t start, after;
+	VecInt added;
+
+	optBlock_t &split = body.blocks[site.block];
+
+	after.code.assign(split.code.begin() + site.index + 1, split.code.end());
+	after.next = split.next;
+	after.count = split.count;
+	split.code.resize(site.index);
+	split.next = prologue;
+
+	for (int b = 0; b < code.blocks.size(); b++)
+	{
+		optBlock_t block = code.blocks.at(b);
+		// Layout and threading can leave a callee's blocks empty
+		int last = block.code.empty() ? PCD_NOP : block.code.back().cmd;
+
+		if (block.count >= 0 && entryCount > 0)
+			block.count = block.count * site.count / entryCount;
+		else
+			block.count = site.count;
+		if (block.next >= 0)
+			block.next += first;
+		for (optInstr_t &instr : block.code)
+		{
+			instr.address = -1;
+			for (int t = 0; t < TargetCount(instr); t++)
+				instr.operands[TargetIndex(instr.cmd, t)] += first;
+			if (IsScriptVar(instr.cmd))
+				instr.operands[0] += base;
+		}
+		if (last == PCD_RETURNVAL && discard)
+		{
+			block.code.back() = MakeInstr(PCD_DROP);
+			block.next = rest;
+		}
+		else if (last == PCD_RETURNVAL || last == PCD_RETURNVOID)
+		{
+			block.code.pop_back();
+			block.next = rest;
+		}
+		body.blocks.add(block);
+	}
+
+	for (int i = callee.argCount - 1; i >= 0; i--)
+		start.code.add(MakeInstr(PCD_ASSIGNSCRIPTVAR, base + i));
+	for (int i = callee.argCount; i < code.varCount; i++)
+	{
+		start.code.add(MakeInstr(body.compact ? PCD_PUSHBYTE : PCD_PUSHNUMBER, 0));
+		start.code.add(MakeInstr(PCD_ASSIGNSCRIPTVAR, base + i));
+	}
+	start.next = first;
+	start.count = site.count;
+	body.blocks.add(start);
+	body.blocks.add(after);
+
+	added.add(prologue);
+	for (int b : code.order)
+		added.add(first + b);
+	added.add(rest);
+	InsertAfter(body, site.block, added);
+}
+
+//==========================================================================
+//
+// Simplify
+//
+// The passes -o turns on. They work on single pushes, so runs of bytes
+// pushed together are split first and joined again after.
+//
+//==========================================================================
+static bool Simplify(optBody_t &body)
+{
+	bool changed = false;
+
+	SplitPushes(body);
+	changed |= HoistInvariants(body);
+	changed |= ReuseValues(body);
+	changed |= ReduceStrength(body);
+	changed |= FuseAssignments(body);
+	changed |= LowerConditions(body);
+	changed |= ThreadJumps(body);
+	changed |= RotateLoops(body);
+	JoinPushes(body);
+	return changed;
+}
+
+//==========================================================================
+//
+// SplitPushes
+//
+//==========================================================================
+static void SplitPushes(optBody_t &body)
+{
+	for (optBlock_t &block : body.blocks)
+	{
+		vector<optInstr_t> code;
+
+		for (optInstr_t &instr : block.code)
+		{
+			int first = instr.cmd == PCD_PUSHBYTES ? 1 : 0;
+			int count = instr.cmd == PCD_PUSHBYTES ? instr.operands[0]
+				: instr.cmd - PCD_PUSH2BYTES + 2;
+
+			if (instr.cmd != PCD_PUSHBYTES && (instr.cmd < PCD_PUSH2BYTES || instr.cmd > PCD_PUSH5BYTES))
+			{
+				code.add(instr);
+				continue;
+			}
+			for (int i = 0; i < count; i++)
+			{
+				optInstr_t push = MakeInstr(PCD_PUSHBYTE, instr.operands[first + i]);
+
+				if (i == 0)
+				{
+					push.address = instr.address;
+					push.size = instr.size;
+				}
+				code.add(push);
+			}
+		}
+		block.code = code;
+	}
+}
+
+//==========================================================================
+//
+// JoinPushes
+//
+// Puts runs of PCD_PUSHBYTE back together, as pCode_AppendCommand does.
+//
+//==========================================================================
+static void JoinPushes(optBody_t &body)
+{
+	for (optBlock_t &block : body.blocks)
+	{
+		vector<optInstr_t> code;
+
+		for (int i = 0; i < block.code.size(); )
+		{
+			int run = 0;
+
+			while (i + run < block.code.size() && block.code[i + run].cmd == PCD_PUSHBYTE)
+				run++;
+			if (run < 2)
+			{
+				code.add(block.code[i++]);
+				continue;
+			}
+
+			optInstr_t push = block.code[i];
+
+			push.operands.clear();
+			if (run > 5)
+			{
+				push.cmd = PCD_PUSHBYTES;
+				push.operands.add(run);
+			}
+			else
+			{
+				push.cmd = PCD_PUSH2BYTES + run - 2;
+			}
+			for (int k = 0; k < run; k++)
+				push.operands.add(block.code[i + k].operands[0]);
+			code.add(push);
+			i += run;
+		}
+		block.code = code;
+	}
+}
+
+//==========================================================================
+//
+// HoistInvariants
+//
+// Innermost loops first, so what is hoisted out of a loop into its
+// preheader can be hoisted again out of the loop around it.
+//
+//==========================================================================
+static bool HoistInvariants(optBody_t &body)
+{
+	vector<optLoop_t> loops = FindLoops(body);
+	bool changed = false;
+
+	for (int l = 0; l < loops.size(); l++)
+	{
+		int preheader = Hoist(body, loops[l]);
+
+		if (preheader < 0)
+			continue;
+		for (int m = l + 1; m < loops.size(); m++)
+		{
+			if (Contains(loops[m].blocks, loops[l].header))
+				loops[m].blocks.add(preheader);
+		}
+		changed = true;
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// Hoist
+//
+// Computes the values that are the same on every trip around a loop
+// once, in a new block before its header, and keeps each in a local of
+// its own. Returns the new block, or -1 if nothing was hoisted.
+//
+//==========================================================================
+static int Hoist(optBody_t &body, const optLoop_t &loop)
+{
+	vector<vector<optInstr_t>> exprs;
+	VecInt temps;
+	VecInt written;
+	bool barrier = false;
+
+	if (loop.header == 0)
+		return -1;
+	for (int b : loop.blocks)
+	{
+		for (const optInstr_t &instr : body.blocks.at(b).code)
+		{
+			if (VarWrite(instr.cmd))
+			{
+				written.add(VarCommands[VarKind(instr.cmd)][VAR_PUSH]);
+				written.add(instr.operands.at(0));
+			}
+			else if (!IsPure(instr.cmd) && TargetCount(instr) == 0 && instr.cmd != PCD_DROP)
+				barrier = true;
+		}
+	}
+
+	for (int b : loop.blocks)
+	{
+		vector<optInstr_t> &code = body.blocks[b].code;
+		vector<optValue_t> values = Values(code);
+
+		for (int i = values.size() - 1; i >= 0; i--)
+		{
+			int start = values[i].start;
+			int weight = 0;
+
+			if (start < 0 || values[i].number < 0 || !Invariant(code, start, i, written, barrier))
+				continue;
+			for (int k = start; k <= i; k++)
+				weight += PureFlags(code[k].cmd) & PURE_BUILTIN ? OPT_BUILTIN_WEIGHT : 1;
+			if (weight < 2)
+				continue;
+
+			vector<optInstr_t> expr;
+
+			expr.assign(code.begin() + start, code.begin() + i + 1);
+			auto same = [&](const vector<optInstr_t> &other)
+			{
+				return std::equal(expr.begin(), expr.end(), other.begin(), other.end(),
+					[](const optInstr_t &a, const optInstr_t &b) { return a.cmd == b.cmd && a.operands == b.operands; });
+			};
+			int found = std::find_if(exprs.begin(), exprs.end(), same) - exprs.begin();
+
+			if (found == exprs.size())
+			{
+				if (body.varCount >= MaxLocals())
+					continue;
+				exprs.add(expr);
+				temps.add(body.varCount++);
+			}
+			code.erase(code.begin() + start + 1, code.begin() + i + 1);
+			code[start] = MakeInstr(PCD_PUSHSCRIPTVAR, temps[found]);
+			i = start;
+		}
+	}
+	if (exprs.empty())
+		return -1;
+
+	optBlock_t preheader;
+	int number = body.blocks.size();
+	long long entered = 0;
+
+	for (int e = 0; e < exprs.size(); e++)
+	{
+		for (optInstr_t &instr : exprs[e])
+			preheader.code.add(instr);
+		preheader.code.add(MakeInstr(PCD_ASSIGNSCRIPTVAR, temps[e]));
+	}
+	for (int b = 0; b < body.blocks.size(); b++)
+	{
+		optBlock_t &block = body.blocks[b];
+		VecInt next = OPT_Successors(block);
+
+		if (Contains(loop.blocks, b) || !Contains(next, loop.header))
+			continue;
+		Retarget(block, loop.header, number);
+		entered += std::max(block.count, 0LL);
+	}
+	preheader.next = loop.header;
+	preheader.count = body.blocks[loop.header].count < 0 ? -1
+		: std::min(entered, body.blocks[loop.header].count);
+	body.blocks.add(preheader);
+	body.order.insert(std::find(body.order.begin(), body.order.end(), loop.header), number);
+	return number;
+}
+
+//==========================================================================
+//
+// Invariant
+//
+// Whether code from start to end computes the same value every time
+// through a loop that writes the variables in written, as the pcode
+// that reads each and its number, and has a pcode that can change what
+// any variable or the game holds if barrier is set. It
+// also has to be safe to compute before the loop, when it might not have
+// been computed at all, so it can only divide by a constant that can't
+// end the script.
+//
+//==========================================================================
+static bool Invariant(const vector<optInstr_t> &code, int start, int end, const VecInt &written, bool barrier)
+{
+	for (int k = start; k <= end; k++)
+	{
+		const optInstr_t &instr = code.at(k);
+		int flags = PureFlags(instr.cmd);
+		int divisor;
+
+		for (int w = 0; w < written.size(); w += 2)
+		{
+			if (instr.cmd == written.at(w) && instr.operands.at(0) == written.at(w + 1))
+				return false;
+		}
+		if (barrier && (flags & (PURE_READS | PURE_BUILTIN)))
+			return false;
+		if ((flags & PURE_TRAPS) && (instr.cmd == PCD_FIXEDDIV || k == start
+			|| !IsConstant(code.at(k - 1), divisor) || divisor == 0 || divisor == -1))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// ReuseValues
+//
+// A value a block computes more than once is kept in a spare local the
+// first time and pushed from there after. The locals are only used
+// inside their block, so every block starts over at the first spare.
+//
+//==========================================================================
+static bool ReuseValues(optBody_t &body)
+{
+	int base = body.varCount;
+	bool changed = false;
+
+	for (optBlock_t &block : body.blocks)
+	{
+		int temps = 0;
+
+		while (base + temps < MaxLocals() && ReuseValue(block, base + temps))
+			temps++;
+		body.varCount = std::max(body.varCount, base + temps);
+		changed |= temps > 0;
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// ReuseValue
+//
+// Keeps the value that saves the most pcodes in temp: one is added to
+// keep it, and every later time it is computed becomes one push.
+//
+//==========================================================================
+static bool ReuseValue(optBlock_t &block, int temp)
+{
+	vector<optValue_t> values = Values(block.code);
+	VecInt best;
+	int bestSaved = 0;
+
+	for (int i = 0; i < values.size(); i++)
+	{
+		VecInt uses;
+		int weight = 0;
+
+		if (values[i].start < 0 || values[i].number < 0)
+			continue;
+		for (int j = values[i].start; j <= i; j++)
+			weight += PureFlags(block.code[j].cmd) & PURE_BUILTIN ? OPT_BUILTIN_WEIGHT : 1;
+		uses.add(i);
+		for (int j = i + 1; j < values.size(); j++)
+		{
+			if (values[j].number == values[i].number && values[j].start > uses.back())
+				uses.add(j);
+		}
+
+		int saved = (uses.size() - 1) * (weight - 1) - 2;
+
+		if (saved > bestSaved)
+		{
+			best = uses;
+			bestSaved = saved;
+		}
+	}
+	if (best.empty())
+		return false;
+
+	// From the end, so the earlier ones are left in place
+	for (int k = best.size() - 1; k > 0; k--)
+	{
+		int start = values[best[k]].start;
+
+		block.code.erase(block.code.begin() + start + 1, block.code.begin() + best[k] + 1);
+		block.code[start] = MakeInstr(PCD_PUSHSCRIPTVAR, temp);
+	}
+
+	optInstr_t keep[] = { MakeInstr(PCD_ASSIGNSCRIPTVAR, temp), MakeInstr(PCD_PUSHSCRIPTVAR, temp) };
+
+	block.code.insert(block.code.begin() + best[0] + 1, keep, keep + 2);
+	return true;
+}
+
+//==========================================================================
+//
+// Values
+//
+// Numbers the values the instructions in code push, following the
+// stack through them. A value is known by the numbers of the ones it is
+// computed from, so only reads can go stale: writing a variable forgets
+// what was read from it, and any other pcode that isn't pure forgets
+// what was read from variables and the game.
+//
+//==========================================================================
+static vector<optValue_t> Values(const vector<optInstr_t> &code)
+{
+	vector<optValue_t> values;
+	vector<optKnown_t> known;
+	VecInt stack;
+	int numbers = 0;
+
+	// With no write, what was read from variables and the game
+	auto forget = [&](const optInstr_t *write)
+	{
+		known.erase(std::remove_if(known.begin(), known.end(), [&](const optKnown_t &other)
+		{
+			if (write != NULL)
+				return other.key[0] == VarCommands[VarKind(write->cmd)][VAR_PUSH] && other.key[1] == write->operands[0];
+			return (PureFlags(other.key[0]) & (PURE_READS | PURE_BUILTIN)) != 0;
+		}), known.end());
+	};
+
+	for (int i = 0; i < code.size(); i++)
+	{
+		const optInstr_t &instr = code.at(i);
+		optValue_t value = { -1, -1, 0 };
+		int pops, pushes;
+
+		if (!StackEffect(instr, pops, pushes))
+		{
+			stack.clear();
+			forget(NULL);
+			values.add(value);
+			continue;
+		}
+
+		VecInt args;
+
+		for (int p = 0; p < pops; p++)
+		{
+			args.insert(args.begin(), stack.empty() ? -1 : stack.back());
+			if (!stack.empty())
+				stack.pop_back();
+		}
+
+		if (IsPure(instr.cmd) && pushes == 1)
+		{
+			optKnown_t entry;
+			int start = i;
+			bool whole = true;
+
+			entry.key.add(instr.cmd == PCD_PUSHBYTE ? PCD_PUSHNUMBER : instr.cmd);
+			for (int operand : instr.operands)
+				entry.key.add(operand);
+			value.flags = PureFlags(instr.cmd);
+			for (int a = args.size() - 1; a >= 0; a--)
+			{
+				const optValue_t *arg = args.at(a) >= 0 ? &values.at(args.at(a)) : NULL;
+
+				whole = whole && arg != NULL && arg->start >= 0 && args.at(a) == start - 1;
+				if (whole)
+					start = arg->start;
+				if (arg == NULL || arg->number < 0)
+				{
+					entry.key.clear();
+					break;
+				}
+				value.flags |= arg->flags;
+			}
+			for (int a = 0; a < args.size() && !entry.key.empty(); a++)
+				entry.key.add(values.at(args.at(a)).number);
+			value.start = whole ? start : -1;
+			if (!entry.key.empty())
+			{
+				auto found = std::find_if(known.begin(), known.end(),
+					[&](const optKnown_t &other) { return other.key == entry.key; });
+
+				if (found != known.end())
+				{
+					value.number = found->number;
+				}
+				else
+				{
+					entry.number = value.number = numbers++;
+					known.add(entry);
+				}
+			}
+		}
+		else if (VarWrite(instr.cmd))
+		{
+			forget(&instr);
+		}
+		else if (instr.cmd != PCD_DROP)
+		{
+			forget(NULL);
+		}
+		for (int p = 0; p < pushes; p++)
+			stack.add(pushes == 1 && value.number >= 0 ? i : -1);
+		values.add(value);
+	}
+	return values;
+}
+
+//==========================================================================
+//
+// ReduceStrength
+//
+// Multiplying and dividing by a constant power of two become shifts and
+// masks where the result is the same for every operand it can get. A
+// negative dividend rounds toward zero and a shift rounds down, and the
+// fix-up for that takes more pcodes than PCD_DIVIDE itself, so division
+// and modulus only change when the dividend can't be negative.
+//
+//==========================================================================
+static bool ReduceStrength(optBody_t &body)
+{
+	VecInt locals = NonNegativeLocals(body);
+	bool changed = false;
+
+	for (optBlock_t &block : body.blocks)
+	{
+		while (ReduceOne(block.code, locals, body.compact))
+			changed = true;
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// ReduceOne
+//
+// Reduces the first operation in code that can be. A constant on the
+// left of a multiply is moved to the right first.
+//
+//==========================================================================
+static bool ReduceOne(vector<optInstr_t> &code, const VecInt &locals, bool compact)
+{
+	VecInt known = NonNegative(code, locals);
+	vector<optValue_t> values = Values(code);
+	vector<optInstr_t> with;
+
+	for (int i = 1; i < code.size(); i++)
+	{
+		int cmd = code[i].cmd;
+		int value;
+
+		if (cmd != PCD_MULTIPLY && cmd != PCD_DIVIDE && cmd != PCD_MODULUS
+			&& cmd != PCD_FIXEDMUL && cmd != PCD_FIXEDDIV)
+		{
+			continue;
+		}
+		if (IsConstant(code[i - 1], value))
+		{
+			if (!Reduce(cmd, value, (known[i] & 2) != 0, compact, with))
+				continue;
+			code.erase(code.begin() + i - 1, code.begin() + i + 1);
+			code.insert(code.begin() + i - 1, with.begin(), with.end());
+			return true;
+		}
+
+		int start = values[i - 1].start;
+
+		if ((cmd == PCD_MULTIPLY || cmd == PCD_FIXEDMUL) && start > 0
+			&& IsConstant(code[start - 1], value) && Reduce(cmd, value, false, compact, with))
+		{
+			optInstr_t constant = code[start - 1];
+
+			code.erase(code.begin() + start - 1);
+			code.insert(code.begin() + i - 1, constant);
+			return true;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// Reduce
+//
+// What to put in place of pushing value and applying cmd to it, given
+// whether the other operand is known to be at least 0.
+//
+//==========================================================================
+static bool Reduce(int cmd, int value, bool positive, bool compact, vector<optInstr_t> &with)
+{
+	int shift = PowerOfTwo(value);
+
+	with.clear();
+	switch (cmd)
+	{
+	case PCD_MULTIPLY:
+	case PCD_DIVIDE:
+		if (value == -1)
+		{
+			with.add(MakeInstr(PCD_UNARYMINUS));
+		}
+		else if (shift > 0 && (cmd == PCD_MULTIPLY || (positive && shift < 31)))
+		{
+			with.add(MakeConstant(shift, compact));
+			with.add(MakeInstr(cmd == PCD_MULTIPLY ? PCD_LSHIFT : PCD_RSHIFT));
+		}
+		else if (shift != 0)
+		{
+			return false;
+		}
+		return true;
+	case PCD_MODULUS:
+		if (shift < 0 || shift == 31 || !positive)
+			return false;
+		with.add(MakeConstant(value - 1, compact));
+		with.add(MakeInstr(PCD_ANDBITWISE));
+		return true;
+	case PCD_FIXEDMUL:
+	case PCD_FIXEDDIV:
+		// The product has 64 bits, so any power of two is a shift. The
+		// engine's FixedDiv saturates a quotient that doesn't fit, which a
+		// shift doesn't, so a division only changes when it is by 1.0 or
+		// more and the dividend can't be negative, and then it can't overflow
+		if (value == -65536 && (cmd == PCD_FIXEDMUL || positive))
+		{
+			with.add(MakeInstr(PCD_UNARYMINUS));
+		}
+		else if (shift > 16 && shift < 31 && (cmd == PCD_FIXEDMUL || positive))
+		{
+			with.add(MakeConstant(shift - 16, compact));
+			with.add(MakeInstr(cmd == PCD_FIXEDMUL ? PCD_LSHIFT : PCD_RSHIFT));
+		}
+		else if (shift >= 0 && shift < 16 && cmd == PCD_FIXEDMUL)
+		{
+			with.add(MakeConstant(16 - shift, compact));
+			with.add(MakeInstr(PCD_RSHIFT));
+		}
+		else if (shift != 16)
+		{
+			return false;
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// NonNegativeLocals
+//
+// The locals that are never below 0. They start out as 0, unless they
+// are arguments, so each one is taken to be until something written to
+// it could be.
+//
+//==========================================================================
+static VecInt NonNegativeLocals(const optBody_t &body)
+{
+	VecInt locals;
+	bool changed = true;
+
+	for (int v = body.argCount; v < body.varCount; v++)
+		locals.add(v);
+	while (changed)
+	{
+		changed = false;
+		for (const optBlock_t &block : body.blocks)
+		{
+			VecInt known = NonNegative(block.code, locals);
+
+			for (int i = 0; i < block.code.size(); i++)
+			{
+				const optInstr_t &instr = block.code.at(i);
+				bool stays;
+
+				if (!IsScriptVar(instr.cmd) || !VarWrite(instr.cmd) || !Contains(locals, instr.operands.at(0)))
+					continue;
+				switch (instr.cmd)
+				{
+				case PCD_ASSIGNSCRIPTVAR:
+				case PCD_ORSCRIPTVAR:
+				case PCD_EORSCRIPTVAR:
+				case PCD_DIVSCRIPTVAR:
+					stays = (known[i] & 1) != 0;
+					break;
+				case PCD_ANDSCRIPTVAR:
+				case PCD_MODSCRIPTVAR:
+				case PCD_RSSCRIPTVAR:
+					stays = true;
+					break;
+				default:
+					stays = false;
+					break;
+				}
+				if (!stays)
+				{
+					locals.erase(std::find(locals.begin(), locals.end(), instr.operands.at(0)));
+					changed = true;
+				}
+			}
+		}
+	}
+	return locals;
+}
+
+//==========================================================================
+//
+// NonNegative
+//
+// Follows the stack through code, given the locals that are never below
+// 0. For each instruction, bit 0 is set if the value on top of the stack
+// is known to be at least 0, and bit 1 if the one under it is.
+//
+//==========================================================================
+static VecInt NonNegative(const vector<optInstr_t> &code, const VecInt &locals)
+{
+	VecInt known;
+	VecInt stack;
+
+	for (const optInstr_t &instr : code)
+	{
+		int top = stack.size() > 0 ? stack.at(stack.size() - 1) : 0;
+		int under = stack.size() > 1 ? stack.at(stack.size() - 2) : 0;
+		bool result = false;
+		int pops, pushes;
+
+		known.add(top | under << 1);
+		if (!StackEffect(instr, pops, pushes))
+		{
+			stack.clear();
+			continue;
+		}
+		switch (instr.cmd)
+		{
+		case PCD_PUSHNUMBER:
+		case PCD_PUSHBYTE:
+			result = instr.operands.at(0) >= 0;
+			break;
+		case PCD_PUSHSCRIPTVAR:
+			result = Contains(locals, instr.operands.at(0));
+			break;
+		case PCD_EQ:
+		case PCD_NE:
+		case PCD_LT:
+		case PCD_GT:
+		case PCD_LE:
+		case PCD_GE:
+		case PCD_NEGATELOGICAL:
+		case PCD_ANDLOGICAL:
+		case PCD_ORLOGICAL:
+		case PCD_THINGCOUNT:
+		case PCD_THINGCOUNTNAME:
+		case PCD_THINGCOUNTSECTOR:
+		case PCD_THINGCOUNTNAMESECTOR:
+		case PCD_PLAYERCOUNT:
+		case PCD_STRLEN:
+		case PCD_TIMER:
+			result = true;
+			break;
+		case PCD_ANDBITWISE:
+			result = top || under;
+			break;
+		case PCD_ORBITWISE:
+		case PCD_EORBITWISE:
+		case PCD_DIVIDE:
+			result = top && under;
+			break;
+		case PCD_MODULUS:
+		case PCD_RSHIFT:
+			result = under;
+			break;
+		}
+		for (int p = 0; p < pops && !stack.empty(); p++)
+			stack.pop_back();
+		for (int p = 0; p < pushes; p++)
+			stack.add(result && pushes == 1);
+	}
+	return known;
+}
+
+//==========================================================================
+//
+// FuseAssignments
+//
+// Stores of an operation on the variable stored to become the compound
+// assignment pcode for it, as x += e would have been written.
+//
+//==========================================================================
+static bool FuseAssignments(optBody_t &body)
+{
+	bool changed = false;
+
+	for (optBlock_t &block : body.blocks)
+	{
+		while (FuseOne(block.code))
+			changed = true;
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// FuseOne
+//
+// Fuses the first store in code that can be. The value being changed is
+// read after the operand instead of before it, so unless the operation
+// can be turned around, the operand has to be pure. For an array, the
+// index must be the same value both times.
+//
+//==========================================================================
+static bool FuseOne(vector<optInstr_t> &code)
+{
+	vector<optValue_t> values = Values(code);
+
+	for (int i = 2; i < code.size(); i++)
+	{
+		int kind = VarKind(code[i].cmd);
+		int op = 0;
+		int push = kind >= 0 ? VarCommands[kind][VAR_PUSH] : -1;
+		int var = kind >= 0 ? code[i].operands.at(0) : -1;
+		int from, to;
+
+		while (op < sizeof(FusedOperators) / sizeof(FusedOperators[0]) && FusedOperators[op] != code[i - 1].cmd)
+			op++;
+		if (kind < 0 || code[i].cmd != VarCommands[kind][VAR_ASSIGN]
+			|| op == sizeof(FusedOperators) / sizeof(FusedOperators[0])
+			|| !MayUse(VarCommands[kind][VAR_FIRST_OP + op]))
+		{
+			continue;
+		}
+		auto reads = [&](int k) { return k >= 0 && code[k].cmd == push && code[k].operands.at(0) == var; };
+		auto same = [&](int a, int b) { return values[a].number >= 0 && values[a].number == values[b].number; };
+
+		// The read is the operand on the right, or on the left in front of a
+		// pure one
+		int right = i - 2;
+		int left = values[i - 2].start - 1;
+		bool swap = code[i - 1].cmd == PCD_ADD || code[i - 1].cmd == PCD_MULTIPLY
+			|| code[i - 1].cmd == PCD_ANDBITWISE || code[i - 1].cmd == PCD_EORBITWISE
+			|| code[i - 1].cmd == PCD_ORBITWISE;
+
+		if (kind < VAR_FIRST_ARRAY)
+		{
+			if (swap && reads(right))
+				from = to = right;
+			else if (reads(left))
+				from = to = left;
+			else
+				continue;
+		}
+		else
+		{
+			// Index, operand, then index and read; or index, then index and
+			// read, then operand
+			int index = right >= 1 ? values[right - 1].start : -1;
+			int operand = index >= 1 ? values[index - 1].start : -1;
+			int first = left >= 1 ? values[left - 1].start : -1;
+
+			if (swap && reads(right) && operand >= 1 && same(operand - 1, right - 1))
+			{
+				from = index;
+				to = right;
+			}
+			else if (reads(left) && first >= 1 && same(first - 1, left - 1))
+			{
+				from = first;
+				to = left;
+			}
+			else
+			{
+				continue;
+			}
+		}
+
+		code[i] = MakeInstr(VarCommands[kind][VAR_FIRST_OP + op], var);
+		code.erase(code.begin() + i - 1);
+		code.erase(code.begin() + from, code.begin() + to + 1);
+
+		// Adding or taking away 1 is an increment or decrement
+		int at = i - 1 - (to + 1 - from);
+		int value;
+
+		if ((op == 0 || op == 1) && at >= 1 && IsConstant(code[at - 1], value) && value == 1)
+		{
+			code[at] = MakeInstr(VarCommands[kind][op == 0 ? VAR_INC : VAR_DEC], var);
+			code.erase(code.begin() + at - 1);
+		}
+		return true;
+	}
+	return false;
+}
+
+
+//==========================================================================
+//
+// LowerConditions
+//
+// A condition is emitted as a value that is then tested. A negation is
+// folded into the comparison before it or the test after it, a test of
+// a comparison with 0 tests the value itself, and one with any other
+// constant becomes PCD_CASEGOTO, which jumps if the value is the
+// constant and otherwise leaves it to be dropped.
+//
+//==========================================================================
+static bool LowerConditions(optBody_t &body)
+{
+	bool changed = false;
+	int count = body.blocks.size();
+
+	for (int b = 0; b < count; b++)
+	{
+		while (FoldTest(body.blocks[b].code))
+			changed = true;
+		changed |= CaseTest(body, b);
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// FoldTest
+//
+// Folds the first negation or comparison with 0 in code that can be.
+//
+//==========================================================================
+static bool FoldTest(vector<optInstr_t> &code)
+{
+	for (int i = 1; i < code.size(); i++)
+	{
+		int cmd = code[i].cmd;
+		int inverse = InverseCompare(code[i - 1].cmd);
+		bool test = cmd == PCD_IFGOTO || cmd == PCD_IFNOTGOTO;
+		int flipped = cmd == PCD_IFGOTO ? PCD_IFNOTGOTO : PCD_IFGOTO;
+		int value;
+
+		if (cmd == PCD_NEGATELOGICAL && inverse >= 0)
+		{
+			code[i - 1] = MakeInstr(inverse);
+			code.erase(code.begin() + i);
+		}
+		else if (test && code[i - 1].cmd == PCD_NEGATELOGICAL)
+		{
+			code[i] = MakeInstr(flipped, code[i].operands.at(0));
+			code.erase(code.begin() + i - 1);
+		}
+		else if (test && i >= 2 && (code[i - 1].cmd == PCD_EQ || code[i - 1].cmd == PCD_NE)
+			&& IsConstant(code[i - 2], value) && value == 0)
+		{
+			if (code[i - 1].cmd == PCD_EQ)
+				code[i] = MakeInstr(flipped, code[i].operands.at(0));
+			code.erase(code.begin() + i - 2, code.begin() + i);
+		}
+		else
+		{
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// CaseTest
+//
+// Ends block with a PCD_CASEGOTO if it tests a comparison of a value
+// with a constant. The constant can be on either side of a pure value.
+// A new block after it drops the value when it isn't the constant.
+//
+//==========================================================================
+static bool CaseTest(optBody_t &body, int block)
+{
+	vector<optInstr_t> &code = body.blocks[block].code;
+	int size = code.size();
+	int value;
+
+	if (size < 3 || (code[size - 1].cmd != PCD_IFGOTO && code[size - 1].cmd != PCD_IFNOTGOTO)
+		|| (code[size - 2].cmd != PCD_EQ && code[size - 2].cmd != PCD_NE))
+	{
+		return false;
+	}
+	if (IsConstant(code[size - 3], value))
+	{
+		code.erase(code.begin() + size - 3);
+	}
+	else
+	{
+		int start = Values(code)[size - 3].start;
+
+		if (start < 1 || !IsConstant(code[start - 1], value))
+			return false;
+		code.erase(code.begin() + start - 1);
+	}
+
+	optBlock_t drop;
+	bool equalJumps = (code.back().cmd == PCD_IFGOTO) == (code[code.size() - 2].cmd == PCD_EQ);
+	int target = code.back().operands.at(0);
+	int next = body.blocks[block].next;
+	int equal = equalJumps ? target : next;
+	long long entered = body.blocks[block].count;
+
+	code.pop_back();
+	code.back() = MakeInstr(PCD_CASEGOTO, value, equal);
+	drop.code.add(MakeInstr(PCD_DROP));
+	drop.next = equalJumps ? next : target;
+	drop.count = entered < 0 ? -1 : std::min(entered, std::max(body.blocks.at(drop.next).count, 0LL));
+	body.blocks[block].next = body.blocks.size();
+	body.blocks.add(drop);
+	InsertAfter(body, block, VecInt { (int)body.blocks.size() - 1 });
+	return true;
+}
+
+//==========================================================================
+//
+// ThreadJumps
+//
+// A jump or fall through to a block that only goes on to another goes
+// straight there, so a chain of PCD_GOTOs is taken in one jump. A test
+// that goes to the same block either way only drops its value. Blocks
+// nothing can reach any more are emptied; they keep their numbers, since
+// a profile counts blocks by number, but take no room. One holding a
+// call whose function is still to be filled in is kept.
+//
+//==========================================================================
+static bool ThreadJumps(optBody_t &body)
+{
+	int count = body.blocks.size();
+	bool changed = false;
+	bool again = true;
+
+	auto destination = [&](int b)
+	{
+		for (int steps = 0; steps < count && body.blocks[b].code.empty() && body.blocks[b].next >= 0; steps++)
+			b = body.blocks[b].next;
+		return b;
+	};
+
+	for (optBlock_t &block : body.blocks)
+	{
+		if (!block.code.empty() && block.code.back().cmd == PCD_GOTO)
+		{
+			block.next = block.code.back().operands.at(0);
+			block.code.pop_back();
+			changed = true;
+		}
+	}
+	while (again)
+	{
+		again = false;
+		for (optBlock_t &block : body.blocks)
+		{
+			if (block.next >= 0 && destination(block.next) != block.next)
+			{
+				block.next = destination(block.next);
+				again = true;
+			}
+			if (block.code.empty())
+				continue;
+
+			optInstr_t &last = block.code.back();
+			int pops, pushes;
+
+			for (int t = 0; t < TargetCount(last); t++)
+			{
+				int &target = last.operands[TargetIndex(last.cmd, t)];
+
+				if (destination(target) != target)
+				{
+					target = destination(target);
+					again = true;
+				}
+			}
+			if ((last.cmd == PCD_IFGOTO || last.cmd == PCD_IFNOTGOTO) && last.operands.at(0) == block.next)
+			{
+				int size = block.code.size();
+
+				// What was tested is dropped, or not pushed if that is all
+				// it does
+				if (size >= 2 && IsPure(block.code[size - 2].cmd)
+					&& StackEffect(block.code[size - 2], pops, pushes) && pops == 0 && pushes == 1)
+				{
+					block.code.resize(size - 2);
+				}
+				else
+				{
+					block.code.back() = MakeInstr(PCD_DROP);
+				}
+				again = true;
+			}
+		}
+		changed |= again;
+	}
+
+	VecInt reached;
+	VecInt work { 0 };
+
+	reached.resize(count);
+	reached[0] = 1;
+	while (!work.empty())
+	{
+		int b = work.back();
+
+		work.pop_back();
+		for (int s : OPT_Successors(body.blocks.at(b)))
+		{
+			if (!reached[s])
+			{
+				reached[s] = 1;
+				work.add(s);
+			}
+		}
+	}
+	for (int b = 0; b < count; b++)
+	{
+		optBlock_t &block = body.blocks[b];
+		bool pending = std::any_of(block.code.begin(), block.code.end(),
+			[&](const optInstr_t &instr) { return HasPending(body, instr); });
+
+		if (reached[b] || pending || (block.code.empty() && block.next < 0))
+			continue;
+		block.code.clear();
+		block.next = -1;
+		changed = true;
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// RotateLoops
+//
+// A loop tested at the top jumps back to the test at the end of every
+// trip, and jumps again when the test passes. A test of up to
+// OPT_MAX_ROTATED_SIZE pcodes is copied to the end of each block that
+// goes back to it, turned around to jump back into the loop, so a trip
+// takes one jump. The test at the top then only runs on the way in.
+//
+//==========================================================================
+static bool RotateLoops(optBody_t &body)
+{
+	bool changed = false;
+
+	for (const optLoop_t &loop : FindLoops(body))
+	{
+		optBlock_t &header = body.blocks[loop.header];
+
+		if (header.code.empty() || header.code.size() > OPT_MAX_ROTATED_SIZE
+			|| (header.code.back().cmd != PCD_IFGOTO && header.code.back().cmd != PCD_IFNOTGOTO)
+			|| std::any_of(header.code.begin(), header.code.end(),
+				[&](const optInstr_t &instr) { return HasPending(body, instr); }))
+		{
+			continue;
+		}
+
+		const optInstr_t &test = header.code.back();
+		bool jumpsIn = Contains(loop.blocks, test.operands.at(0));
+		int inside = jumpsIn ? test.operands.at(0) : header.next;
+		int outside = jumpsIn ? header.next : test.operands.at(0);
+		int cmd = jumpsIn ? test.cmd : test.cmd == PCD_IFGOTO ? PCD_IFNOTGOTO : PCD_IFGOTO;
+
+		if (jumpsIn == Contains(loop.blocks, header.next))
+			continue;
+		for (int b : loop.blocks)
+		{
+			optBlock_t &latch = body.blocks[b];
+
+			if (b == loop.header || latch.next != loop.header
+				|| (!latch.code.empty() && TargetCount(latch.code.back()) > 0))
+			{
+				continue;
+			}
+			for (const optInstr_t &instr : header.code)
+			{
+				latch.code.add(instr);
+				latch.code.back().address = -1;
+			}
+			latch.code.back() = MakeInstr(cmd, inside);
+			latch.next = outside;
+			if (header.count >= 0 && latch.count >= 0)
+				header.count = std::max(header.count - latch.count, 0LL);
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// GuessCounts
+//
+// Without a profile, a block is taken to run OPT_GUESSED_TRIPS times
+// for every time the loop around it is entered, and one that can't be
+// reached never to run.
+//
+//==========================================================================
+static void GuessCounts(optBody_t &body)
+{
+	vector<optLoop_t> loops = FindLoops(body);
+
+	for (int b = 0; b < body.blocks.size(); b++)
+	{
+		optBlock_t &block = body.blocks[b];
+		int depth = 0;
+
+		for (const optLoop_t &loop : loops)
+			depth += Contains(loop.blocks, b);
+		block.count = block.code.empty() && block.next < 0 ? 0 : 1;
+		for (int i = 0; i < depth && i < OPT_MAX_GUESSED_DEPTH; i++)
+			block.count *= OPT_GUESSED_TRIPS;
+	}
+}
+
+//==========================================================================
+//
+// OrderCases
+//
+// A switch the profile says mostly takes a few cases tests them first.
+//
+//==========================================================================
+static bool OrderCases(optBody_t &body)
+{
+	VecInt preds = Predecessors(body);
+	VecInt seen;
+	bool changed = false;
+	int count = body.blocks.size();
+
+	seen.resize(count);
+	for (int b = 0; b < count; b++)
+	{
+		int cmd = body.blocks[b].code.empty() ? PCD_NOP : body.blocks[b].code.back().cmd;
+
+		if (cmd == PCD_CASEGOTOSORTED)
+			changed |= PeelCases(body, b);
+		else if (cmd == PCD_CASEGOTO && !seen[b])
+			changed |= SortCaseChain(body, b, preds, seen);
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// SortCaseChain
+//
+// A Hexen switch is a run of blocks holding one PCD_CASEGOTO each. Case
+// values are unique, so the tests can go in any order; the hottest case
+// goes first.
+//
+//==========================================================================
+static bool SortCaseChain(optBody_t &body, int head, const VecInt &preds, VecInt &seen)
+{
+	VecInt chain;
+	vector<optInstr_t> tests;
+
+	for (int b = head; b >= 0 && !seen[b]; b = body.blocks[b].next)
+	{
+		optBlock_t &block = body.blocks[b];
+
+		if (block.code.size() != 1 || block.code[0].cmd != PCD_CASEGOTO
+			|| (b != head && preds.at(b) != 1))
+		{
+			break;
+		}
+		seen[b] = 1;
+		chain.add(b);
+		tests.add(block.code[0]);
+	}
+	for (int i = 0; i < tests.size(); i++)
+	{
+		for (int j = 0; j < i; j++)
+		{
+			if (tests[i].operands[0] == tests[j].operands[0])
+				return false;
+		}
+	}
+
+	auto hits = [&](const optInstr_t &test) { return body.blocks.at(test.operands.at(1)).count; };
+	vector<optInstr_t> sorted = tests;
+
+	std::stable_sort(sorted.begin(), sorted.end(),
+		[&](const optInstr_t &a, const optInstr_t &b) { return hits(a) > hits(b); });
+	if (std::equal(sorted.begin(), sorted.end(), tests.begin(),
+		[](const optInstr_t &a, const optInstr_t &b) { return a.operands.at(0) == b.operands.at(0); }))
+	{
+		return false;
+	}
+	for (int i = 0; i < chain.size(); i++)
+	{
+		sorted[i].address = -1;
+		body.blocks[chain[i]].code[0] = sorted[i];
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// PeelCases
+//
+// Tests a case with PCD_CASEGOTO ahead of the sorted table while it
+// takes at least half of what is left of the switch's runs, up to
+// OPT_MAX_PEELED_CASES cases. The case's count is its target block's.
+//
+//==========================================================================
+static bool PeelCases(optBody_t &body, int block)
+{
+	optInstr_t table = body.blocks[block].code.back();
+	long long remaining = body.blocks[block].count;
+	int cases = table.operands[0];
+	VecInt byCount;
+	VecInt peeled;
+	vector<optInstr_t> tests;
+	VecInt counts;
+
+	auto hits = [&](int i) { return body.blocks.at(table.operands.at(2 + i * 2)).count; };
+
+	for (int i = 0; i < cases; i++)
+		byCount.add(i);
+	std::stable_sort(byCount.begin(), byCount.end(), [&](int a, int b) { return hits(a) > hits(b); });
+	peeled.resize(cases);
+	for (int i : byCount)
+	{
+		if (tests.size() == OPT_MAX_PEELED_CASES || hits(i) <= 0 || hits(i) * 2 < remaining)
+			break;
+		counts.add(remaining);
+		tests.add(MakeInstr(PCD_CASEGOTO, table.operands[1 + i * 2], table.operands[2 + i * 2]));
+		peeled[i] = 1;
+		remaining -= hits(i);
+	}
+	if (tests.empty())
+		return false;
+
+	optBlock_t rest;
+	VecInt added;
+	int first = body.blocks.size();
+	int restBlock = first + tests.size() - 1;
+
+	rest.next = body.blocks[block].next;
+	rest.count = std::max(remaining, 0LL);
+	if (tests.size() < cases)
+	{
+		optInstr_t left = MakeInstr(PCD_CASEGOTOSORTED, 0);
+
+		for (int i = 0; i < cases; i++)
+		{
+			if (peeled[i])
+				continue;
+			left.operands[0]++;
+			left.operands.add(table.operands[1 + i * 2]);
+			left.operands.add(table.operands[2 + i * 2]);
+		}
+		rest.code.add(left);
+	}
+
+	body.blocks[block].code.back() = tests[0];
+	body.blocks[block].next = first;
+	for (int i = 1; i < tests.size(); i++)
+	{
+		optBlock_t test;
+
+		test.code.add(tests[i]);
+		test.next = first + i;
+		test.count = counts[i];
+		added.add(body.blocks.size());
+		body.blocks.add(test);
+	}
+	added.add(restBlock);
+	body.blocks.add(rest);
+	InsertAfter(body, block, added);
+	return true;
+}
+
+//==========================================================================
+//
+// Layout
+//
+// Chains blocks along their hottest edges, so those become fall
+// throughs; the chain holding the entry goes first, then the rest by
+// how hot their first block is. There are only block counts, so an edge
+// is taken to run as often as the colder of its ends. A conditional
+// jump to the block after it is turned around, and a PCD_GOTO to the
+// block after it is dropped.
+//
+//==========================================================================
+static bool Layout(optBody_t &body)
+{
+	struct edge_t
+	{
+		int from;
+		int to;
+		long long weight;
+	};
+
+	int count = body.blocks.size();
+	vector<edge_t> edges;
+	vector<VecInt> chains;
+	VecInt chainOf;
+	VecInt position;
+	VecInt order;
+	bool changed = false;
+
+	auto weight = [&](int b) { return std::max(body.blocks.at(b).count, 0LL); };
+	auto addEdge = [&](int from, int to)
+	{
+		long long w = std::min(weight(from), weight(to));
+
+		if (w > 0 && to != 0 && from != to)
+			edges.add({ from, to, w });
+	};
+
+	position.resize(count);
+	for (int k = 0; k < count; k++)
+		position[body.order[k]] = k;
+	for (int k = 0; k < count; k++)
+	{
+		int b = body.order[k];
+		const optBlock_t &block = body.blocks.at(b);
+
+		if (block.next >= 0)
+			addEdge(b, block.next);
+		if (!block.code.empty())
+		{
+			const optInstr_t &last = block.code.back();
+
+			for (int t = 0; t < TargetCount(last); t++)
+				addEdge(b, last.operands.at(TargetIndex(last.cmd, t)));
+		}
+	}
+	std::stable_sort(edges.begin(), edges.end(),
+		[](const edge_t &a, const edge_t &b) { return a.weight > b.weight; });
+
+	chainOf.resize(count);
+	for (int k = 0; k < count; k++)
+	{
+		chainOf[body.order[k]] = k;
+		chains.add(VecInt { body.order[k] });
+	}
+	for (edge_t &edge : edges)
+	{
+		int from = chainOf[edge.from];
+		int to = chainOf[edge.to];
+
+		if (from == to || chains[from].back() != edge.from || chains[to].front() != edge.to)
+			continue;
+		for (int b : chains[to])
+		{
+			chains[from].add(b);
+			chainOf[b] = from;
+		}
+		chains[to].clear();
+	}
+
+	VecInt chainOrder;
+
+	for (int c = 0; c < count; c++)
+	{
+		if (!chains[c].empty())
+			chainOrder.add(c);
+	}
+	std::stable_sort(chainOrder.begin(), chainOrder.end(), [&](int a, int b)
+	{
+		if ((chains[a].front() == 0) != (chains[b].front() == 0))
+			return chains[a].front() == 0;
+		return weight(chains[a].front()) > weight(chains[b].front());
+	});
+	for (int c : chainOrder)
+	{
+		for (int b : chains[c])
+			order.add(b);
+	}
+	changed = order != body.order;
+	body.order = order;
+
+	for (int k = 0; k < count; k++)
+	{
+		optBlock_t &block = body.blocks[order[k]];
+		int following = k + 1 < count ? order[k + 1] : -1;
+
+		if (block.code.empty() || following < 0)
+			continue;
+
+		optInstr_t &last = block.code.back();
+
+		if ((last.cmd == PCD_IFGOTO || last.cmd == PCD_IFNOTGOTO)
+			&& last.operands[0] == following && block.next != following)
+		{
+			last.cmd = last.cmd == PCD_IFGOTO ? PCD_IFNOTGOTO : PCD_IFGOTO;
+			last.operands[0] = block.next;
+			block.next = following;
+			changed = true;
+		}
+		else if (last.cmd == PCD_GOTO && last.operands[0] == following)
+		{
+			block.code.pop_back();
+			block.next = following;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+//==========================================================================
+//
+// CallBlocks
+//
+// The block each PCD_CALL and PCD_CALLDISCARD is in, in the order a
+// profile numbers the calls.
+//
+//==========================================================================
+static VecInt CallBlocks(const optBody_t &body)
+{
+	VecInt blocks;
+
+	for (int b = 0; b < body.blocks.size(); b++)
+	{
+		for (const optInstr_t &instr : body.blocks[b].code)
+		{
+			if (instr.cmd == PCD_CALL || instr.cmd == PCD_CALLDISCARD)
+				blocks.add(b);
+		}
+	}
+	return blocks;
+}
+
+//==========================================================================
+//
+// Instrument
+//
+// Starts every block with an increment of its own counter. Functions
+// are kept for inlining without them, so the blocks inlined into a body
+// get counters of that body, which are put down to its first line.
+//
+//==========================================================================
+static void Instrument(const string &name, unsigned int hash, int blockCount, const VecInt &callBlocks, optBody_t &body)
+{
+	string firstFile;
+	int firstLine = 0;
+
+	pCode_FindLine(body.start, firstFile, firstLine);
+	PF_AddCounterBody(name, hash, blockCount, callBlocks);
+	for (int b = 0; b < body.blocks.size(); b++)
+	{
+		optBlock_t &block = body.blocks[b];
+		string file = firstFile;
+		int line = firstLine;
+
+		for (optInstr_t &instr : block.code)
+		{
+			if (instr.address >= 0 && pCode_FindLine(instr.address, file, line))
+				break;
+		}
+
+		int counter = PF_AddCounter(b, file, line);
+		optInstr_t increment[] =
+		{
+			MakeInstr(body.compact && counter <= 255 ? PCD_PUSHBYTE : PCD_PUSHNUMBER, counter),
+			MakeInstr(PCD_INCGLOBALARRAY, PF_COUNTER_ARRAY)
+		};
+
+		block.code.insert(block.code.begin(), increment, increment + 2);
+	}
+}
+
+//==========================================================================
+//
+// Predecessors
+//
+// How many jumps and fall throughs lead to each block.
+//
+//==========================================================================
+static VecInt Predecessors(const optBody_t &body)
+{
+	VecInt preds;
+
+	preds.resize(body.blocks.size());
+	for (const optBlock_t &block : body.blocks)
+	{
+		if (block.next >= 0)
+			preds[block.next]++;
+		for (const optInstr_t &instr : block.code)
+		{
+			for (int t = 0; t < TargetCount(instr); t++)
+				preds[instr.operands.at(TargetIndex(instr.cmd, t))]++;
+		}
+	}
+	return preds;
+}
+
+//==========================================================================
+//
+// InsertAfter
+//
+// Puts new blocks in the layout right after block.
+//
+//==========================================================================
+static void InsertAfter(optBody_t &body, int block, const VecInt &blocks)
+{
+	auto at = std::find(body.order.begin(), body.order.end(), block) + 1;
+
+	body.order.insert(at, blocks.begin(), blocks.end());
+}
+
+//==========================================================================
+//
+// FindLoops
+//
+// Finds the natural loop of each jump back to a block that dominates
+// the one it is in. Loops with the same header are one loop. The
+// innermost come first.
+//
+//==========================================================================
+static vector<optLoop_t> FindLoops(const optBody_t &body)
+{
+	int count = body.blocks.size();
+	vector<VecInt> preds;
+	vector<VecInt> dom;
+	vector<optLoop_t> loops;
+	VecInt reached;
+	VecInt work { 0 };
+	bool changed = true;
+
+	preds.resize(count);
+	reached.resize(count);
+	reached[0] = 1;
+	while (!work.empty())
+	{
+		int b = work.back();
+
+		work.pop_back();
+		for (int s : OPT_Successors(body.blocks.at(b)))
+		{
+			preds[s].add(b);
+			if (!reached[s])
+			{
+				reached[s] = 1;
+				work.add(s);
+			}
+		}
+	}
+
+	// dom[b][d] is set if every way to b goes through d
+	dom.resize(count);
+	for (int b = 0; b < count; b++)
+	{
+		dom[b].resize(count);
+		for (int d = 0; d < count; d++)
+			dom[b][d] = b == 0 ? d == 0 : 1;
+	}
+	while (changed)
+	{
+		changed = false;
+		for (int b = 1; b < count; b++)
+		{
+			VecInt both;
+
+			if (!reached[b])
+				continue;
+			both.resize(count);
+			for (int d = 0; d < count; d++)
+				both[d] = 1;
+			for (int p : preds[b])
+			{
+				for (int d = 0; d < count; d++)
+					both[d] &= dom[p][d];
+			}
+			both[b] = 1;
+			if (both != dom[b])
+			{
+				dom[b] = both;
+				changed = true;
+			}
+		}
+	}
+
+	for (int b = 0; b < count; b++)
+	{
+		if (!reached[b])
+			continue;
+		for (int h : OPT_Successors(body.blocks.at(b)))
+		{
+			if (!dom[b][h])
+				continue;
+
+			auto found = std::find_if(loops.begin(), loops.end(),
+				[&](const optLoop_t &loop) { return loop.header == h; });
+
+			if (found == loops.end())
+			{
+				loops.add({ h, VecInt { h } });
+				found = loops.end() - 1;
+			}
+			work.add(b);
+			while (!work.empty())
+			{
+				int k = work.back();
+
+				work.pop_back();
+				if (Contains(found->blocks, k))
+					continue;
+				found->blocks.add(k);
+				for (int p : preds[k])
+					work.add(p);
+			}
+		}
+	}
+	std::stable_sort(loops.begin(), loops.end(),
+		[](const optLoop_t &a, const optLoop_t &b) { return a.blocks.size() < b.blocks.size(); });
+	return loops;
+}
+
+//==========================================================================
+//
+// Retarget
+//
+// Makes every way out of block that goes to from go to to instead.
+//
+//==========================================================================
+static void Retarget(optBlock_t &block, int from, int to)
+{
+	if (block.next == from)
+		block.next = to;
+	for (optInstr_t &instr : block.code)
+	{
+		for (int t = 0; t < TargetCount(instr); t++)
+		{
+			int &target = instr.operands[TargetIndex(instr.cmd, t)];
+
+			if (target == from)
+				target = to;
+		}
+	}
+}
+
+//==========================================================================
+//
+// MakeInstr
+//
+// An instruction the optimizer adds. Only its operands are needed; its
+// size is worked out when it is written.
+//
+//==========================================================================
+static optInstr_t MakeInstr(int cmd, int operand1, int operand2)
+{
+	optInstr_t instr;
+	int count = strlen(pCode_Info[cmd].operands);
+
+	instr.cmd = cmd;
+	instr.address = -1;
+	instr.size = 0;
+	if (count > 0)
+		instr.operands.add(operand1);
+	if (count > 1)
+		instr.operands.add(operand2);
+	return instr;
+}
+
+//==========================================================================
+//
+// MakeConstant
+//
+//==========================================================================
+static optInstr_t MakeConstant(int value, bool compact)
+{
+	return MakeInstr(compact && value >= 0 && value <= 255 ? PCD_PUSHBYTE : PCD_PUSHNUMBER, value);
+}
+
+//==========================================================================
+//
+// InstrCount
+//
+//==========================================================================
+static int InstrCount(const optBody_t &body)
+{
+	int count = 0;
+
+	for (const optBlock_t &block : body.blocks)
+		count += block.code.size();
+	return count;
+}
+
+//==========================================================================
+//
+// TargetCount
+//
+// Jumps an instruction can take. TargetIndex says which operand holds
+// each one.
+//
+//==========================================================================
+static int TargetCount(const optInstr_t &instr)
+{
+	switch (instr.cmd)
+	{
+	case PCD_GOTO:
+	case PCD_IFGOTO:
+	case PCD_IFNOTGOTO:
+	case PCD_CASEGOTO:
+		return 1;
+	case PCD_CASEGOTOSORTED:
+		return instr.operands.at(0);
+	default:
+		return 0;
+	}
+}
+
+static int TargetIndex(int cmd, int target)
+{
+	switch (cmd)
+	{
+	case PCD_CASEGOTO:
+		return 1;
+	case PCD_CASEGOTOSORTED:
+		return 2 + target * 2;
+	default:
+		return 0;
+	}
+}
+
+//==========================================================================
+//
+// FallsThrough
+//
+// Whether the next instruction can run after this one.
+//
+//==========================================================================
+static bool FallsThrough(int cmd)
+{
+	return cmd != PCD_GOTO && cmd != PCD_TERMINATE && cmd != PCD_RESTART
+		&& cmd != PCD_RETURNVOID && cmd != PCD_RETURNVAL;
+}
+
+//==========================================================================
+//
+// EndsBlock
+//
+//==========================================================================
+static bool EndsBlock(int cmd)
+{
+	return !FallsThrough(cmd) || cmd == PCD_IFGOTO || cmd == PCD_IFNOTGOTO
+		|| cmd == PCD_CASEGOTO || cmd == PCD_CASEGOTOSORTED;
+}
+
+//==========================================================================
+//
+// InverseCompare
+//
+// The comparison that is true when cmd's is false, or -1.
+//
+//==========================================================================
+static int InverseCompare(int cmd)
+{
+	switch (cmd)
+	{
+	case PCD_EQ:
+		return PCD_NE;
+	case PCD_NE:
+		return PCD_EQ;
+	case PCD_LT:
+		return PCD_GE;
+	case PCD_GE:
+		return PCD_LT;
+	case PCD_GT:
+		return PCD_LE;
+	case PCD_LE:
+		return PCD_GT;
+	default:
+		return -1;
+	}
+}
+
+//==========================================================================
+//
+// IsScriptVar
+//
+//==========================================================================
+static bool IsScriptVar(int cmd)
+{
+	return VarKind(cmd) == VAR_SCRIPT;
+}
+
+//==========================================================================
+//
+// VarKind
+//
+// The row of VarCommands a pcode is in, or -1. VarWrite says if it
+// changes the variable.
+//
+//==========================================================================
+static int VarKind(int cmd)
+{
+	for (int kind = 0; kind < sizeof(VarCommands) / sizeof(VarCommands[0]); kind++)
+	{
+		for (int var : VarCommands[kind])
+		{
+			if (cmd == var)
+				return kind;
+		}
+	}
+	return -1;
+}
+
+static bool VarWrite(int cmd)
+{
+	int kind = VarKind(cmd);
+
+	return kind >= 0 && cmd != VarCommands[kind][VAR_PUSH];
+}
+
+//==========================================================================
+//
+// StackEffect
+//
+// How many values an instruction pops and pushes, if that is fixed.
+//
+//==========================================================================
+static bool StackEffect(const optInstr_t &instr, int &pops, int &pushes)
+{
+	pops = pCode_Info[instr.cmd].pops;
+	pushes = pCode_Info[instr.cmd].pushes;
+	if (instr.cmd == PCD_PUSHBYTES)
+		pushes = instr.operands.at(0);
+	return pops != PCODE_VARIES && pushes != PCODE_VARIES;
+}
+
+//==========================================================================
+//
+// PureFlags
+//
+// The PURE_ flags of a pcode in PureCommands, or -1. IsPure says if it
+// is in there.
+//
+//==========================================================================
+static int PureFlags(int cmd)
+{
+	for (const optPure_t &pure : PureCommands)
+	{
+		if (pure.cmd == cmd)
+			return pure.flags;
+	}
+	return -1;
+}
+
+static bool IsPure(int cmd)
+{
+	return PureFlags(cmd) >= 0;
+}
+
+//==========================================================================
+//
+// IsConstant
+//
+// Whether an instruction pushes a number that is known, and which.
+//
+//==========================================================================
+static bool IsConstant(const optInstr_t &instr, int &value)
+{
+	if (instr.cmd != PCD_PUSHNUMBER && instr.cmd != PCD_PUSHBYTE)
+		return false;
+	value = instr.operands.at(0);
+	return true;
+}
+
+//==========================================================================
+//
+// Contains
+//
+//==========================================================================
+static bool Contains(const VecInt &list, int value)
+{
+	return std::find(list.begin(), list.end(), value) != list.end();
+}
+
+//==========================================================================
+//
+// HasPending
+//
+// Whether instr holds a call whose function is still to be filled in.
+//
+//==========================================================================
+static bool HasPending(const optBody_t &body, const optInstr_t &instr)
+{
+	return std::any_of(body.pending.begin(), body.pending.end(),
+		[&](int address) { return address >= instr.address && address < instr.address + instr.size; });
+}
+
+//==========================================================================
+//
+// PowerOfTwo
+//
+// Which power of two value is, taken as unsigned, or -1.
+//
+//==========================================================================
+static int PowerOfTwo(int value)
+{
+	unsigned int bits = value;
+	int shift = 0;
+
+	if (bits == 0 || (bits & (bits - 1)) != 0)
+		return -1;
+	while (bits >>= 1)
+		shift++;
+	return shift;
+}
+
+//==========================================================================
+//
+// MaxLocals
+//
+// A Hexen object can't give a script more than MAX_SCRIPT_VARIABLES
+// locals, and one built with -h may be written as one.
+//
+//==========================================================================
+static int MaxLocals()
+{
+	return pCode_NoShrink ? MAX_SCRIPT_VARIABLES : OPT_MAX_LOCALS;
+}
+
+//==========================================================================
+//
+// MayUse
+//
+// Hexen has no pcodes after PCD_ENDPRINTBOLD, so an object built with
+// -h can't be given them.
+//
+//==========================================================================
+static bool MayUse(int cmd)
+{
+	return !pCode_NoShrink || cmd <= PCD_ENDPRINTBOLD;
+}
+
+//==========================================================================
+//
+// FindFunction
+//
+//==========================================================================
+static const optFunction_t *FindFunction(int number)
+{
+	for (optFunction_t &function : Functions)
+	{
+		if (function.number == number)
+			return &function;
+	}
+	return NULL;
+}
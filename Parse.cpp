@@ -16,6 +16,10 @@
 #include "error.h"
 #include "misc.h"
 #include "strlist.h"
+#include "object.h"
+#include "stats.h"
+#include "opt.h"
+#include "profile.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -79,6 +83,10 @@ static void OuterSpecialDef();
 static void OuterDefine(bool force);
 static void OuterInclude();
 static void OuterImport();
+static bool ImportObject(string fileName);
+static string FindLibraryFile(const string &sourceName, const string &extension);
+static bool ObjectIsCurrent(const string &objectName, const VecStr &sources);
+static void DeclareLibrary(const libInterface_t &library, const string &sourceName);
 static bool ProcessStatement(StatementType owner);
 static void LeadingCompoundStatement(StatementType owner);
 static void LeadingVarDeclare();
@@ -140,11 +148,15 @@ static ACS_Node *SpeculateSymbol(string name, bool hasReturn);
 static ACS_Node *SpeculateFunction(const string& name, bool hasReturn);
 static void UnspeculateFunction(ACS_Node *node);
 static void AddScriptFuncRef(ACS_Node *node, int address, int argcount);
+static VecInt PendingCalls(int start);
+static void MovePendingCalls(int start);
 static void CheckForUndefinedFunctions();
 static void SkipBraceBlock(int depth);
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
+extern string acs_ObjectFileName;
+
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
@@ -327,6 +339,8 @@ static ScriptType ScriptCounts[]
 //==========================================================================
 void PA_Parse()
 {
+	allocScope_t allocScope(ALLOC_PARSER);
+
 	pa_ScriptCount = 0;
 	pa_TypedScriptCounts = ScriptCounts;
 	for (int i = 0; ScriptCounts[i].TypeName != NULL; i++)
@@ -446,6 +460,7 @@ static void Outside()
 				{
 					Message(MSG_DEBUG, "Allocations modified for exporting");
 					ImportMode = IMPORT_Exporting;
+					PC_SetLibraryName(tk_String);
 				}
 				else if (ImportMode == IMPORT_Importing)
 				{
@@ -725,8 +740,16 @@ static void OuterScript()
 		scriptFlags |= NET_SCRIPT_FLAG;
 		TK_NextToken();
 	}
+	traceSpan_t span("script", &pCode_Size, !st_Tracing ? "" :
+		ST_TraceArg("script", scriptNumber) + ", " + ST_TraceArg("file", tk_SourceName));
+
 	CountScript(scriptType);
 	pCode_AddScript(scriptNumber, scriptType, scriptFlags, ScriptVarCount);
+
+	string bodyName = scriptNumber >= 0 ? "script " + string(scriptNumber) : "script \"" + scriptName + "\"";
+	int bodyStart = pCode_Current;
+	int argCount = ScriptVarCount;
+
 	pCode_LastAppendedCommand = PCD_NOP;
 	if(ProcessStatement(STMT_SCRIPT) == false)
 	{
@@ -736,6 +759,9 @@ static void OuterScript()
 	{
 		PC_AppendCmd(PCD_TERMINATE);
 	}
+	ScriptVarCount = OPT_Body(bodyName, bodyStart, argCount, ScriptVarCount, PendingCalls(bodyStart));
+	MovePendingCalls(bodyStart);
+	pCode_AddLineBody(bodyName, bodyStart);
 	PC_SetScriptVarCount(scriptNumber, scriptType, ScriptVarCount);
 	pa_ScriptCount++;
 }
@@ -752,6 +778,7 @@ static void OuterFunction()
 	bool hasReturn;
 	ACS_Node *node;
 	int defLine;
+	string funcName;
 
 	Message(MSG_DEBUG, "---- OuterFunction ----");
 	importing = ImportMode;
@@ -767,6 +794,7 @@ static void OuterFunction()
 	}
 	hasReturn = tk_Token != TK_VOID;
 	TK_NextTokenMustBe(TK_IDENTIFIER, ERR_INVALID_IDENTIFIER);
+	funcName = tk_String;
 	sym = sym_FindGlobal(tk_String);
 	if(sym != NULL)
 	{
@@ -874,8 +902,14 @@ static void OuterFunction()
 		return;
 	}
 
+	traceSpan_t span("function", &pCode_Size, !st_Tracing ? "" :
+		ST_TraceArg("function", funcName) + ", " + ST_TraceArg("file", tk_SourceName));
+
 	TK_NextToken();
 	InsideFunction = sym;
+
+	int bodyStart = pCode_Current;
+
 	pCode_LastAppendedCommand = PCD_NOP;
 
 	// If we just call ProcessStatement(STMT_SCRIPT), and this function
@@ -900,6 +934,10 @@ static void OuterFunction()
 		}
 		PC_AppendCmd(PCD_RETURNVOID);
 	}
+	ScriptVarCount = OPT_Body(funcName, bodyStart, sym->cmd->scriptFunc.argCount, ScriptVarCount,
+		PendingCalls(bodyStart));
+	MovePendingCalls(bodyStart);
+	pCode_AddLineBody(funcName, bodyStart);
 
 	TK_TokenMustBe(TK_RBRACE, ERR_INVALID_STATEMENT);
 	TK_NextToken();
@@ -908,6 +946,7 @@ static void OuterFunction()
 	sym->cmd->scriptFunc.varCount = ScriptVarCount -
 		sym->cmd->scriptFunc.argCount;
 	PC_AddFunction(sym);
+	OPT_AddFunction(sym->cmd->scriptFunc.funcNumber, sym->cmd->scriptFunc.argCount);
 	UnspeculateFunction(sym);
 	InsideFunction = NULL;
 }
@@ -1024,6 +1063,7 @@ static void OuterMapVar(int local)
 				if(ImportMode != IMPORT_Importing)
 				{
 					PC_AddArray(index, size);
+					PC_SetArrayDims(index, ndim, dims);
 				}
 				MS_Message(MSG_DEBUG, "%s changed to an array of size %d\n", sym->name, size);
 				sym->type = SY_MAPARRAY;
@@ -1117,6 +1157,10 @@ static void OuterWorldVar(bool isGlobal)
 					}
 					while(tk_Token == TK_LBRACKET);
 				}
+				if(isGlobal && pf_Instrument && index == PF_COUNTER_ARRAY)
+				{
+					ERR_Error(ERR_COUNTER_ARRAY_USED, true, index);
+				}
 				sym = SY_InsertGlobal(tk_String, isGlobal ? SY_GLOBALARRAY : SY_WORLDARRAY);
 				sym->cmd->array.index = index;
 				sym->arr->dimAmt = 1;
@@ -1222,6 +1266,10 @@ static void OuterDefine(bool libdef)
 	value = EvalConstExpression();
 	MS_Message(MSG_DEBUG, "Constant value: %d\n", value);
 	node->cmd->.value = value;
+	if(libdef && ImportMode != IMPORT_Importing)
+	{
+		PC_AddLibDefine(node->name(), value);
+	}
 	// Defines inside an import are deleted when the import is popped.
 	if(ImportMode != IMPORT_Importing || force)
 	{
@@ -1274,11 +1322,200 @@ static void OuterImport()
 	{
 		Message(MSG_DEBUG, "Importing a file");
 		TK_NextTokenMustBe(TK_STRING, ERR_STRING_LIT_NOT_FOUND);
-		TK_Import(tk_String, ImportMode);
+		if(!ImportObject(tk_String))
+		{
+			TK_Import(tk_String, ImportMode);
+		}
 	}
 	TK_NextToken();
 }
 
+//==========================================================================
+//
+// ImportObject
+//
+// Imports a library without tokenizing its source. The library's
+// interface file is used if the hash of its sources still matches,
+// otherwise its object if that is newer than every file it was built
+// from. Returns false if the source has to be imported instead.
+//
+//==========================================================================
+
+static bool ImportObject(string fileName)
+{
+	acsObject_t object;
+	libInterface_t library;
+	string sourceName, objectName, interfaceName;
+	traceSpan_t span("import", NULL, ST_TraceArg("file", fileName));
+
+	if(!TK_FindInclude(fileName, sourceName))
+	{ // Let TK_Import complain about it
+		return false;
+	}
+	objectName = FindLibraryFile(sourceName, ".o");
+	interfaceName = FindLibraryFile(sourceName, ".acsi");
+
+	if(OBJ_LoadInterface(interfaceName, library) && !library.sources.empty() &&
+		library.sourceHash == MS_HashFiles(library.sources))
+	{
+		Message(MSG_DEBUG, "*Importing " + interfaceName);
+		TK_AddDependency(interfaceName);
+	}
+	else
+	{
+		library = libInterface_t();
+		if(!OBJ_Load(objectName, object) || !OBJ_ReadLibrary(object, library) ||
+			!ObjectIsCurrent(objectName, library.sources))
+		{
+			return false;
+		}
+		Message(MSG_DEBUG, "*Importing " + objectName);
+		TK_AddDependency(objectName);
+	}
+	TK_AddDependency(sourceName);
+	DeclareLibrary(library, sourceName);
+	return true;
+}
+
+//==========================================================================
+//
+// FindLibraryFile
+//
+// Where the library built from sourceName has its file with extension:
+// in the directory this object goes to, if it is there, since a build
+// that keeps objects apart from sources puts them all together, or
+// else next to the source.
+//
+//==========================================================================
+
+static string FindLibraryFile(const string &sourceName, const string &extension)
+{
+	string local = sourceName;
+	string output = acs_ObjectFileName;
+	string dir = sourceName;
+	string base = sourceName;
+
+	MS_StripFileExt(local);
+	MS_SuggestFileExt(local, string(extension));
+	if(MS_StripFilename(dir))
+	{
+		base = sourceName.substr(dir.length());
+	}
+	if(!MS_StripFilename(output))
+	{
+		output.clear();
+	}
+	output += base;
+	MS_StripFileExt(output);
+	MS_SuggestFileExt(output, string(extension));
+	return MS_FileExists(output) ? output : local;
+}
+
+//==========================================================================
+//
+// ObjectIsCurrent
+//
+// Whether a library's object is at least as new as every file it was
+// built from. An object that doesn't list them can't be trusted.
+//
+//==========================================================================
+
+static bool ObjectIsCurrent(const string &objectName, const VecStr &sources)
+{
+	time_t built = MS_FileTime(objectName);
+
+	if(sources.empty())
+	{
+		return false;
+	}
+	for(const string &source : sources)
+	{
+		if(!MS_FileExists(source) || MS_FileTime(source) > built)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// DeclareLibrary
+//
+// Adds an imported library's exports to the symbol table, the same way
+// importing its source would.
+//
+//==========================================================================
+
+static void DeclareLibrary(const libInterface_t &library, const string &sourceName)
+{
+	ImportModes prevMode;
+	ACS_Node *sym;
+
+	prevMode = ImportMode;
+	ImportMode = IMPORT_Importing;
+	PC_AddImport(library.name);
+
+	for(const libFunction_t &func : library.functions)
+	{
+		if(SY_FindGlobal(func.name) != NULL)
+		{ // Redefined
+			ERR_Error(ERR_REDEFINED_IDENTIFIER, true, func.name);
+			continue;
+		}
+		sym = SY_InsertGlobal(func.name, SY_SCRIPTFUNC);
+		sym->cmd->scriptFunc.address = 0;
+		sym->cmd->scriptFunc.predefined = false;
+		sym->cmd->scriptFunc.sourceLine = 0;
+		sym->cmd->scriptFunc.sourceName = sourceName;
+		sym->cmd->scriptFunc.argCount = func.argCount;
+		sym->cmd->scriptFunc.varCount = func.argCount;
+		sym->cmd->scriptFunc.hasReturnValue = func.hasReturnValue;
+	}
+
+	for(const libDefine_t &def : library.defines)
+	{
+		sym = SY_InsertGlobalUnique(def.name, SY_CONSTANT);
+		sym->cmd->constant.value = def.value;
+		sym->cmd->constant.fileDepth = 0;
+	}
+
+	for(const libVariable_t &var : library.variables)
+	{
+		if(var.name.empty())
+		{
+			continue;
+		}
+		if(SY_FindGlobal(var.name) != NULL)
+		{ // Redefined
+			ERR_Error(ERR_REDEFINED_IDENTIFIER, true, var.name);
+			continue;
+		}
+		if(var.size == 0)
+		{
+			sym = SY_InsertGlobal(var.name, SY_MAPVAR);
+			sym->cmd->var.index = 0;
+		}
+		else
+		{
+			int ndim = var.dims.size() > 0 ? var.dims.size() : 1;
+
+			sym = SY_InsertGlobal(var.name, SY_MAPARRAY);
+			sym->cmd->array.index = 0;
+			sym->arr->dimAmt = ndim;
+			sym->cmd->array.size = var.size;
+			sym->cmd->array.dimensions[ndim-1] = 1;
+			for(int i = ndim - 2; i >= 0; --i)
+			{
+				sym->arr->dimensions[i] =
+					sym->cmd->array.dimensions[i+1] * var.dims[i+1];
+			}
+		}
+	}
+
+	ImportMode = prevMode;
+}
+
 //==========================================================================
 //
 // ProcessStatement
@@ -4306,6 +4543,7 @@ static void UnspeculateFunction(ACS_Node *sym)
 					sym->cmd->scriptFunc.argCount == 1 ? "" : "s");
 			}
 
+			st_Counters[STAT_FILLINS]++;
 			if(pCode_NoShrink)
 			{
 				PC_WriteInt(sym->cmd->scriptFunc.funcNumber, fillin->address);
@@ -4348,6 +4586,43 @@ static void AddScriptFuncRef(ACS_Node *node, int address, int argcount)
 	FillinFunctionsLatest = &fillin->next;
 }
 
+//==========================================================================
+//
+// PendingCalls
+//
+// Where the calls made since start still need their function numbers.
+//
+//==========================================================================
+
+static VecInt PendingCalls(int start)
+{
+	VecInt pending;
+
+	for (prefunc_t *fillin = FillinFunctions; fillin != NULL; fillin = fillin->next)
+	{
+		if (fillin->address >= start)
+			pending.add(fillin->address);
+	}
+	return pending;
+}
+
+//==========================================================================
+//
+// MovePendingCalls
+//
+// Follows those calls to wherever OPT_Body put them.
+//
+//==========================================================================
+
+static void MovePendingCalls(int start)
+{
+	for (prefunc_t *fillin = FillinFunctions; fillin != NULL; fillin = fillin->next)
+	{
+		if (fillin->address >= start)
+			fillin->address = OPT_NewAddress(fillin->address);
+	}
+}
+
 //==========================================================================
 //
 // Check for undefined functions
@@ -4373,6 +4648,9 @@ static void CheckForUndefinedFunctions()
 // If depth is 0, it scans for the first { and then starts going from there.
 // At exit, the terminating } is left as the current token.
 //
+// Once the { is found, the lexer's brace index is used to jump straight
+// past the body. The token loop is only used when that isn't possible.
+//
 //==========================================================================
 
 void SkipBraceBlock(int depth)
@@ -4388,6 +4666,10 @@ void SkipBraceBlock(int depth)
 			}
 			TK_NextToken();
 		}
+		if (TK_SkipToMatchingBrace())
+		{
+			return;
+		}
 		depth = 1;
 	}
 	// Match it with a }
@@ -14,11 +14,29 @@
 #include "token.h"
 #include "symbol.h"
 #include "parse.h"
+#include "object.h"
+#include "stats.h"
 
 // MACROS ------------------------------------------------------------------
 
 // TYPES -------------------------------------------------------------------
 
+// Where the pcodes emitted for a source line begin
+struct pcLine_t
+{
+	int address;
+	int file;		// In LineFiles
+	int line;
+};
+
+// A script or function, for the line map
+struct pcLineBody_t
+{
+	string name;
+	int start;
+	int end;
+};
+
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
 
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
@@ -30,11 +48,16 @@ static void CloseOld();
 static void CloseNew();
 static void CreateDummyScripts();
 static void RecordDummyScripts();
+static void RecordLine();
+static int FindLineRecord(int address);
+static void WriteLineBody(ofstream &out, const pcLineBody_t &body);
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
 
+bool pCode_RecordLines;
+
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
 static bool ObjectOpened = false;
@@ -50,13 +73,19 @@ static int ObjectFlags;
 static int PushByteAddr;
 static auto Imports = vector<string>(MAX_IMPORTS);
 static bool HaveExtendedScripts;
-
-
-//This is so that ACC doesn't have to carry around these strings
-//unless someone is actually developing it, and requires them
-
-#if _DEBUG
-static string pCode_Names[PCODE_COMMAND_COUNT]
+static string LibraryName;									// From #library, for LDEF
+static VecStr LibDefineNames;
+static VecInt LibDefineValues;
+static int ArrayDimCounts[MAX_MAP_VARIABLES];
+static int ArrayDims[MAX_MAP_VARIABLES][MAX_ARRAY_DIMS];
+static vector<pcLine_t> Lines;
+static VecStr LineFiles;
+static int LineFile = -1;		// In LineFiles, for tk_SourceName
+static vector<pcLineBody_t> LineBodies;
+
+
+// Used by the debug log and the -s report
+string pCode_Names[PCODE_COMMAND_COUNT]
 {
 	"PCD_NOP",
 	"PCD_TERMINATE",
@@ -189,8 +218,8 @@ static string pCode_Names[PCODE_COMMAND_COUNT]
 	"PCD_BLUETEAMSCORE",
 	"PCD_REDTEAMSCORE",
 	"PCD_ISONEFLAGCTF",
-	"PCD_LSPEC6",
-	"PCD_LSPEC6DIRECT",
+	"PCD_GETINVASIONWAVE",
+	"PCD_GETINVASIONSTATE",
 	"PCD_PRINTNAME",
 	"PCD_MUSICCHANGE",
 	"PCD_CONSOLECOMMANDDIRECT",
@@ -326,7 +355,7 @@ static string pCode_Names[PCODE_COMMAND_COUNT]
 	"PCD_GETSECTORCEILINGZ",
 	"PCD_LSPEC5RESULT",
 	"PCD_GETSIGILPIECES",
-	"PCD_GELEVELINFO",
+	"PCD_GETLEVELINFO",
 	"PCD_CHANGESKY",
 	"PCD_PLAYERINGAME",
 	"PCD_PLAYERISBOT",
@@ -429,14 +458,378 @@ static string pCode_Names[PCODE_COMMAND_COUNT]
 	"PCD_SCRIPTWAITNAMED",
 	"PCD_TRANSLATIONRANGE3",
 };
-#endif
+
+// Used by the disassembler and the VM
+const pcodeInfo_t pCode_Info[PCODE_COMMAND_COUNT] =
+{
+	{ "",	0, 0 },			// PCD_NOP
+	{ "",	0, 0 },			// PCD_TERMINATE
+	{ "",	0, 0 },			// PCD_SUSPEND
+	{ "i",	0, 1 },			// PCD_PUSHNUMBER
+	{ "c",	1, 0 },			// PCD_LSPEC1
+	{ "c",	2, 0 },			// PCD_LSPEC2
+	{ "c",	3, 0 },			// PCD_LSPEC3
+	{ "c",	4, 0 },			// PCD_LSPEC4
+	{ "c",	5, 0 },			// PCD_LSPEC5
+	{ "ci",	0, 0 },			// PCD_LSPEC1DIRECT
+	{ "cii",	0, 0 },		// PCD_LSPEC2DIRECT
+	{ "ciii",	0, 0 },		// PCD_LSPEC3DIRECT
+	{ "ciiii",	0, 0 },		// PCD_LSPEC4DIRECT
+	{ "ciiiii",0, 0 },		// PCD_LSPEC5DIRECT
+	{ "",	2, 1 },			// PCD_ADD
+	{ "",	2, 1 },			// PCD_SUBTRACT
+	{ "",	2, 1 },			// PCD_MULTIPLY
+	{ "",	2, 1 },			// PCD_DIVIDE
+	{ "",	2, 1 },			// PCD_MODULUS
+	{ "",	2, 1 },			// PCD_EQ
+	{ "",	2, 1 },			// PCD_NE
+	{ "",	2, 1 },			// PCD_LT
+	{ "",	2, 1 },			// PCD_GT
+	{ "",	2, 1 },			// PCD_LE
+	{ "",	2, 1 },			// PCD_GE
+	{ "c",	1, 0 },			// PCD_ASSIGNSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_ASSIGNMAPVAR
+	{ "c",	1, 0 },			// PCD_ASSIGNWORLDVAR
+	{ "c",	0, 1 },			// PCD_PUSHSCRIPTVAR
+	{ "c",	0, 1 },			// PCD_PUSHMAPVAR
+	{ "c",	0, 1 },			// PCD_PUSHWORLDVAR
+	{ "c",	1, 0 },			// PCD_ADDSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_ADDMAPVAR
+	{ "c",	1, 0 },			// PCD_ADDWORLDVAR
+	{ "c",	1, 0 },			// PCD_SUBSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_SUBMAPVAR
+	{ "c",	1, 0 },			// PCD_SUBWORLDVAR
+	{ "c",	1, 0 },			// PCD_MULSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_MULMAPVAR
+	{ "c",	1, 0 },			// PCD_MULWORLDVAR
+	{ "c",	1, 0 },			// PCD_DIVSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_DIVMAPVAR
+	{ "c",	1, 0 },			// PCD_DIVWORLDVAR
+	{ "c",	1, 0 },			// PCD_MODSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_MODMAPVAR
+	{ "c",	1, 0 },			// PCD_MODWORLDVAR
+	{ "c",	0, 0 },			// PCD_INCSCRIPTVAR
+	{ "c",	0, 0 },			// PCD_INCMAPVAR
+	{ "c",	0, 0 },			// PCD_INCWORLDVAR
+	{ "c",	0, 0 },			// PCD_DECSCRIPTVAR
+	{ "c",	0, 0 },			// PCD_DECMAPVAR
+	{ "c",	0, 0 },			// PCD_DECWORLDVAR
+	{ "i",	0, 0 },			// PCD_GOTO
+	{ "i",	1, 0 },			// PCD_IFGOTO
+	{ "",	1, 0 },			// PCD_DROP
+	{ "",	1, 0 },			// PCD_DELAY
+	{ "i",	0, 0 },			// PCD_DELAYDIRECT
+	{ "",	2, 1 },			// PCD_RANDOM
+	{ "ii",	0, 1 },			// PCD_RANDOMDIRECT
+	{ "",	2, 1 },			// PCD_THINGCOUNT
+	{ "ii",	0, 1 },			// PCD_THINGCOUNTDIRECT
+	{ "",	1, 0 },			// PCD_TAGWAIT
+	{ "i",	0, 0 },			// PCD_TAGWAITDIRECT
+	{ "",	1, 0 },			// PCD_POLYWAIT
+	{ "i",	0, 0 },			// PCD_POLYWAITDIRECT
+	{ "",	2, 0 },			// PCD_CHANGEFLOOR
+	{ "ii",	0, 0 },			// PCD_CHANGEFLOORDIRECT
+	{ "",	2, 0 },			// PCD_CHANGECEILING
+	{ "ii",	0, 0 },			// PCD_CHANGECEILINGDIRECT
+	{ "",	0, 0 },			// PCD_RESTART
+	{ "",	2, 1 },			// PCD_ANDLOGICAL
+	{ "",	2, 1 },			// PCD_ORLOGICAL
+	{ "",	2, 1 },			// PCD_ANDBITWISE
+	{ "",	2, 1 },			// PCD_ORBITWISE
+	{ "",	2, 1 },			// PCD_EORBITWISE
+	{ "",	1, 1 },			// PCD_NEGATELOGICAL
+	{ "",	2, 1 },			// PCD_LSHIFT
+	{ "",	2, 1 },			// PCD_RSHIFT
+	{ "",	1, 1 },			// PCD_UNARYMINUS
+	{ "i",	1, 0 },			// PCD_IFNOTGOTO
+	{ "",	0, 1 },			// PCD_LINESIDE
+	{ "",	1, 0 },			// PCD_SCRIPTWAIT
+	{ "i",	0, 0 },			// PCD_SCRIPTWAITDIRECT
+	{ "",	0, 0 },			// PCD_CLEARLINESPECIAL
+	{ "ii",	0, 0 },			// PCD_CASEGOTO
+	{ "",	0, 0 },			// PCD_BEGINPRINT
+	{ "",	0, 0 },			// PCD_ENDPRINT
+	{ "",	1, 0 },			// PCD_PRINTSTRING
+	{ "",	1, 0 },			// PCD_PRINTNUMBER
+	{ "",	1, 0 },			// PCD_PRINTCHARACTER
+	{ "",	0, 1 },			// PCD_PLAYERCOUNT
+	{ "",	0, 1 },			// PCD_GAMETYPE
+	{ "",	0, 1 },			// PCD_GAMESKILL
+	{ "",	0, 1 },			// PCD_TIMER
+	{ "",	2, 0 },			// PCD_SECTORSOUND
+	{ "",	2, 0 },			// PCD_AMBIENTSOUND
+	{ "",	1, 0 },			// PCD_SOUNDSEQUENCE
+	{ "",	4, 0 },			// PCD_SETLINETEXTURE
+	{ "",	2, 0 },			// PCD_SETLINEBLOCKING
+	{ "",	7, 0 },			// PCD_SETLINESPECIAL
+	{ "",	3, 0 },			// PCD_THINGSOUND
+	{ "",	0, 0 },			// PCD_ENDPRINTBOLD
+	{ "",	2, 0 },			// PCD_ACTIVATORSOUND
+	{ "",	2, 0 },			// PCD_LOCALAMBIENTSOUND
+	{ "",	2, 0 },			// PCD_SETLINEMONSTERBLOCKING
+	{ "",	0, 1 },			// PCD_PLAYERBLUESKULL
+	{ "",	0, 1 },			// PCD_PLAYERREDSKULL
+	{ "",	0, 1 },			// PCD_PLAYERYELLOWSKULL
+	{ "",	0, 1 },			// PCD_PLAYERMASTERSKULL
+	{ "",	0, 1 },			// PCD_PLAYERBLUECARD
+	{ "",	0, 1 },			// PCD_PLAYERREDCARD
+	{ "",	0, 1 },			// PCD_PLAYERYELLOWCARD
+	{ "",	0, 1 },			// PCD_PLAYERMASTERCARD
+	{ "",	0, 1 },			// PCD_PLAYERBLACKSKULL
+	{ "",	0, 1 },			// PCD_PLAYERSILVERSKULL
+	{ "",	0, 1 },			// PCD_PLAYERGOLDSKULL
+	{ "",	0, 1 },			// PCD_PLAYERBLACKCARD
+	{ "",	0, 1 },			// PCD_PLAYERSILVERCARD
+	{ "",	0, 1 },			// PCD_PLAYERONTEAM
+	{ "",	0, 1 },			// PCD_PLAYERTEAM
+	{ "",	0, 1 },			// PCD_PLAYERHEALTH
+	{ "",	0, 1 },			// PCD_PLAYERARMORPOINTS
+	{ "",	0, 1 },			// PCD_PLAYERFRAGS
+	{ "",	0, 1 },			// PCD_PLAYEREXPERT
+	{ "",	0, 1 },			// PCD_BLUETEAMCOUNT
+	{ "",	0, 1 },			// PCD_REDTEAMCOUNT
+	{ "",	0, 1 },			// PCD_BLUETEAMSCORE
+	{ "",	0, 1 },			// PCD_REDTEAMSCORE
+	{ "",	0, 1 },			// PCD_ISONEFLAGCTF
+	{ "",	0, 1 },			// PCD_GETINVASIONWAVE
+	{ "",	0, 1 },			// PCD_GETINVASIONSTATE
+	{ "",	1, 0 },			// PCD_PRINTNAME
+	{ "",	2, 0 },			// PCD_MUSICCHANGE
+	{ "iii",	0, 0 },		// PCD_CONSOLECOMMANDDIRECT
+	{ "",	3, 0 },			// PCD_CONSOLECOMMAND
+	{ "",	0, 1 },			// PCD_SINGLEPLAYER
+	{ "",	2, 1 },			// PCD_FIXEDMUL
+	{ "",	2, 1 },			// PCD_FIXEDDIV
+	{ "",	1, 0 },			// PCD_SETGRAVITY
+	{ "i",	0, 0 },			// PCD_SETGRAVITYDIRECT
+	{ "",	1, 0 },			// PCD_SETAIRCONTROL
+	{ "i",	0, 0 },			// PCD_SETAIRCONTROLDIRECT
+	{ "",	0, 0 },			// PCD_CLEARINVENTORY
+	{ "",	2, 0 },			// PCD_GIVEINVENTORY
+	{ "ii",	0, 0 },			// PCD_GIVEINVENTORYDIRECT
+	{ "",	2, 0 },			// PCD_TAKEINVENTORY
+	{ "ii",	0, 0 },			// PCD_TAKEINVENTORYDIRECT
+	{ "",	1, 1 },			// PCD_CHECKINVENTORY
+	{ "i",	0, 1 },			// PCD_CHECKINVENTORYDIRECT
+	{ "",	6, 1 },			// PCD_SPAWN
+	{ "iiiiii",0, 1 },		// PCD_SPAWNDIRECT
+	{ "",	4, 1 },			// PCD_SPAWNSPOT
+	{ "iiii",	0, 1 },		// PCD_SPAWNSPOTDIRECT
+	{ "",	3, 0 },			// PCD_SETMUSIC
+	{ "iii",	0, 0 },		// PCD_SETMUSICDIRECT
+	{ "",	3, 0 },			// PCD_LOCALSETMUSIC
+	{ "iii",	0, 0 },		// PCD_LOCALSETMUSICDIRECT
+	{ "",	1, 0 },			// PCD_PRINTFIXED
+	{ "",	1, 0 },			// PCD_PRINTLOCALIZED
+	{ "",	0, 0 },			// PCD_MOREHUDMESSAGE
+	{ "",	0, 0 },			// PCD_OPTHUDMESSAGE
+	{ "",	6, 0 },			// PCD_ENDHUDMESSAGE
+	{ "",	6, 0 },			// PCD_ENDHUDMESSAGEBOLD
+	{ "",	1, 0 },			// PCD_SETSTYLE
+	{ "i",	0, 0 },			// PCD_SETSTYLEDIRECT
+	{ "",	1, 0 },			// PCD_SETFONT
+	{ "i",	0, 0 },			// PCD_SETFONTDIRECT
+	{ "b",	0, 1 },			// PCD_PUSHBYTE
+	{ "bb",	0, 0 },			// PCD_LSPEC1DIRECTB
+	{ "bbb",	0, 0 },		// PCD_LSPEC2DIRECTB
+	{ "bbbb",	0, 0 },		// PCD_LSPEC3DIRECTB
+	{ "bbbbb",	0, 0 },		// PCD_LSPEC4DIRECTB
+	{ "bbbbbb",0, 0 },		// PCD_LSPEC5DIRECTB
+	{ "b",	0, 0 },			// PCD_DELAYDIRECTB
+	{ "bb",	0, 1 },			// PCD_RANDOMDIRECTB
+	{ "n",	0, PCODE_VARIES },	// PCD_PUSHBYTES
+	{ "bb",	0, 2 },			// PCD_PUSH2BYTES
+	{ "bbb",	0, 3 },		// PCD_PUSH3BYTES
+	{ "bbbb",	0, 4 },		// PCD_PUSH4BYTES
+	{ "bbbbb",	0, 5 },		// PCD_PUSH5BYTES
+	{ "",	7, 0 },			// PCD_SETTHINGSPECIAL
+	{ "c",	1, 0 },			// PCD_ASSIGNGLOBALVAR
+	{ "c",	0, 1 },			// PCD_PUSHGLOBALVAR
+	{ "c",	1, 0 },			// PCD_ADDGLOBALVAR
+	{ "c",	1, 0 },			// PCD_SUBGLOBALVAR
+	{ "c",	1, 0 },			// PCD_MULGLOBALVAR
+	{ "c",	1, 0 },			// PCD_DIVGLOBALVAR
+	{ "c",	1, 0 },			// PCD_MODGLOBALVAR
+	{ "c",	0, 0 },			// PCD_INCGLOBALVAR
+	{ "c",	0, 0 },			// PCD_DECGLOBALVAR
+	{ "",	5, 0 },			// PCD_FADETO
+	{ "",	9, 0 },			// PCD_FADERANGE
+	{ "",	0, 0 },			// PCD_CANCELFADE
+	{ "",	1, 1 },			// PCD_PLAYMOVIE
+	{ "",	8, 0 },			// PCD_SETFLOORTRIGGER
+	{ "",	8, 0 },			// PCD_SETCEILINGTRIGGER
+	{ "",	1, 1 },			// PCD_GETACTORX
+	{ "",	1, 1 },			// PCD_GETACTORY
+	{ "",	1, 1 },			// PCD_GETACTORZ
+	{ "",	1, 0 },			// PCD_STARTTRANSLATION
+	{ "",	4, 0 },			// PCD_TRANSLATIONRANGE1
+	{ "",	8, 0 },			// PCD_TRANSLATIONRANGE2
+	{ "",	0, 0 },			// PCD_ENDTRANSLATION
+	{ "c",	PCODE_VARIES, PCODE_VARIES },	// PCD_CALL
+	{ "c",	PCODE_VARIES, 0 },	// PCD_CALLDISCARD
+	{ "",	0, 0 },			// PCD_RETURNVOID
+	{ "",	1, 0 },			// PCD_RETURNVAL
+	{ "c",	1, 1 },			// PCD_PUSHMAPARRAY
+	{ "c",	2, 0 },			// PCD_ASSIGNMAPARRAY
+	{ "c",	2, 0 },			// PCD_ADDMAPARRAY
+	{ "c",	2, 0 },			// PCD_SUBMAPARRAY
+	{ "c",	2, 0 },			// PCD_MULMAPARRAY
+	{ "c",	2, 0 },			// PCD_DIVMAPARRAY
+	{ "c",	2, 0 },			// PCD_MODMAPARRAY
+	{ "c",	1, 0 },			// PCD_INCMAPARRAY
+	{ "c",	1, 0 },			// PCD_DECMAPARRAY
+	{ "",	1, 2 },			// PCD_DUP
+	{ "",	2, 2 },			// PCD_SWAP
+	{ "",	3, 0 },			// PCD_WRITETOINI
+	{ "",	3, 1 },			// PCD_GETFROMINI
+	{ "",	1, 1 },			// PCD_SIN
+	{ "",	1, 1 },			// PCD_COS
+	{ "",	2, 1 },			// PCD_VECTORANGLE
+	{ "",	1, 1 },			// PCD_CHECKWEAPON
+	{ "",	1, 1 },			// PCD_SETWEAPON
+	{ "",	1, 1 },			// PCD_TAGSTRING
+	{ "c",	1, 1 },			// PCD_PUSHWORLDARRAY
+	{ "c",	2, 0 },			// PCD_ASSIGNWORLDARRAY
+	{ "c",	2, 0 },			// PCD_ADDWORLDARRAY
+	{ "c",	2, 0 },			// PCD_SUBWORLDARRAY
+	{ "c",	2, 0 },			// PCD_MULWORLDARRAY
+	{ "c",	2, 0 },			// PCD_DIVWORLDARRAY
+	{ "c",	2, 0 },			// PCD_MODWORLDARRAY
+	{ "c",	1, 0 },			// PCD_INCWORLDARRAY
+	{ "c",	1, 0 },			// PCD_DECWORLDARRAY
+	{ "c",	1, 1 },			// PCD_PUSHGLOBALARRAY
+	{ "c",	2, 0 },			// PCD_ASSIGNGLOBALARRAY
+	{ "c",	2, 0 },			// PCD_ADDGLOBALARRAY
+	{ "c",	2, 0 },			// PCD_SUBGLOBALARRAY
+	{ "c",	2, 0 },			// PCD_MULGLOBALARRAY
+	{ "c",	2, 0 },			// PCD_DIVGLOBALARRAY
+	{ "c",	2, 0 },			// PCD_MODGLOBALARRAY
+	{ "c",	1, 0 },			// PCD_INCGLOBALARRAY
+	{ "c",	1, 0 },			// PCD_DECGLOBALARRAY
+	{ "",	2, 0 },			// PCD_SETMARINEWEAPON
+	{ "",	3, 0 },			// PCD_SETACTORPROPERTY
+	{ "",	2, 1 },			// PCD_GETACTORPROPERTY
+	{ "",	0, 1 },			// PCD_PLAYERNUMBER
+	{ "",	0, 1 },			// PCD_ACTIVATORTID
+	{ "",	2, 0 },			// PCD_SETMARINESPRITE
+	{ "",	0, 1 },			// PCD_GETSCREENWIDTH
+	{ "",	0, 1 },			// PCD_GETSCREENHEIGHT
+	{ "",	7, 0 },			// PCD_THING_PROJECTILE2
+	{ "",	1, 1 },			// PCD_STRLEN
+	{ "",	3, 0 },			// PCD_SETHUDSIZE
+	{ "",	1, 1 },			// PCD_GETCVAR
+	{ "s",	0, 0 },			// PCD_CASEGOTOSORTED
+	{ "",	1, 0 },			// PCD_SETRESULTVALUE
+	{ "",	0, 1 },			// PCD_GETLINEROWOFFSET
+	{ "",	1, 1 },			// PCD_GETACTORFLOORZ
+	{ "",	1, 1 },			// PCD_GETACTORANGLE
+	{ "",	3, 1 },			// PCD_GETSECTORFLOORZ
+	{ "",	3, 1 },			// PCD_GETSECTORCEILINGZ
+	{ "c",	5, 1 },			// PCD_LSPEC5RESULT
+	{ "",	0, 1 },			// PCD_GETSIGILPIECES
+	{ "",	1, 1 },			// PCD_GETLEVELINFO
+	{ "",	2, 0 },			// PCD_CHANGESKY
+	{ "",	1, 1 },			// PCD_PLAYERINGAME
+	{ "",	1, 1 },			// PCD_PLAYERISBOT
+	{ "",	3, 0 },			// PCD_SETCAMERATOTEXTURE
+	{ "",	0, 0 },			// PCD_ENDLOG
+	{ "",	1, 1 },			// PCD_GETAMMOCAPACITY
+	{ "",	2, 0 },			// PCD_SETAMMOCAPACITY
+	{ "",	2, 0 },			// PCD_PRINTMAPCHARARRAY
+	{ "",	2, 0 },			// PCD_PRINTWORLDCHARARRAY
+	{ "",	2, 0 },			// PCD_PRINTGLOBALCHARARRAY
+	{ "",	2, 0 },			// PCD_SETACTORANGLE
+	{ "",	2, 0 },			// PCD_GRABINPUT
+	{ "",	3, 0 },			// PCD_SETMOUSEPOINTER
+	{ "",	2, 0 },			// PCD_MOVEMOUSEPOINTER
+	{ "",	7, 0 },			// PCD_SPAWNPROJECTILE
+	{ "",	1, 1 },			// PCD_GETSECTORLIGHTLEVEL
+	{ "",	1, 1 },			// PCD_GETACTORCEILINGZ
+	{ "",	5, 1 },			// PCD_SETACTORPOSITION
+	{ "",	1, 0 },			// PCD_CLEARACTORINVENTORY
+	{ "",	3, 0 },			// PCD_GIVEACTORINVENTORY
+	{ "",	3, 0 },			// PCD_TAKEACTORINVENTORY
+	{ "",	2, 1 },			// PCD_CHECKACTORINVENTORY
+	{ "",	2, 1 },			// PCD_THINGCOUNTNAME
+	{ "",	3, 1 },			// PCD_SPAWNSPOTFACING
+	{ "",	1, 1 },			// PCD_PLAYERCLASS
+	{ "c",	1, 0 },			// PCD_ANDSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_ANDMAPVAR
+	{ "c",	1, 0 },			// PCD_ANDWORLDVAR
+	{ "c",	1, 0 },			// PCD_ANDGLOBALVAR
+	{ "c",	2, 0 },			// PCD_ANDMAPARRAY
+	{ "c",	2, 0 },			// PCD_ANDWORLDARRAY
+	{ "c",	2, 0 },			// PCD_ANDGLOBALARRAY
+	{ "c",	1, 0 },			// PCD_EORSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_EORMAPVAR
+	{ "c",	1, 0 },			// PCD_EORWORLDVAR
+	{ "c",	1, 0 },			// PCD_EORGLOBALVAR
+	{ "c",	2, 0 },			// PCD_EORMAPARRAY
+	{ "c",	2, 0 },			// PCD_EORWORLDARRAY
+	{ "c",	2, 0 },			// PCD_EORGLOBALARRAY
+	{ "c",	1, 0 },			// PCD_ORSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_ORMAPVAR
+	{ "c",	1, 0 },			// PCD_ORWORLDVAR
+	{ "c",	1, 0 },			// PCD_ORGLOBALVAR
+	{ "c",	2, 0 },			// PCD_ORMAPARRAY
+	{ "c",	2, 0 },			// PCD_ORWORLDARRAY
+	{ "c",	2, 0 },			// PCD_ORGLOBALARRAY
+	{ "c",	1, 0 },			// PCD_LSSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_LSMAPVAR
+	{ "c",	1, 0 },			// PCD_LSWORLDVAR
+	{ "c",	1, 0 },			// PCD_LSGLOBALVAR
+	{ "c",	2, 0 },			// PCD_LSMAPARRAY
+	{ "c",	2, 0 },			// PCD_LSWORLDARRAY
+	{ "c",	2, 0 },			// PCD_LSGLOBALARRAY
+	{ "c",	1, 0 },			// PCD_RSSCRIPTVAR
+	{ "c",	1, 0 },			// PCD_RSMAPVAR
+	{ "c",	1, 0 },			// PCD_RSWORLDVAR
+	{ "c",	1, 0 },			// PCD_RSGLOBALVAR
+	{ "c",	2, 0 },			// PCD_RSMAPARRAY
+	{ "c",	2, 0 },			// PCD_RSWORLDARRAY
+	{ "c",	2, 0 },			// PCD_RSGLOBALARRAY
+	{ "",	2, 1 },			// PCD_GETPLAYERINFO
+	{ "",	4, 0 },			// PCD_CHANGELEVEL
+	{ "",	5, 0 },			// PCD_SECTORDAMAGE
+	{ "",	3, 0 },			// PCD_REPLACETEXTURES
+	{ "",	1, 1 },			// PCD_NEGATEBINARY
+	{ "",	1, 1 },			// PCD_GETACTORPITCH
+	{ "",	2, 0 },			// PCD_SETACTORPITCH
+	{ "",	1, 0 },			// PCD_PRINTBIND
+	{ "",	3, 1 },			// PCD_SETACTORSTATE
+	{ "",	3, 1 },			// PCD_THINGDAMAGE2
+	{ "",	1, 1 },			// PCD_USEINVENTORY
+	{ "",	2, 1 },			// PCD_USEACTORINVENTORY
+	{ "",	2, 1 },			// PCD_CHECKACTORCEILINGTEXTURE
+	{ "",	2, 1 },			// PCD_CHECKACTORFLOORTEXTURE
+	{ "",	1, 1 },			// PCD_GETACTORLIGHTLEVEL
+	{ "",	1, 0 },			// PCD_SETMUGSHOTSTATE
+	{ "",	3, 1 },			// PCD_THINGCOUNTSECTOR
+	{ "",	3, 1 },			// PCD_THINGCOUNTNAMESECTOR
+	{ "",	1, 1 },			// PCD_CHECKPLAYERCAMERA
+	{ "",	7, 1 },			// PCD_MORPHACTOR
+	{ "",	2, 1 },			// PCD_UNMORPHACTOR
+	{ "",	2, 1 },			// PCD_GETPLAYERINPUT
+	{ "",	1, 1 },			// PCD_CLASSIFYACTOR
+	{ "",	1, 0 },			// PCD_PRINTBINARY
+	{ "",	1, 0 },			// PCD_PRINTHEX
+	{ "cw",	PCODE_VARIES, 1 },	// PCD_CALLFUNC
+	{ "",	0, 1 },			// PCD_SAVESTRING
+	{ "",	4, 0 },			// PCD_PRINTMAPCHRANGE
+	{ "",	4, 0 },			// PCD_PRINTWORLDCHRANGE
+	{ "",	4, 0 },			// PCD_PRINTGLOBALCHRANGE
+	{ "",	6, 1 },			// PCD_STRCPYTOMAPCHRANGE
+	{ "",	6, 1 },			// PCD_STRCPYTOWORLDCHRANGE
+	{ "",	6, 1 },			// PCD_STRCPYTOGLOBALCHRANGE
+	{ "c",	0, 1 },			// PCD_PUSHFUNCTION
+	{ "",	PCODE_VARIES, PCODE_VARIES },	// PCD_CALLSTACK
+	{ "",	1, 0 },			// PCD_SCRIPTWAITNAMED
+	{ "",	8, 0 },			// PCD_TRANSLATIONRANGE3
+};
+
 static void pCode_CommandLog(int location, int code, string prefix)
 {
-#if _DEBUG
 	MS_Message(MSG_DEBUG, prefix + "> %06d = #%d:%s\n", location, code, pCode_Names[code]);
-#else
-	MS_Message(MSG_DEBUG, prefix + "> %06d = #%d\n", location, pCode);
-#endif
 }
 
 
@@ -449,6 +842,8 @@ static void pCode_CommandLog(int location, int code, string prefix)
 //==========================================================================
 void PC_OpenObject(string name, size_t size, int flags)
 {
+	allocScope_t allocScope(ALLOC_PCODE);
+
 	if(ObjectOpened)
 		PC_CloseObject();
 	
@@ -472,7 +867,10 @@ void PC_OpenObject(string name, size_t size, int flags)
 //==========================================================================
 void PC_CloseObject()
 {
+	allocScope_t allocScope(ALLOC_PCODE);
+
 	Message(MSG_DEBUG, "---- PC_CloseObject ----");
+	ST_StartPhase(PHASE_CLOSE);
 	pCode_AppendPadding(4 - pCode_Size % 4);
 	if (!pCode_NoShrink || (NumLanguages > 1) || (NumStringLists > 0) ||
 		(pCode_FunctionCount > 0) || MapVariablesInit || NumArrays != 0 ||
@@ -494,10 +892,15 @@ void PC_CloseObject()
 	{
 		CloseOld();
 	}
+	ST_EndPhase(PHASE_CLOSE);
+	ST_Peak(STAT_PEAK_PCODE, pCode_Buffer.size());
+
+	ST_StartPhase(PHASE_WRITE);
 	if(MS_SaveFile(ObjectName, pCode_Buffer.data) == false)
 	{
 		ERR_Exit(ERR_SAVE_OBJECT_FAILED, false);
 	}
+	ST_EndPhase(PHASE_WRITE);
 }
 
 //==========================================================================
@@ -538,6 +941,7 @@ static void CloseNew()
 {
 	int i, j, count;
 	int chunkStart;
+	traceSpan_t closeSpan("CloseNew", &pCode_Size);
 
 	if (pCode_WadAuthor)
 	{
@@ -556,6 +960,7 @@ static void CloseNew()
 	}
 	if(j > 0)
 	{
+		traceSpan_t span("SPTR", &pCode_Size);
 		PC_Append("SPTR", 4);
 		PC_AppendInt(j * 8);
 		for (i = 0; i < pCode_ScriptCount; i++)
@@ -583,6 +988,7 @@ static void CloseNew()
 	}
 	if(j > 0)
 	{
+		traceSpan_t span("SVCT", &pCode_Size);
 		PC_Append("SVCT", 4);
 		PC_AppendInt(j * 4);
 		for (i = 0; i < pCode_ScriptCount; ++i)
@@ -608,6 +1014,7 @@ static void CloseNew()
 	}
 	if (j > 0)
 	{
+		traceSpan_t span("SFLG", &pCode_Size);
 		PC_Append("SFLG", 4);
 		PC_AppendInt(j * 4);
 		for (i = 0; i < pCode_ScriptCount; ++i)
@@ -626,6 +1033,7 @@ static void CloseNew()
 
 	if(pCode_FunctionCount > 0)
 	{
+		ST_TraceBegin("FUNC");
 		PC_Append("FUNC", 4);
 		PC_AppendInt(pCode_FunctionCount * 8);
 		for(i = 0; i < pCode_FunctionCount; ++i)
@@ -639,6 +1047,7 @@ static void CloseNew()
 			PC_AppendByte(0);
 			PC_AppendInt(info->address);
 		}
+		ST_TraceEnd(ST_TraceArg("bytes", pCode_FunctionCount * 8 + 8));
 		STR_WriteListChunk(STRLIST_FUNCTIONS, MAKE4CC('F', 'N', 'A', 'M'), false);
 	}
 
@@ -673,6 +1082,7 @@ static void CloseNew()
 
 		if (i < j)
 		{
+			traceSpan_t span("MINI", &pCode_Size);
 			PC_Append("MINI", 4);
 			PC_AppendInt((j-i)*4+4);
 			PC_AppendInt(i);						// First map var defined
@@ -698,6 +1108,7 @@ static void CloseNew()
 		}
 		if(count > 0)
 		{
+			traceSpan_t span("MSTR", &pCode_Size);
 			PC_Append("MSTR", 4);
 			PC_AppendInt(count*4);
 			for(i = 0; i < pa_MapVarCount; ++i)
@@ -719,6 +1130,7 @@ static void CloseNew()
 		}
 		if(count > 0)
 		{
+			traceSpan_t span("ASTR", &pCode_Size);
 			PC_Append("ASTR", 4);
 			PC_AppendInt(count*4);
 			for(i = 0; i < pa_MapVarCount; ++i)
@@ -759,6 +1171,7 @@ static void CloseNew()
 	}
 	if(count > 0)
 	{
+		traceSpan_t span("MIMP", &pCode_Size);
 		PC_Append("MIMP", 4);
 		PC_AppendInt(count);
 		for(i = 0; i < pa_MapVarCount; ++i)
@@ -785,6 +1198,7 @@ static void CloseNew()
 		}
 		if(count)
 		{
+			ST_TraceBegin("ARAY");
 			PC_Append("ARAY", 4);
 			PC_AppendInt(count*8);
 			for(i = 0; i < pa_MapVarCount; ++i)
@@ -795,12 +1209,14 @@ static void CloseNew()
 					PC_AppendInt(ArraySizes[i]);
 				}
 			}
+			ST_TraceEnd(ST_TraceArg("bytes", count * 8 + 8));
 			for(i = 0; i < pa_MapVarCount; ++i)
 			{
 				if(ArrayInits[i])
 				{
 					int j;
 
+					traceSpan_t span("AINI", &pCode_Size);
 					PC_Append("AINI", 4);
 					PC_AppendInt(ArraySizes[i]*4+4);
 					PC_AppendInt(i);
@@ -824,6 +1240,7 @@ static void CloseNew()
 		}
 		if(count)
 		{
+			traceSpan_t span("AIMP", &pCode_Size);
 			PC_Append("AIMP", 4);
 			PC_AppendInt(count+4);
 			PC_AppendInt(j);
@@ -842,10 +1259,74 @@ static void CloseNew()
 	// Add a dummy chunk to indicate if this object is a library.
 	if(ImportMode == IMPORT_Exporting)
 	{
+		traceSpan_t span("ALIB", &pCode_Size);
 		PC_Append("ALIB", 4);
 		PC_AppendInt(0);
 	}
 
+	// Record what an importer needs that the chunks above don't carry, so
+	// the library can be imported from this object instead of its source:
+	// the #library name, the #libdefines and the shape of its arrays.
+	if(ImportMode == IMPORT_Exporting)
+	{
+		count = LibraryName.length() + 1 + 8;
+		for(i = 0; i < LibDefineNames.size(); ++i)
+		{
+			count += 5 + LibDefineNames[i].length();
+		}
+		for(i = j = 0; i < pa_MapVarCount; ++i)
+		{
+			if(ArraySizes[i] && !MapVariables[i].imported && ArrayDimCounts[i] > 1)
+			{
+				count += 8 + ArrayDimCounts[i] * 4;
+				++j;
+			}
+		}
+		traceSpan_t span("LDEF", &pCode_Size);
+		PC_Append("LDEF", 4);
+		PC_AppendInt(count);
+		PC_AppendString(LibraryName);
+		PC_AppendInt(LibDefineNames.size());
+		for(i = 0; i < LibDefineNames.size(); ++i)
+		{
+			PC_AppendInt(LibDefineValues[i]);
+			PC_AppendString(LibDefineNames[i]);
+		}
+		PC_AppendInt(j);
+		for(i = 0; i < pa_MapVarCount; ++i)
+		{
+			if(ArraySizes[i] && !MapVariables[i].imported && ArrayDimCounts[i] > 1)
+			{
+				PC_AppendInt(i);
+				PC_AppendInt(ArrayDimCounts[i]);
+				for(int d = 0; d < ArrayDimCounts[i]; ++d)
+				{
+					PC_AppendInt(ArrayDims[i][d]);
+				}
+			}
+		}
+	}
+
+	// Record every file the library was built from, so an importer can
+	// tell if this object is older than any of them.
+	if(ImportMode == IMPORT_Exporting)
+	{
+		const VecStr &sources = TK_GetDependencies();
+
+		count = 0;
+		for(i = 0; i < sources.size(); ++i)
+		{
+			count += sources[i].length() + 1;
+		}
+		traceSpan_t span("LDEP", &pCode_Size);
+		PC_Append("LDEP", 4);
+		PC_AppendInt(count);
+		for(i = 0; i < sources.size(); ++i)
+		{
+			PC_AppendString(sources[i]);
+		}
+	}
+
 	// Record libraries imported by this object.
 	if(Imports.size() > 0)
 	{
@@ -856,6 +1337,7 @@ static void CloseNew()
 		}
 		if(count > 0)
 		{
+			traceSpan_t span("LOAD", &pCode_Size);
 			PC_Append("LOAD", 4);
 			PC_AppendInt(count);
 			for (i = 0; i < Imports.size(); ++i)
@@ -956,6 +1438,7 @@ static void RecordDummyScripts()
 
 void pCode_Append(int data)
 {
+	allocScope_t allocScope(ALLOC_PCODE);
 	if (ImportMode != IMPORT_Importing)
 	{
 		Message(MSG_DEBUG, "AI> " + string(pCode_Current) + " = " + string(data));
@@ -968,6 +1451,7 @@ void pCode_Append(int data)
 }
 void pCode_Append(short data)
 {
+	allocScope_t allocScope(ALLOC_PCODE);
 	if (ImportMode != IMPORT_Importing)
 	{
 		Message(MSG_DEBUG, "AS> " + string(pCode_Current) + " = " + string(data));
@@ -980,6 +1464,7 @@ void pCode_Append(short data)
 }
 void pCode_Append(byte data)
 {
+	allocScope_t allocScope(ALLOC_PCODE);
 	if (ImportMode != IMPORT_Importing)
 	{
 		Message(MSG_DEBUG, "AB> " + string(pCode_Current) + " = " + string(data));
@@ -991,6 +1476,7 @@ void pCode_Append(byte data)
 }
 void pCode_Append(string data)
 {
+	allocScope_t allocScope(ALLOC_PCODE);
 	//TODO: check to see if \0 is needed
 	for (char c : data)
 	{
@@ -1004,11 +1490,13 @@ void pCode_Append(string data)
 
 void pCode_AppendCommand(pCode cmd)
 {
+	allocScope_t allocScope(ALLOC_PCODE);
 	if (ImportMode != IMPORT_Importing)
 	{
 		pCode_LastAppendedCommand = cmd;
 		if (pCode_NoShrink)
 		{
+			RecordLine();
 			pCode_CommandLog(pCode_Current, cmd, "AP");
 			cmd = (pCode)MS_LittleUINT(cmd);
 			pCode_Append(cmd);
@@ -1057,6 +1545,7 @@ void pCode_AppendCommand(pCode cmd)
 			{ // Remember the first PCD_PUSHBYTE, in case there are more
 				PushByteAddr = pCode_Current;
 			}
+			RecordLine();
 			pCode_CommandLog(pCode_Current, cmd, "AP");
 
 			if (cmd < 256 - 16)
@@ -1125,6 +1614,220 @@ void pCode_AppendPushVal(int val)
 	}
 }
 
+//==========================================================================
+//
+// pCode_ReadCode
+//
+// The bytes emitted since start, for the optimizer to rework.
+//
+//==========================================================================
+vector<byte> pCode_ReadCode(int start)
+{
+	vector<byte> code;
+
+	for (int i = start; i < pCode_Current; i++)
+	{
+		for (int b = 0; b < pCode_ByteSizes[i]; b++)
+			code.add((pCode_Buffer[i] >> (b * 8)) & 255);
+	}
+	return code;
+}
+
+//==========================================================================
+//
+// pCode_ReplaceCode
+//
+// Throws away everything emitted since start and appends code instead.
+//
+//==========================================================================
+void pCode_ReplaceCode(int start, const vector<byte> &code)
+{
+	allocScope_t allocScope(ALLOC_PCODE);
+
+	for (int i = start; i < pCode_Current; i++)
+		pCode_Size -= pCode_ByteSizes[i];
+	pCode_Buffer.resize(start);
+	pCode_ByteSizes.resize(start);
+	pCode_Current = start;
+	for (byte data : code)
+		pCode_Append(data);
+}
+
+//==========================================================================
+//
+// RecordLine
+//
+// Called as each pcode is emitted, if -g or -instrument needs the lines.
+// A record starts wherever the source line changes; pcodes merged away
+// after being emitted lose theirs. The file is only looked up again when
+// the source being read changes.
+//
+//==========================================================================
+static void RecordLine()
+{
+	if (!pCode_RecordLines)
+		return;
+	while (!Lines.empty() && Lines.back().address >= pCode_Current)
+		Lines.pop_back();
+
+	if (LineFile < 0 || LineFiles[LineFile] != tk_SourceName)
+	{
+		LineFile = 0;
+		while (LineFile < LineFiles.size() && LineFiles[LineFile] != tk_SourceName)
+			LineFile++;
+		if (LineFile == LineFiles.size())
+			LineFiles.add(tk_SourceName);
+	}
+	if (!Lines.empty() && Lines.back().file == LineFile && Lines.back().line == tk_Line)
+		return;
+	Lines.add({ pCode_Current, LineFile, tk_Line });
+}
+
+//==========================================================================
+//
+// FindLineRecord
+//
+// The record covering address, or -1 if it comes before them all.
+//
+//==========================================================================
+static int FindLineRecord(int address)
+{
+	auto found = std::upper_bound(Lines.begin(), Lines.end(), address,
+		[](int a, const pcLine_t &record) { return a < record.address; });
+
+	return (found - Lines.begin()) - 1;
+}
+
+//==========================================================================
+//
+// pCode_FindLine
+//
+// The source file and line the pcode at address was emitted for.
+//
+//==========================================================================
+bool pCode_FindLine(int address, string &file, int &line)
+{
+	int record = FindLineRecord(address);
+
+	if (record < 0)
+		return false;
+	file = LineFiles[Lines[record].file];
+	line = Lines[record].line;
+	return true;
+}
+
+//==========================================================================
+//
+// pCode_MoveLines
+//
+// Called after pCode_ReplaceCode, with where each pcode that was kept
+// went, in the order they are now in. Pcodes that were added belong to
+// the line before them.
+//
+//==========================================================================
+void pCode_MoveLines(int start, const VecInt &from, const VecInt &to)
+{
+	vector<pcLine_t> moved;
+
+	for (int i = 0; i < from.size(); i++)
+	{
+		int record = FindLineRecord(from.at(i));
+
+		if (record < 0)
+			continue;
+
+		pcLine_t line = Lines[record];
+
+		line.address = to.at(i);
+		if (moved.empty() || moved.back().file != line.file || moved.back().line != line.line)
+			moved.add(line);
+	}
+	while (!Lines.empty() && Lines.back().address >= start)
+		Lines.pop_back();
+	for (pcLine_t &line : moved)
+	{
+		if (Lines.empty() || Lines.back().file != line.file || Lines.back().line != line.line)
+			Lines.add(line);
+	}
+}
+
+//==========================================================================
+//
+// pCode_AddLineBody
+//
+// Called once a script or function has been emitted from start to the
+// end of the buffer, and the optimizer is done with it.
+//
+//==========================================================================
+void pCode_AddLineBody(const string &name, int start)
+{
+	if (pCode_Current > start)
+		LineBodies.add({ name, start, pCode_Current });
+}
+
+//==========================================================================
+//
+// pCode_WriteLines
+//
+// The -g line map. Each row of a body is a range of its pcodes that came
+// from one line, given as the change in address and line from the row
+// before, and the file if it changed:
+//
+//   ; acc lines
+//   file 0 "map01.acs"
+//   body "script 1" 8 120		name, address and size
+//   0 12 0						8: file 0, line 12
+//   6 1						14: line 13
+//   4 5 1						18: file 1, line 18
+//
+// The first row of a body is from its address and line 0, and always
+// gives the file.
+//
+//==========================================================================
+bool pCode_WriteLines(const string &fileName)
+{
+	ofstream out(fileName, ios::out | ios::trunc);
+
+	if (!out.is_open())
+		return false;
+
+	out << "; acc lines" << endl;
+	for (int i = 0; i < LineFiles.size(); i++)
+		out << "file " << i << " \"" << LineFiles[i] << "\"" << endl;
+	for (pcLineBody_t &body : LineBodies)
+		WriteLineBody(out, body);
+	out.close();
+	return !out.fail();
+}
+
+//==========================================================================
+//
+// WriteLineBody
+//
+//==========================================================================
+static void WriteLineBody(ofstream &out, const pcLineBody_t &body)
+{
+	int record = std::max(FindLineRecord(body.start), 0);
+	int address = body.start;
+	int line = 0;
+	int file = -1;
+
+	out << "body \"" << body.name << "\" " << body.start << " " << body.end - body.start << endl;
+	for (; record < Lines.size() && Lines[record].address < body.end; record++)
+	{
+		pcLine_t &row = Lines[record];
+		int start = std::max(row.address, body.start);
+
+		out << start - address << " " << row.line - line;
+		if (row.file != file)
+			out << " " << row.file;
+		out << endl;
+		address = start;
+		line = row.line;
+		file = row.file;
+	}
+}
+
 //==========================================================================
 //
 // pCode_Skip
@@ -1177,6 +1880,8 @@ void PC_NameMapVariable(int index, ACS_Node *node)
 //==========================================================================
 void pCode_AddScript(int number, ScriptActivation type, int flags, int argCount, string name = "")
 {
+	allocScope_t allocScope(ALLOC_PCODE);
+
 	if (flags != 0 || number < 0 || number >= 1000)
 	{
 		HaveExtendedScripts = true;
@@ -1260,6 +1965,22 @@ void PC_AddArray(int index, int size)
 	pCode_HexenEnforcer();
 }
 
+//==========================================================================
+//
+// PC_SetArrayDims
+//
+// Remembers the dimensions of a multidimensional array, for LDEF.
+//
+//==========================================================================
+void PC_SetArrayDims(int index, int ndim, int *dims)
+{
+	ArrayDimCounts[index] = ndim;
+	for(int i = 0; i < ndim && i < MAX_ARRAY_DIMS; ++i)
+	{
+		ArrayDims[index][i] = dims[i];
+	}
+}
+
 //==========================================================================
 //
 // PC_InitArray
@@ -1302,6 +2023,85 @@ int PC_AddImport(string name)
 	return Imports.size();
 }
 
+//==========================================================================
+//
+// PC_SetLibraryName
+//
+//==========================================================================
+void PC_SetLibraryName(string name)
+{
+	LibraryName = name;
+}
+
+//==========================================================================
+//
+// PC_AddLibDefine
+//
+//==========================================================================
+void PC_AddLibDefine(string name, int value)
+{
+	LibDefineNames.add(name);
+	LibDefineValues.add(value);
+}
+
+//==========================================================================
+//
+// PC_GetInterface
+//
+// Describes what this library exports, the same things CloseNew writes
+// to FUNC, MEXP, MSTR, ARAY, ASTR and LDEF.
+//
+//==========================================================================
+void PC_GetInterface(libInterface_t &library)
+{
+	int i;
+
+	library.name = LibraryName;
+
+	for(i = 0; i < pCode_FunctionCount; ++i)
+	{
+		functionInfo_t *info = &FunctionInfo[i];
+
+		if(info->address != 0)
+		{
+			library.functions.add({ *STR_GetString(STRLIST_FUNCTIONS, info->name),
+				info->argCount, info->hasReturnValue });
+		}
+	}
+	for(i = 0; i < pa_MapVarCount; ++i)
+	{
+		if(MapVariables[i].imported)
+		{
+			continue;
+		}
+
+		libVariable_t var;
+
+		var.name = MapVariables[i].name;
+		var.isString = ArraySizes[i] ? ArrayOfStrings[i] : MapVariables[i].isString;
+		var.size = ArraySizes[i];
+		if(ArraySizes[i])
+		{
+			if(ArrayDimCounts[i] > 1)
+			{
+				for(int d = 0; d < ArrayDimCounts[i]; ++d)
+				{
+					var.dims.add(ArrayDims[i][d]);
+				}
+			}
+			else
+			{
+				var.dims.add(ArraySizes[i]);
+			}
+		}
+		library.variables.add(var);
+	}
+	for(i = 0; i < LibDefineNames.size(); ++i)
+	{
+		library.defines.add({ LibDefineNames[i], LibDefineValues[i] });
+	}
+}
+
 //==========================================================================
 //
 // pCode_HexenEnforcer
@@ -1313,4 +2113,4 @@ inline void pCode_HexenEnforcer()
 {
 	if (pCode_EnforceHexen)
 		ERR_Error(ERR_HEXEN_COMPAT, true);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,472 @@
+//**************************************************************************
+//**
+//** profile.cpp
+//**
+//** Profiles written by -run -profile and read back by -profile when
+//** compiling. A profile is text:
+//**
+//**   ; acc profile
+//**   body "script 1" 8c2f01d4 3		name, OPT_Hash and block count
+//**   block 1 350					times block 1 was entered
+//**   call 0 350					times the first call ran
+//**
+//** Blocks and calls that never ran are left out. Blocks are numbered as
+//** OPT_Decode splits the body, so a body that has changed since it was
+//** profiled no longer matches its hash and is compiled as usual.
+//**
+//** The compiler hashes a body as the source gives it, before -o or
+//** -profile change it, and -run hashes the body it ran. So the object
+//** profiled must be built without -o or -profile, or nothing in the
+//** profile will match.
+//**
+//** An object compiled with -instrument counts every block entered in
+//** global array PF_COUNTER_ARRAY, and gets a map of its counters:
+//**
+//**   ; acc counters
+//**   array 63						the global array
+//**   counters 250					how many counters it holds
+//**   body "script 1" 8c2f01d4 3		as in a profile
+//**   call 0 2						the first call is in block 2
+//**   counter 0 0 "map01.acs" 12	counter 0 is block 0, from line 12
+//**
+//** Blocks numbered past the body's block count were added when it was
+//** compiled, such as inlined calls. Headers/Counters.acs logs the array
+//** in the game as lines of "acc counter 0 350", and -counts reads the
+//** log back with the map to write a profile. The counts are only those
+//** of the source's blocks if the object was compiled without -o.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <cstring>
+#include <sstream>
+#include "common.h"
+#include "profile.h"
+#include "opt.h"
+#include "vm.h"
+#include "object.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define PROFILE_HEADER "; acc profile"
+#define COUNTERS_HEADER "; acc counters"
+
+// TYPES -------------------------------------------------------------------
+
+// A body instrumented by -instrument
+struct pfCounterBody_t
+{
+	string name;
+	unsigned int hash;
+	int blockCount;
+	VecInt callBlocks;	// The block each call of the profile is in
+};
+
+// A counter added by -instrument
+struct pfCounter_t
+{
+	int body;		// In CounterBodies
+	int block;
+	string file;
+	int line;
+};
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static bool ReadCounters(const string &fileName, vector<pfCounterBody_t> &bodies, vector<pfCounter_t> &counters);
+static bool ReadQuoted(const std::string &text, string &quoted, std::string &rest);
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool pf_Instrument;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static vector<pfBody_t> Bodies;
+static bool Loaded;
+static vector<pfCounterBody_t> CounterBodies;
+static vector<pfCounter_t> Counters;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// PF_Load
+//
+// Returns false if the file can't be read or isn't a profile.
+//
+//==========================================================================
+bool PF_Load(const string &fileName)
+{
+	ifstream file(fileName);
+	std::string text;
+
+	if (!file.is_open() || !std::getline(file, text) || text.compare(0, strlen(PROFILE_HEADER), PROFILE_HEADER) != 0)
+		return false;
+
+	while (std::getline(file, text))
+	{
+		std::istringstream line(text);
+		std::string kind;
+		long long count;
+		int index;
+
+		line >> kind;
+		if (kind == "body")
+		{
+			size_t first = text.find('"');
+			size_t last = text.rfind('"');
+			pfBody_t body;
+			int blocks;
+
+			if (first == std::string::npos || last == first)
+				return false;
+			line.str(text.substr(last + 1));
+			line.clear();
+			if (!(line >> std::hex >> body.hash >> std::dec >> blocks) || blocks < 0)
+				return false;
+			body.name = text.substr(first + 1, last - first - 1);
+			body.blocks.resize(blocks);
+			Bodies.add(body);
+		}
+		else if (kind == "block" || kind == "call")
+		{
+			if (Bodies.empty() || !(line >> index >> count) || index < 0)
+				return false;
+
+			vector<long long> &counts = kind == "block" ? Bodies.back().blocks : Bodies.back().calls;
+
+			if (kind == "call" && index >= counts.size())
+				counts.resize(index + 1);
+			if (index < counts.size())
+				counts[index] = count;
+		}
+		else if (!kind.empty() && kind[0] != ';')
+		{
+			return false;
+		}
+	}
+	Loaded = true;
+	return true;
+}
+
+//==========================================================================
+//
+// PF_Loaded
+//
+//==========================================================================
+bool PF_Loaded()
+{
+	return Loaded;
+}
+
+//==========================================================================
+//
+// PF_FindBody
+//
+// The profile of a body with this name, if it was taken from the same
+// code. Returns NULL if it wasn't.
+//
+//==========================================================================
+const pfBody_t *PF_FindBody(const string &name, unsigned int hash)
+{
+	for (pfBody_t &body : Bodies)
+	{
+		if (body.hash == hash && body.name == name)
+			return &body;
+	}
+	return NULL;
+}
+
+//==========================================================================
+//
+// PF_Write
+//
+// Turns the instructions the VM counted at each address into block and
+// call counts for every body that ran.
+//
+//==========================================================================
+bool PF_Write(const vmState_t &vm, const string &fileName)
+{
+	const acsObject_t &object = *vm.object;
+	vector<objBody_t> bodies;
+	ofstream file(fileName, ios::out | ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	file << PROFILE_HEADER << endl;
+	OBJ_FindBodies(object, bodies);
+	for (objBody_t &found : bodies)
+	{
+		optBody_t body;
+		int ordinal = 0;
+
+		if (!OPT_Decode((const byte *)object.data.data() + found.address, found.size,
+			found.address, vm.compact, body) || vm.hits.at(found.address) == 0)
+		{
+			continue;
+		}
+
+		file << "body \"" << found.name << "\" " << std::hex << OPT_Hash(body) << std::dec
+			<< " " << body.blocks.size() << endl;
+		for (int b = 0; b < body.blocks.size(); b++)
+		{
+			long long count = vm.hits.at(body.blocks[b].code[0].address);
+
+			if (count > 0)
+				file << "block " << b << " " << count << endl;
+		}
+		for (optBlock_t &block : body.blocks)
+		{
+			for (optInstr_t &instr : block.code)
+			{
+				if (instr.cmd != PCD_CALL && instr.cmd != PCD_CALLDISCARD)
+					continue;
+				if (vm.hits.at(instr.address) > 0)
+					file << "call " << ordinal << " " << vm.hits.at(instr.address) << endl;
+				ordinal++;
+			}
+		}
+	}
+	file.close();
+	return !file.fail();
+}
+
+//==========================================================================
+//
+// PF_AddCounterBody
+//
+// Called before the counters of a body are added, with the block each
+// of its calls was in before it was compiled.
+//
+//==========================================================================
+void PF_AddCounterBody(const string &name, unsigned int hash, int blockCount, const VecInt &callBlocks)
+{
+	pfCounterBody_t body;
+
+	body.name = name;
+	body.hash = hash;
+	body.blockCount = blockCount;
+	body.callBlocks = callBlocks;
+	CounterBodies.add(body);
+}
+
+//==========================================================================
+//
+// PF_AddCounter
+//
+// Returns the counter's index in the array.
+//
+//==========================================================================
+int PF_AddCounter(int block, const string &file, int line)
+{
+	pfCounter_t counter;
+
+	counter.body = CounterBodies.size() - 1;
+	counter.block = block;
+	counter.file = file;
+	counter.line = line;
+	Counters.add(counter);
+	return Counters.size() - 1;
+}
+
+//==========================================================================
+//
+// PF_WriteCounters
+//
+//==========================================================================
+bool PF_WriteCounters(const string &fileName)
+{
+	ofstream file(fileName, ios::out | ios::trunc);
+	int body = -1;
+
+	if (!file.is_open())
+		return false;
+
+	file << COUNTERS_HEADER << endl;
+	file << "array " << PF_COUNTER_ARRAY << endl;
+	file << "counters " << Counters.size() << endl;
+	for (int i = 0; i < Counters.size(); i++)
+	{
+		pfCounter_t &counter = Counters[i];
+
+		if (counter.body != body)
+		{
+			pfCounterBody_t &found = CounterBodies[counter.body];
+
+			body = counter.body;
+			file << "body \"" << found.name << "\" " << std::hex << found.hash << std::dec
+				<< " " << found.blockCount << endl;
+			for (int c = 0; c < found.callBlocks.size(); c++)
+				file << "call " << c << " " << found.callBlocks[c] << endl;
+		}
+		file << "counter " << i << " " << counter.block << " \"" << counter.file << "\" " << counter.line << endl;
+	}
+	file.close();
+	return !file.fail();
+}
+
+//==========================================================================
+//
+// PF_ConvertCounters
+//
+// Writes a profile from the map of an instrumented object and a log of
+// its counters. Lines of the log that aren't "acc counter i n" are other
+// messages and are skipped. A call ran as often as the block it is in.
+//
+//==========================================================================
+bool PF_ConvertCounters(const string &countersName, const string &logName, const string &profileName)
+{
+	vector<pfCounterBody_t> bodies;
+	vector<pfCounter_t> counters;
+	vector<pfBody_t> counted;
+	ifstream log(logName);
+	std::string text;
+
+	if (!ReadCounters(countersName, bodies, counters) || !log.is_open())
+		return false;
+
+	counted.resize(bodies.size());
+	for (int b = 0; b < bodies.size(); b++)
+		counted[b].blocks.resize(bodies[b].blockCount);
+	while (std::getline(log, text))
+	{
+		size_t found = text.find("acc counter ");
+		int index;
+		long long count;
+
+		if (found == std::string::npos)
+			continue;
+
+		std::istringstream line(text.substr(found + strlen("acc counter ")));
+
+		if (!(line >> index >> count) || index < 0 || index >= counters.size())
+			continue;
+
+		pfCounter_t &counter = counters[index];
+		vector<long long> &blocks = counted[counter.body].blocks;
+
+		// Blocks added when the body was compiled aren't in the profile
+		if (counter.block < blocks.size())
+			blocks[counter.block] += count;
+	}
+
+	ofstream file(profileName, ios::out | ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	file << PROFILE_HEADER << endl;
+	for (int b = 0; b < bodies.size(); b++)
+	{
+		pfCounterBody_t &body = bodies[b];
+		vector<long long> &blocks = counted[b].blocks;
+
+		if (blocks.empty() || blocks[0] == 0)
+			continue;
+
+		file << "body \"" << body.name << "\" " << std::hex << body.hash << std::dec
+			<< " " << body.blockCount << endl;
+		for (int i = 0; i < blocks.size(); i++)
+		{
+			if (blocks[i] > 0)
+				file << "block " << i << " " << blocks[i] << endl;
+		}
+		for (int c = 0; c < body.callBlocks.size(); c++)
+		{
+			int block = body.callBlocks[c];
+
+			if (block >= 0 && block < blocks.size() && blocks[block] > 0)
+				file << "call " << c << " " << blocks[block] << endl;
+		}
+	}
+	file.close();
+	return !file.fail();
+}
+
+//==========================================================================
+//
+// ReadCounters
+//
+// Reads the map PF_WriteCounters wrote. Returns false if the file can't
+// be read or isn't one.
+//
+//==========================================================================
+static bool ReadCounters(const string &fileName, vector<pfCounterBody_t> &bodies, vector<pfCounter_t> &counters)
+{
+	ifstream file(fileName);
+	std::string text;
+
+	if (!file.is_open() || !std::getline(file, text) || text.compare(0, strlen(COUNTERS_HEADER), COUNTERS_HEADER) != 0)
+		return false;
+
+	while (std::getline(file, text))
+	{
+		std::istringstream line(text);
+		std::string kind;
+		std::string rest;
+		int index;
+		int block;
+
+		line >> kind;
+		if (kind == "body")
+		{
+			pfCounterBody_t body;
+
+			if (!ReadQuoted(text, body.name, rest))
+				return false;
+			line.str(rest);
+			line.clear();
+			if (!(line >> std::hex >> body.hash >> std::dec >> body.blockCount) || body.blockCount < 0)
+				return false;
+			bodies.add(body);
+		}
+		else if (kind == "call")
+		{
+			if (bodies.empty() || !(line >> index >> block) || index != bodies.back().callBlocks.size())
+				return false;
+			bodies.back().callBlocks.add(block);
+		}
+		else if (kind == "counter")
+		{
+			pfCounter_t counter;
+
+			if (bodies.empty() || !(line >> index >> counter.block) || index != counters.size()
+				|| !ReadQuoted(text, counter.file, rest))
+			{
+				return false;
+			}
+			line.str(rest);
+			line.clear();
+			line >> counter.line;
+			counter.body = bodies.size() - 1;
+			counters.add(counter);
+		}
+		else if (kind != "array" && kind != "counters" && !kind.empty() && kind[0] != ';')
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// ReadQuoted
+//
+// Splits a line at the first and last quotes.
+//
+//==========================================================================
+static bool ReadQuoted(const std::string &text, string &quoted, std::string &rest)
+{
+	size_t first = text.find('"');
+	size_t last = text.rfind('"');
+
+	if (first == std::string::npos || last == first)
+		return false;
+	quoted = text.substr(first + 1, last - first - 1);
+	rest = text.substr(last + 1);
+	return true;
+}
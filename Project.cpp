@@ -0,0 +1,510 @@
+//**************************************************************************
+//**
+//** project.cpp
+//**
+//** Builds several sources and the libraries they import in one run.
+//** Files are only scanned for directives here, never tokenized.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "common.h"
+#include "project.h"
+#include "token.h"
+#include "error.h"
+#include "misc.h"
+#include "stats.h"
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+enum NodeState : int
+{
+	NODE_WAITING,		// Imports not built yet
+	NODE_READY,			// Queued for a worker
+	NODE_BUILT,			// Compiled this run
+	NODE_CURRENT,		// Object was already up to date
+	NODE_FAILED			// Failed, or an import failed
+};
+
+// A source that gets compiled into an object: one named on the command
+// line, or a library imported by one.
+struct projectNode_t
+{
+	string source;
+	string object;
+	bool isLibrary;
+	VecStr includes;	// Every file #included, directly or not
+	VecInt imports;		// Nodes #imported by this one
+	VecInt users;		// Nodes that #import this one
+	int waiting;		// Imports not finished yet
+	time_t newestInput;	// Newest of the source and its includes
+	NodeState state;
+};
+
+// EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static int AddNode(const string &sourceName);
+static void ScanFile(const string &fileName, projectNode_t &node, VecStr &imports, VecStr &visited);
+static bool ResolvePath(const string &from, const string &fileName, string &path);
+static bool SortNodes();
+static void Worker(int track);
+static bool CompileNode(int index);
+static void FinishNode(int index, NodeState state);
+static bool WriteDepFile(const string &name);
+
+// EXTERNAL DATA DECLARATIONS ----------------------------------------------
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static vector<projectNode_t> Nodes;
+static VecStr Options;
+static string Program;
+static VecInt Ready;
+static int Unfinished;
+static std::mutex QueueLock;
+static std::condition_variable QueueSignal;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// PJ_AddSource
+//
+//==========================================================================
+void PJ_AddSource(string sourceName)
+{
+	MS_SuggestFileExt(sourceName, ".acs");
+	AddNode(sourceName);
+}
+
+//==========================================================================
+//
+// PJ_AddOption
+//
+// Options passed on to every compile, such as include paths.
+//
+//==========================================================================
+void PJ_AddOption(string option)
+{
+	Options.add(option);
+}
+
+//==========================================================================
+//
+// PJ_Build
+//
+// Builds every source given with PJ_AddSource, and every library they
+// import, in dependency order. Libraries are compiled with -l so that
+// the ones importing them read the interface file instead of the
+// library's source. Sources whose object is newer than everything it
+// depends on are skipped. Returns the exit code for main.
+//
+//==========================================================================
+int PJ_Build(string program, int jobs)
+{
+	std::vector<std::thread> workers;
+	int failed = 0;
+
+	Program = program;
+
+	if (Nodes.empty())
+		return 0;
+
+	if (!SortNodes())
+		return 1;
+
+	if (jobs <= 0)
+		jobs = std::thread::hardware_concurrency();
+	if (jobs <= 0)
+		jobs = 1;
+
+	Message(MSG_NORMAL, "Building " + string((int)Nodes.size()) + " objects with " + string(jobs) + " jobs");
+
+	Unfinished = Nodes.size();
+	for (int i = 0; i < Nodes.size(); i++)
+	{
+		if (Nodes[i].waiting == 0)
+		{
+			Nodes[i].state = NODE_READY;
+			Ready.add(i);
+		}
+	}
+
+	for (int i = 0; i < jobs; i++)
+		workers.push_back(std::thread(Worker, i + 1));
+	for (std::thread &worker : workers)
+		worker.join();
+
+	for (projectNode_t &node : Nodes)
+	{
+		if (node.state == NODE_FAILED)
+			failed++;
+	}
+
+	if (!WriteDepFile(PROJECT_DEPFILE))
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, PROJECT_DEPFILE);
+
+	if (failed > 0)
+	{
+		Message(MSG_NORMAL, string(failed) + " of " + string((int)Nodes.size()) + " objects failed");
+		return 1;
+	}
+	return 0;
+}
+
+//==========================================================================
+//
+// AddNode
+//
+// Adds a source to the graph, scanning it and everything it imports.
+// Returns its index.
+//
+//==========================================================================
+static int AddNode(const string &sourceName)
+{
+	projectNode_t node;
+	VecStr imports;
+	VecStr visited;
+	int index;
+
+	for (index = 0; index < Nodes.size(); index++)
+	{
+		if (Nodes[index].source == sourceName)
+			return index;
+	}
+
+	if (!MS_FileExists(sourceName))
+		ERR_Exit(ERR_CANT_OPEN_FILE, false, sourceName);
+
+	node.source = sourceName;
+	node.object = sourceName;
+	MS_StripFileExt(node.object);
+	MS_SuggestFileExt(node.object, ".o");
+	node.isLibrary = false;
+	node.waiting = 0;
+	node.newestInput = MS_FileTime(sourceName);
+	node.state = NODE_WAITING;
+
+	ScanFile(sourceName, node, imports, visited);
+
+	index = Nodes.size();
+	Nodes.add(node);
+
+	for (string &import : imports)
+	{
+		int lib = AddNode(import);
+
+		Nodes[index].imports.add(lib);
+		Nodes[lib].users.add(index);
+	}
+	Nodes[index].waiting = Nodes[index].imports.size();
+	return index;
+}
+
+//==========================================================================
+//
+// ScanFile
+//
+// Looks for #include, #import and #library outside of comments and
+// strings. Included files are scanned too, since their directives
+// count for the file including them.
+//
+//==========================================================================
+static void ScanFile(const string &fileName, projectNode_t &node, VecStr &imports, VecStr &visited)
+{
+	int size;
+	const char *data;
+
+	for (string &name : visited)
+	{
+		if (name == fileName)
+			return;
+	}
+	visited.add(fileName);
+
+	data = MS_MapFile(fileName, size);
+	if (data == NULL)
+		return;
+
+	for (int i = 0; i < size; i++)
+	{
+		if (data[i] == '/' && i + 1 < size && data[i + 1] == '/')
+		{
+			while (i < size && data[i] != '\n')
+				i++;
+		}
+		else if (data[i] == '/' && i + 1 < size && data[i + 1] == '*')
+		{
+			for (i += 2; i + 1 < size && !(data[i] == '*' && data[i + 1] == '/'); i++)
+				;
+			i++;
+		}
+		else if (data[i] == '"')
+		{
+			for (i++; i < size && data[i] != '"'; i++)
+			{
+				if (data[i] == '\\')
+					i++;
+			}
+		}
+		else if (data[i] == '#')
+		{
+			string directive, argument, path;
+
+			for (i++; i < size && (data[i] == ' ' || data[i] == '\t'); i++)
+				;
+			for (; i < size && isalpha((byte)data[i]); i++)
+				directive.append(1, tolower(data[i]));
+			for (; i < size && (data[i] == ' ' || data[i] == '\t'); i++)
+				;
+			if (i >= size || data[i] != '"')
+			{
+				i--;
+				continue;
+			}
+			for (i++; i < size && data[i] != '"' && data[i] != '\n'; i++)
+				argument.append(1, data[i]);
+
+			if (directive == "library")
+			{
+				node.isLibrary = true;
+			}
+			else if (directive == "include" || directive == "import")
+			{
+				if (!ResolvePath(fileName, argument, path))
+				{
+					ERR_ErrorAt(fileName, 0);
+					ERR_Exit(ERR_CANT_FIND_INCLUDE, true, argument);
+				}
+				if (directive == "import")
+				{
+					imports.add(path);
+				}
+				else
+				{
+					node.includes.add(path);
+					node.newestInput = std::max(node.newestInput, MS_FileTime(path));
+					ScanFile(path, node, imports, visited);
+				}
+			}
+		}
+	}
+	MS_UnmapFile(data, size);
+}
+
+//==========================================================================
+//
+// ResolvePath
+//
+// The directory of the including file is searched first, the same as
+// TK_Include does, and then the include paths.
+//
+//==========================================================================
+static bool ResolvePath(const string &from, const string &fileName, string &path)
+{
+	if (!MS_IsPathAbsolute(fileName))
+	{
+		path = from;
+		if (!MS_StripFilename(path))
+			path = "";
+		path += fileName;
+		if (MS_FileExists(path))
+			return true;
+	}
+	return TK_FindInclude(fileName, path);
+}
+
+//==========================================================================
+//
+// SortNodes
+//
+// Checks that the imports form no cycle, which would leave some library
+// waiting forever.
+//
+//==========================================================================
+static bool SortNodes()
+{
+	VecInt waiting;
+	VecInt order;
+
+	for (int i = 0; i < Nodes.size(); i++)
+	{
+		waiting.add(Nodes[i].waiting);
+		if (Nodes[i].waiting == 0)
+			order.add(i);
+	}
+	for (int i = 0; i < order.size(); i++)
+	{
+		for (int user : Nodes[order[i]].users)
+		{
+			if (--waiting[user] == 0)
+				order.add(user);
+		}
+	}
+	if (order.size() == Nodes.size())
+		return true;
+
+	for (int i = 0; i < Nodes.size(); i++)
+	{
+		if (waiting[i] > 0)
+		{
+			ERR_Error(ERR_IMPORT_CYCLE, false, Nodes[i].source);
+		}
+	}
+	ERR_Finish();
+	return false;
+}
+
+//==========================================================================
+//
+// Worker
+//
+// Takes ready nodes off the queue until everything is finished. Each
+// worker gets its own track in the trace.
+//
+//==========================================================================
+static void Worker(int track)
+{
+	ST_SetTrack(track, "worker " + to_string(track));
+
+	for (;;)
+	{
+		int index;
+		bool built;
+
+		{
+			std::unique_lock<std::mutex> lock(QueueLock);
+
+			QueueSignal.wait(lock, [] { return !Ready.empty() || Unfinished == 0; });
+			if (Ready.empty())
+				return;
+			index = Ready.back();
+			Ready.pop_back();
+		}
+		ST_TraceBegin("compile", ST_TraceArg("source", Nodes[index].source));
+		built = CompileNode(index);
+		ST_TraceEnd(ST_TraceArg("result", built ? (Nodes[index].state == NODE_CURRENT ? "current" : "built") : "failed"));
+		FinishNode(index, built ? NODE_BUILT : NODE_FAILED);
+	}
+}
+
+//==========================================================================
+//
+// CompileNode
+//
+// Compiles a node in a child acc, unless its object is newer than its
+// inputs and every library it imports. Sets NODE_CURRENT if skipped.
+//
+//==========================================================================
+static bool CompileNode(int index)
+{
+	projectNode_t &node = Nodes[index];
+	time_t objectTime = MS_FileTime(node.object);
+	bool current = objectTime != 0 && objectTime >= node.newestInput;
+	string command;
+
+	for (int lib : node.imports)
+	{
+		if (Nodes[lib].state == NODE_BUILT || MS_FileTime(Nodes[lib].object) > objectTime)
+			current = false;
+	}
+	if (current)
+	{
+		std::lock_guard<std::mutex> lock(QueueLock);
+		node.state = NODE_CURRENT;
+		Message(MSG_VERBOSE, "Up to date: " + node.source);
+		return true;
+	}
+
+	command = "\"" + Program + "\" -L";
+	for (string &option : Options)
+		command += " \"" + option + "\"";
+	command += " \"" + node.source + "\" \"" + node.object + "\"";
+
+	Message(MSG_NORMAL, "Compiling " + node.source);
+	return std::system(command.c_str()) == 0;
+}
+
+//==========================================================================
+//
+// FinishNode
+//
+// Queues the nodes that were waiting on this one. If it failed, they
+// fail too without being compiled.
+//
+//==========================================================================
+static void FinishNode(int index, NodeState state)
+{
+	VecInt failed;
+
+	{
+		std::lock_guard<std::mutex> lock(QueueLock);
+
+		if (Nodes[index].state != NODE_CURRENT || state == NODE_FAILED)
+			Nodes[index].state = state;
+		Unfinished--;
+
+		for (int user : Nodes[index].users)
+		{
+			if (state == NODE_FAILED)
+			{
+				if (Nodes[user].state == NODE_WAITING)
+				{
+					Nodes[user].state = NODE_FAILED;
+					failed.add(user);
+				}
+			}
+			else if (--Nodes[user].waiting == 0 && Nodes[user].state == NODE_WAITING)
+			{
+				Nodes[user].state = NODE_READY;
+				Ready.add(user);
+			}
+		}
+	}
+	for (int user : failed)
+	{
+		Message(MSG_NORMAL, "Skipping " + Nodes[user].source + ": an import failed");
+		FinishNode(user, NODE_FAILED);
+	}
+	QueueSignal.notify_all();
+}
+
+//==========================================================================
+//
+// WriteDepFile
+//
+// Writes a make rule for each object, which ninja also reads.
+//
+//==========================================================================
+static bool WriteDepFile(const string &name)
+{
+	ofstream file(name, ios::out | ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	for (projectNode_t &node : Nodes)
+	{
+		file << MS_EscapeMakePath(node.object) << ": " << MS_EscapeMakePath(node.source);
+		for (string &include : node.includes)
+			file << " \\" << endl << "  " << MS_EscapeMakePath(include);
+		for (int lib : node.imports)
+			file << " \\" << endl << "  " << MS_EscapeMakePath(Nodes[lib].object);
+		file << endl;
+	}
+	file.close();
+	return !file.fail();
+}
@@ -0,0 +1,320 @@
+//**************************************************************************
+//**
+//** sizes.cpp
+//**
+//** The -s report: which part of the object every byte belongs to, and
+//** which pcodes each script and function was built from. Both are read
+//** back from the finished object, so they show what -o and -profile
+//** made of the bodies.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <iomanip>
+#include "common.h"
+#include "sizes.h"
+#include "pcode.h"
+#include "object.h"
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+// Pcodes in one script or function of the object
+struct bodyCounts_t
+{
+	string name;
+	VecInt commands;	// Indexed by pcode
+};
+
+// A range of bytes in the object
+struct sizeRegion_t
+{
+	int start;
+	int size;
+	string name;
+	bool isBody;
+};
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static void AddRegion(vector<sizeRegion_t> &regions, int start, int size, const string &name, bool isBody = false);
+static void FindDirectory(const acsObject_t &object, vector<sizeRegion_t> &regions, bool strings);
+static void FillGaps(const acsObject_t &object, vector<sizeRegion_t> &regions);
+static void CountCommands(const acsObject_t &object, const objBody_t &body, bodyCounts_t &counts);
+static void PrintReport(ostream &out, const acsObject_t &object, vector<sizeRegion_t> &regions,
+	const vector<bodyCounts_t> &bodies);
+static string ChunkName(int id);
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool sz_Enabled;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// SZ_WriteReport
+//
+// Reads the object back and divides it into regions: the header, each
+// body, each chunk, the Hexen directory and string table, and padding.
+// Anything else is reported as "other". Writes to the console if no
+// file name is given.
+//
+//==========================================================================
+bool SZ_WriteReport(const string &objectName, const string &fileName)
+{
+	acsObject_t object;
+	vector<sizeRegion_t> regions;
+	vector<objBody_t> bodies;
+	vector<bodyCounts_t> counts;
+
+	if (!OBJ_Load(objectName, object))
+		return false;
+
+	AddRegion(regions, 0, 8, "header");
+	if (object.format == OBJ_FORMAT_ACS0)
+	{
+		FindDirectory(object, regions, true);
+	}
+	else
+	{
+		for (objChunk_t &chunk : object.chunks)
+			AddRegion(regions, chunk.offset - 8, chunk.size + 8, "chunk " + ChunkName(chunk.id));
+
+		if (object.data[3] == 0)
+		{ // Wrapped in a Hexen object: the chunk pointer and marker, then
+		  // a directory of WadAuthor's dummy scripts
+			AddRegion(regions, object.dirOffset - 8, 8, "chunk list end");
+			FindDirectory(object, regions, false);
+		}
+	}
+	OBJ_FindBodies(object, bodies);
+	counts.resize(bodies.size());
+	for (int i = 0; i < bodies.size(); i++)
+	{
+		AddRegion(regions, bodies[i].address, bodies[i].size, bodies[i].name, true);
+		CountCommands(object, bodies[i], counts[i]);
+	}
+	FillGaps(object, regions);
+
+	if (fileName.empty())
+	{
+		PrintReport(cerr, object, regions, counts);
+		return true;
+	}
+
+	ofstream file(fileName, ios::out | ios::trunc);
+
+	if (!file.is_open())
+		return false;
+	PrintReport(file, object, regions, counts);
+	file.close();
+	return !file.fail();
+}
+
+//==========================================================================
+//
+// AddRegion
+//
+//==========================================================================
+static void AddRegion(vector<sizeRegion_t> &regions, int start, int size, const string &name, bool isBody)
+{
+	sizeRegion_t region;
+
+	region.start = start;
+	region.size = size;
+	region.name = name;
+	region.isBody = isBody;
+	regions.add(region);
+}
+
+//==========================================================================
+//
+// FindDirectory
+//
+// The Hexen script directory and string offsets. Only a Hexen object
+// keeps its strings there; the new formats leave the list empty.
+//
+//==========================================================================
+static void FindDirectory(const acsObject_t &object, vector<sizeRegion_t> &regions, bool strings)
+{
+	int size = object.data.size();
+	int count = OBJ_ReadInt(object, object.dirOffset);
+
+	if (count < 0 || count > (size - object.dirOffset) / 12)
+		return;
+	AddRegion(regions, object.dirOffset, 4 + count * 12, "script directory");
+
+	int list = object.dirOffset + 4 + count * 12;
+
+	count = OBJ_ReadInt(object, list);
+	if (count < 0 || count > (size - list) / 4)
+		return;
+	AddRegion(regions, list, 4 + count * 4, "string offsets");
+
+	for (int i = 0; strings && i < count; i++)
+	{
+		int offset = OBJ_ReadInt(object, list + 4 + i * 4);
+
+		AddRegion(regions, offset, OBJ_ReadString(object, offset).length() + 1, "strings");
+	}
+}
+
+//==========================================================================
+//
+// FillGaps
+//
+// Sorts the regions and names the bytes none of them cover.
+//
+//==========================================================================
+static void FillGaps(const acsObject_t &object, vector<sizeRegion_t> &regions)
+{
+	int size = object.data.size();
+	int count = regions.size();
+	int pos = 0;
+
+	std::sort(regions.begin(), regions.end(),
+		[](const sizeRegion_t &a, const sizeRegion_t &b) { return a.start < b.start; });
+
+	for (int i = 0; i <= count; i++)
+	{
+		int start = i < count ? regions[i].start : size;
+
+		if (start > pos)
+		{
+			bool zero = std::all_of(object.data.begin() + pos, object.data.begin() + start,
+				[](char c) { return c == 0; });
+
+			AddRegion(regions, pos, start - pos, string(zero ? "padding" : "other"));
+		}
+		if (i < count)
+			pos = std::max(pos, std::min(regions[i].start + regions[i].size, size));
+	}
+}
+
+//==========================================================================
+//
+// CountCommands
+//
+// Decodes a body up to the padding after it, or the first pcode that
+// can't be decoded.
+//
+//==========================================================================
+static void CountCommands(const acsObject_t &object, const objBody_t &body, bodyCounts_t &counts)
+{
+	const byte *code = (const byte *)object.data.data() + body.address;
+	int end = body.size;
+	int pos = 0;
+
+	counts.name = body.name;
+	counts.commands.resize(PCODE_COMMAND_COUNT);
+	while (end > 0 && code[end - 1] == 0)
+		end--;
+	while (pos < end)
+	{
+		objInstr_t instr;
+
+		if (!OBJ_DecodeInstr(code, body.size, pos, body.address, object.format == OBJ_FORMAT_ACSe, instr))
+			break;
+		counts.commands[instr.cmd]++;
+		pos += instr.size;
+	}
+}
+
+//==========================================================================
+//
+// PrintReport
+//
+// Regions with the same name, such as padding and repeated chunks, are
+// added together. Bodies come last with their pcode counts.
+//
+//==========================================================================
+static void PrintReport(ostream &out, const acsObject_t &object, vector<sizeRegion_t> &regions,
+	const vector<bodyCounts_t> &bodies)
+{
+	vector<sizeRegion_t> totals;
+	VecInt pieces;
+	double total = object.data.size();
+
+	for (sizeRegion_t &region : regions)
+	{
+		int i = 0;
+
+		while (i < totals.size() && totals[i].name != region.name)
+			i++;
+		if (i == totals.size())
+		{
+			totals.add(region);
+			pieces.add(1);
+		}
+		else
+		{
+			totals[i].size += region.size;
+			pieces[i]++;
+		}
+	}
+
+	VecInt order;
+
+	for (int i = 0; i < totals.size(); i++)
+		order.add(i);
+	std::stable_sort(order.begin(), order.end(),
+		[&](int a, int b) { return totals[a].size > totals[b].size; });
+
+	out << "\"" << object.name << "\": " << object.data.size() << " bytes" << endl;
+	out << "     bytes       %  region" << endl;
+	out << std::fixed << std::setprecision(1);
+	for (int i : order)
+	{
+		out << std::setw(10) << totals[i].size << std::setw(7) << totals[i].size * 100 / total
+			<< "%  " << totals[i].name;
+		if (pieces[i] > 1)
+			out << " (" << pieces[i] << ")";
+		out << endl;
+	}
+
+	for (int i : order)
+	{
+		if (!totals[i].isBody)
+			continue;
+
+		for (const bodyCounts_t &body : bodies)
+		{
+			if (body.name != totals[i].name)
+				continue;
+
+			VecInt commands;
+
+			for (int cmd = 0; cmd < PCODE_COMMAND_COUNT; cmd++)
+			{
+				if (body.commands[cmd] > 0)
+					commands.add(cmd);
+			}
+			std::stable_sort(commands.begin(), commands.end(),
+				[&](int a, int b) { return body.commands[a] > body.commands[b]; });
+
+			out << endl << totals[i].name << ": " << totals[i].size << " bytes" << endl;
+			for (int cmd : commands)
+				out << std::setw(10) << body.commands[cmd] << "  " << pCode_Names[cmd] << endl;
+			break;
+		}
+	}
+}
+
+//==========================================================================
+//
+// ChunkName
+//
+//==========================================================================
+static string ChunkName(int id)
+{
+	string name;
+
+	for (int i = 0; i < 4; i++)
+		name += (char)((id >> (i * 8)) & 255);
+	return name;
+}
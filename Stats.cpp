@@ -0,0 +1,631 @@
+//**************************************************************************
+//**
+//** stats.cpp
+//**
+//** Phase timings and counters for -t, trace spans for -r, and
+//** allocations by subsystem for -a.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include "common.h"
+#include "stats.h"
+#include "misc.h"
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+struct phaseTime_t
+{
+	double wall;		// Seconds
+	double cpu;			// Seconds
+	double wallStart;
+	double cpuStart;
+	int running;		// Nesting of ST_StartPhase calls
+};
+
+// Wall time spent while a file is open, including the parsing and code
+// generation done while reading it, but not the files it includes
+struct fileTime_t
+{
+	string name;
+	double wall;
+};
+
+// Allocations charged to one subsystem. Atomic, since project mode
+// allocates from several threads.
+struct allocStats_t
+{
+	std::atomic<long long> count;
+	std::atomic<long long> bytes;
+	std::atomic<long long> live;	// Bytes not freed yet
+	std::atomic<long long> peak;	// Most bytes live at once
+};
+
+// Put in front of every allocation, so it can be uncharged when freed.
+// Sized to keep the block after it aligned as malloc's was.
+struct alignas(std::max_align_t) allocHeader_t
+{
+	size_t size;
+	int tag;
+};
+
+// A span for the trace file
+struct traceEvent_t
+{
+	string name;
+	string args;		// JSON members, without the braces
+	double start;		// Seconds
+	double duration;
+	int track;
+};
+
+// EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static double WallTime();
+static double CpuTime();
+static void ChargeFile(double now);
+static string JsonString(const string &text);
+static string JoinArgs(const string &a, const string &b);
+static void AllocJson(ofstream &file);
+
+// EXTERNAL DATA DECLARATIONS ----------------------------------------------
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool st_Enabled;
+long long st_Counters[NUM_STAT_COUNTERS];
+bool st_Tracing;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static phaseTime_t Phases[NUM_PHASES];
+static vector<fileTime_t> Files;
+static VecInt FileStack;
+static double FileStart;
+static vector<traceEvent_t> TraceEvents;
+static vector<traceEvent_t> TrackNames;
+static std::mutex TraceLock;
+static double TraceStart = WallTime();
+static thread_local vector<traceEvent_t> OpenSpans;
+static thread_local int Track;
+static allocStats_t Allocs[NUM_ALLOC_TAGS];
+static thread_local AllocTag CurrentAllocTag;
+
+static const char *AllocTagNames[NUM_ALLOC_TAGS] =
+{
+	"other",
+	"lexer",
+	"parser",
+	"symbols",
+	"strings",
+	"pcode"
+};
+
+static const char *PhaseNames[NUM_PHASES] =
+{
+	"lex",
+	"parse",
+	"close",
+	"write"
+};
+
+static const char *CounterNames[NUM_STAT_COUNTERS] =
+{
+	"tokens",
+	"symbol_lookups",
+	"symbol_probes",
+	"string_lookups",
+	"string_probes",
+	"fillins",
+	"peak_pcode_bytes",
+	"peak_symbols",
+	"peak_nesting"
+};
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// ST_StartPhase
+//
+// Phases may nest; only the outermost start and end are timed.
+//
+//==========================================================================
+void ST_StartPhase(StatPhase phase)
+{
+	phaseTime_t &p = Phases[phase];
+
+	if (!st_Enabled || p.running++ > 0)
+		return;
+	p.wallStart = WallTime();
+	p.cpuStart = CpuTime();
+}
+
+//==========================================================================
+//
+// ST_EndPhase
+//
+//==========================================================================
+void ST_EndPhase(StatPhase phase)
+{
+	phaseTime_t &p = Phases[phase];
+
+	if (!st_Enabled || p.running == 0 || --p.running > 0)
+		return;
+	p.wall += WallTime() - p.wallStart;
+	p.cpu += CpuTime() - p.cpuStart;
+}
+
+//==========================================================================
+//
+// ST_Peak
+//
+//==========================================================================
+void ST_Peak(StatCounter counter, long long value)
+{
+	if (value > st_Counters[counter])
+		st_Counters[counter] = value;
+}
+
+//==========================================================================
+//
+// ST_EnterFile
+//
+// Called when the lexer starts reading a file. Until ST_LeaveFile, all
+// wall time is charged to it rather than the file including it.
+//
+//==========================================================================
+void ST_EnterFile(const string &fileName)
+{
+	double now;
+	int index;
+
+	if (!st_Enabled)
+		return;
+
+	now = WallTime();
+	ChargeFile(now);
+
+	for (index = 0; index < Files.size(); index++)
+	{
+		if (Files[index].name == fileName)
+			break;
+	}
+	if (index == Files.size())
+		Files.add({ fileName, 0 });
+	FileStack.add(index);
+	ST_Peak(STAT_PEAK_NESTING, FileStack.size() - 1);
+}
+
+//==========================================================================
+//
+// ST_LeaveFile
+//
+//==========================================================================
+void ST_LeaveFile()
+{
+	if (!st_Enabled || FileStack.empty())
+		return;
+
+	ChargeFile(WallTime());
+	FileStack.pop_back();
+}
+
+//==========================================================================
+//
+// ChargeFile
+//
+//==========================================================================
+static void ChargeFile(double now)
+{
+	if (!FileStack.empty())
+		Files[FileStack.back()].wall += now - FileStart;
+	FileStart = now;
+}
+
+//==========================================================================
+//
+// ST_Report
+//
+//==========================================================================
+void ST_Report()
+{
+	if (!st_Enabled)
+		return;
+
+	ChargeFile(WallTime());
+
+	cerr << std::fixed << std::setprecision(3);
+	cerr << "  phase          wall ms    cpu ms" << endl;
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		double wall = Phases[i].wall;
+		double cpu = Phases[i].cpu;
+
+		if (i == PHASE_PARSE)
+		{ // Lexing is reported on its own
+			wall -= Phases[PHASE_LEX].wall;
+			cpu -= Phases[PHASE_LEX].cpu;
+		}
+		cerr << "  " << std::left << std::setw(10) << PhaseNames[i] << std::right
+			<< std::setw(12) << wall * 1000 << std::setw(10) << cpu * 1000 << endl;
+	}
+
+	cerr << "  file" << endl;
+	for (fileTime_t &file : Files)
+		cerr << std::setw(12) << file.wall * 1000 << " ms  " << file.name << endl;
+
+	for (int i = 0; i < NUM_STAT_COUNTERS; i++)
+		cerr << "  " << std::left << std::setw(18) << CounterNames[i] << std::right << st_Counters[i] << endl;
+}
+
+//==========================================================================
+//
+// ST_WriteJson
+//
+// Writes the same numbers as ST_Report, with times in milliseconds.
+//
+//==========================================================================
+bool ST_WriteJson(const string &fileName)
+{
+	ofstream file(fileName, ios::out | ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	ChargeFile(WallTime());
+
+	file << std::fixed << std::setprecision(3);
+	file << "{" << endl << "  \"phases\": {";
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		double wall = Phases[i].wall;
+		double cpu = Phases[i].cpu;
+
+		if (i == PHASE_PARSE)
+		{
+			wall -= Phases[PHASE_LEX].wall;
+			cpu -= Phases[PHASE_LEX].cpu;
+		}
+		file << (i ? "," : "") << endl << "    \"" << PhaseNames[i]
+			<< "\": { \"wall_ms\": " << wall * 1000 << ", \"cpu_ms\": " << cpu * 1000 << " }";
+	}
+	file << endl << "  }," << endl << "  \"files\": [";
+	for (int i = 0; i < Files.size(); i++)
+	{
+		file << (i ? "," : "") << endl << "    { \"name\": " << JsonString(Files[i].name)
+			<< ", \"wall_ms\": " << Files[i].wall * 1000 << " }";
+	}
+	file << endl << "  ]," << endl << "  \"counters\": {";
+	for (int i = 0; i < NUM_STAT_COUNTERS; i++)
+		file << (i ? "," : "") << endl << "    \"" << CounterNames[i] << "\": " << st_Counters[i];
+	file << endl << "  },";
+	AllocJson(file);
+	file << endl << "}" << endl;
+
+	file.close();
+	return !file.fail();
+}
+
+//==========================================================================
+//
+// ST_TraceBegin
+//
+// Opens a span on the calling thread's track. Spans must be closed in
+// the reverse order they were opened.
+//
+//==========================================================================
+void ST_TraceBegin(const string &name, const string &args)
+{
+	traceEvent_t span;
+
+	if (!st_Tracing)
+		return;
+
+	span.name = name;
+	span.args = args;
+	span.start = WallTime();
+	span.duration = 0;
+	span.track = Track;
+	OpenSpans.add(span);
+}
+
+//==========================================================================
+//
+// ST_TraceEnd
+//
+// Closes the last span opened, adding any arguments known only now.
+//
+//==========================================================================
+void ST_TraceEnd(const string &args)
+{
+	if (!st_Tracing || OpenSpans.empty())
+		return;
+
+	traceEvent_t span = OpenSpans.back();
+
+	OpenSpans.pop_back();
+	span.duration = WallTime() - span.start;
+	span.args = JoinArgs(span.args, args);
+
+	std::lock_guard<std::mutex> lock(TraceLock);
+	TraceEvents.add(move(span));
+}
+
+//==========================================================================
+//
+// ST_TraceArg
+//
+//==========================================================================
+string ST_TraceArg(const string &key, const string &value)
+{
+	return JsonString(key) + ": " + JsonString(value);
+}
+
+string ST_TraceArg(const string &key, int value)
+{
+	return JsonString(key) + ": " + to_string(value);
+}
+
+//==========================================================================
+//
+// ST_SetTrack
+//
+// Puts the calling thread's spans on their own named track.
+//
+//==========================================================================
+void ST_SetTrack(int track, const string &name)
+{
+	traceEvent_t meta;
+
+	Track = track;
+	if (!st_Tracing)
+		return;
+
+	meta.name = name;
+	meta.track = track;
+
+	std::lock_guard<std::mutex> lock(TraceLock);
+	TrackNames.add(meta);
+}
+
+//==========================================================================
+//
+// ST_WriteTrace
+//
+// Writes the spans in the Trace Event Format, which chrome://tracing
+// and Perfetto read. Times are in microseconds.
+//
+//==========================================================================
+bool ST_WriteTrace(const string &fileName)
+{
+	ofstream file(fileName, ios::out | ios::trunc);
+	bool first = true;
+
+	if (!file.is_open())
+		return false;
+
+	std::lock_guard<std::mutex> lock(TraceLock);
+
+	file << std::fixed << std::setprecision(1);
+	file << "{\"traceEvents\": [";
+	for (traceEvent_t &meta : TrackNames)
+	{
+		file << (first ? "" : ",") << endl << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+			<< meta.track << ", \"args\": {\"name\": " << JsonString(meta.name) << "}}";
+		first = false;
+	}
+	for (traceEvent_t &span : TraceEvents)
+	{
+		file << (first ? "" : ",") << endl << "{\"name\": " << JsonString(span.name)
+			<< ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << span.track
+			<< ", \"ts\": " << (span.start - TraceStart) * 1e6
+			<< ", \"dur\": " << span.duration * 1e6
+			<< ", \"args\": {" << span.args << "}}";
+		first = false;
+	}
+	file << endl << "]}" << endl;
+
+	file.close();
+	return !file.fail();
+}
+
+//==========================================================================
+//
+// traceSpan_t
+//
+//==========================================================================
+traceSpan_t::traceSpan_t(const string &name, const int *size, const string &args)
+	: size(size), startSize(size ? *size : 0)
+{
+	ST_TraceBegin(name, args);
+}
+
+traceSpan_t::~traceSpan_t()
+{
+	if (st_Tracing)
+		ST_TraceEnd(size ? ST_TraceArg("bytes", *size - startSize) : "");
+}
+
+//==========================================================================
+//
+// operator new / delete
+//
+// Every allocation is charged to the subsystem set by the innermost
+// allocScope_t on its thread. The cost is a header and a few relaxed
+// atomic adds, so this is always on; -a only controls the report.
+//
+//==========================================================================
+void *operator new(size_t size)
+{
+	allocHeader_t *header = (allocHeader_t *)malloc(sizeof(allocHeader_t) + size);
+	allocStats_t &stats = Allocs[CurrentAllocTag];
+	long long live, peak;
+
+	if (header == NULL)
+		throw std::bad_alloc();
+
+	header->size = size;
+	header->tag = CurrentAllocTag;
+
+	stats.count.fetch_add(1, std::memory_order_relaxed);
+	stats.bytes.fetch_add(size, std::memory_order_relaxed);
+	live = stats.live.fetch_add(size, std::memory_order_relaxed) + size;
+	peak = stats.peak.load(std::memory_order_relaxed);
+	while (live > peak && !stats.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		;
+	return header + 1;
+}
+
+void operator delete(void *p) noexcept
+{
+	allocHeader_t *header;
+
+	if (p == NULL)
+		return;
+	header = (allocHeader_t *)p - 1;
+	Allocs[header->tag].live.fetch_sub(header->size, std::memory_order_relaxed);
+	free(header);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+//==========================================================================
+//
+// allocScope_t
+//
+//==========================================================================
+allocScope_t::allocScope_t(AllocTag tag)
+	: previous(CurrentAllocTag)
+{
+	CurrentAllocTag = tag;
+}
+
+allocScope_t::~allocScope_t()
+{
+	CurrentAllocTag = previous;
+}
+
+//==========================================================================
+//
+// ST_AllocCount
+//
+// Allocations made so far, by every subsystem.
+//
+//==========================================================================
+long long ST_AllocCount()
+{
+	long long count = 0;
+
+	for (allocStats_t &stats : Allocs)
+		count += stats.count.load(std::memory_order_relaxed);
+	return count;
+}
+
+//==========================================================================
+//
+// ST_AllocReport
+//
+//==========================================================================
+void ST_AllocReport()
+{
+	cerr << "  subsystem     allocations       bytes     peak bytes" << endl;
+	for (int i = 0; i < NUM_ALLOC_TAGS; i++)
+	{
+		cerr << "  " << std::left << std::setw(10) << AllocTagNames[i] << std::right
+			<< std::setw(14) << Allocs[i].count.load()
+			<< std::setw(12) << Allocs[i].bytes.load()
+			<< std::setw(15) << Allocs[i].peak.load() << endl;
+	}
+	cerr << "  peak RSS: " << MS_PeakMemory() / 1024 << " kB" << endl;
+}
+
+//==========================================================================
+//
+// AllocJson
+//
+//==========================================================================
+static void AllocJson(ofstream &file)
+{
+	file << endl << "  \"allocations\": {";
+	for (int i = 0; i < NUM_ALLOC_TAGS; i++)
+	{
+		file << (i ? "," : "") << endl << "    \"" << AllocTagNames[i]
+			<< "\": { \"count\": " << Allocs[i].count.load()
+			<< ", \"bytes\": " << Allocs[i].bytes.load()
+			<< ", \"peak_bytes\": " << Allocs[i].peak.load() << " }";
+	}
+	file << endl << "  }," << endl << "  \"peak_rss_kb\": " << MS_PeakMemory() / 1024;
+}
+
+//==========================================================================
+//
+// JoinArgs
+//
+//==========================================================================
+static string JoinArgs(const string &a, const string &b)
+{
+	if (a.empty())
+		return b;
+	if (b.empty())
+		return a;
+	return a + ", " + b;
+}
+
+//==========================================================================
+//
+// JsonString
+//
+//==========================================================================
+static string JsonString(const string &text)
+{
+	string quoted = "\"";
+
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+//==========================================================================
+//
+// WallTime
+//
+//==========================================================================
+static double WallTime()
+{
+	using namespace std::chrono;
+
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+//==========================================================================
+//
+// CpuTime
+//
+//==========================================================================
+static double CpuTime()
+{
+	return (double)std::clock() / CLOCKS_PER_SEC;
+}
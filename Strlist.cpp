@@ -11,6 +11,7 @@
 #include "error.h"
 #include "misc.h"
 #include "pcode.h"
+#include "stats.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -113,6 +114,7 @@ static StringTable str_StringStorage = StringTable(NUM_STRLISTS);
 //==========================================================================
 void STR_Init()
 {
+	allocScope_t allocScope(ALLOC_STRINGS);
 	//TODO: verify that using an empty string is ok
 	str_LanguageList.add(LanguageInfo(""));	// Default language is always number 0
 }
@@ -192,9 +194,12 @@ int STR_FindInList(StringListType list, string name)
 //==========================================================================
 static int STR_FindInSomeList(StringList &list, string name)
 {
+	allocScope_t allocScope(ALLOC_STRINGS);
 	int i = 0;
+	st_Counters[STAT_STRING_LOOKUPS]++;
 	for(StringInfo &info : list)
 	{
+		st_Counters[STAT_STRING_PROBES]++;
 		if(info.name.compare(name) == 0)
 			return i;
 		i++;
@@ -225,9 +230,14 @@ int STR_FindInListInsensitive(StringListType list, string name)
 //==========================================================================
 static int STR_FindInSomeListInsensitive(StringList &list, string name)
 {
+	allocScope_t allocScope(ALLOC_STRINGS);
+	st_Counters[STAT_STRING_LOOKUPS]++;
 	for (auto &s : list)
+	{
+		st_Counters[STAT_STRING_PROBES]++;
 		if (s.name.compare(name) == 0)
 			return s.index;
+	}
 	
 	return STR_PutStringInSomeList(list, name);
 }
@@ -272,6 +282,7 @@ int STR_AppendToList(int list, string name)
 //==========================================================================
 static int STR_PutStringInSomeList(StringList &list, string name)
 {
+	allocScope_t allocScope(ALLOC_STRINGS);
 	if(list.size() >= MAX_STRINGS)
 	{
 		ERR_Error(ERR_TOO_MANY_STRINGS, true, MAX_STRINGS);
@@ -345,6 +356,7 @@ void STR_WriteChunk(int language, bool encrypt)
 	int lenadr;
 
 	Message(MSG_DEBUG, "---- STR_WriteChunk " + string(language) + " ----");
+	traceSpan_t span(encrypt ? "STRE" : "STRL", &pCode_Size, ST_TraceArg("language", language));
 	pCode_Append(encrypt ? "STRE" : "STRL");
 	lenadr = pCode_Current;
 	PC_SkipInt();
@@ -368,6 +380,8 @@ void STR_WriteListChunk(int list, int id, bool quad)
 	{
 		MS_Message(MSG_DEBUG, "---- STR_WriteListChunk %d %c%c%c%c----\n", list,
 			id&255, (id>>8)&255, (id>>16)&255, (id>>24)&255);
+		char name[5] = { (char)(id&255), (char)((id>>8)&255), (char)((id>>16)&255), (char)((id>>24)&255), 0 };
+		traceSpan_t span(name, &pCode_Size, ST_TraceArg("list", list));
 		pCode_Append(id);
 		lenadr = pCode_Current;
 		pCode_Skip(4);
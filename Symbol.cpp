@@ -10,6 +10,7 @@
 #include "symbol.h"
 #include "misc.h"
 #include "parse.h"
+#include "stats.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -221,6 +222,8 @@ static string NodeTypeString(NodeType type)
 //==========================================================================
 void sym_Init()
 {
+	allocScope_t allocScope(ALLOC_SYMBOLS);
+
 	//Add std types
 	ACS_TypeDef::Init("void");
 	ACS_TypeDef::Init("int");
@@ -290,8 +293,11 @@ ACS_Node *sym_FindGlobal(string name)
 
 static ACS_Node *Find(string name, DepthVal depth)
 {
+	allocScope_t allocScope(ALLOC_SYMBOLS);
+	st_Counters[STAT_SYMBOL_LOOKUPS]++;
 	for (ACS_Node &node : sym_Nodes)
 	{
+		st_Counters[STAT_SYMBOL_PROBES]++;
 		if (node.name().compare(name) == 0)
 		{
 			if (sym_Depths[node.depth].current == depth)
@@ -366,12 +372,14 @@ ACS_Node *SY_InsertGlobalUnique(string name, NodeType type)
 //==========================================================================
 static ACS_Node *Insert(string name, NodeType type, DepthVal depth = pa_CurrentDepth)
 {
+	allocScope_t allocScope(ALLOC_SYMBOLS);
 	ACS_Node node = ACS_Node(type, name);
 
 	node.isImported = (ImportMode == IMPORT_Importing);
 	node.depth = depth;
 
 	sym_Nodes.add(move(node));
+	ST_Peak(STAT_PEAK_SYMBOLS, sym_Nodes.size());
 	return(&sym_Nodes.lastAdded());
 }
 
@@ -28,6 +28,7 @@
 #include "error.h"
 #include "misc.h"
 #include "symbol.h"
+#include "stats.h"
 #include "parse.h"
 
 // MACROS ------------------------------------------------------------------
@@ -47,6 +48,14 @@ enum CharType : char
 	CHR_SPECIAL
 };
 
+// A matched { } pair, as byte offsets into the source buffer
+struct braceSpan_t
+{
+	int open;
+	int close;		// -1 if the brace is never closed
+	int lines;		// Newlines between the two braces
+};
+
 struct nestInfo_t
 {
 	vector<char> data;
@@ -58,6 +67,8 @@ struct nestInfo_t
 	bool imported;
 	enum ImportModes prevMode;
 	char lastChar;
+	vector<braceSpan_t> braces;
+	bool bracesIndexed;
 };
 
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
@@ -85,6 +96,8 @@ static void SkipComment();
 static void BumpMasterSourceLine(char Chr, bool clear); // master line - Ty 07jan2000
 static int AddFileName(const string name);
 static int OctalChar();
+static void IndexBraces();
+static const braceSpan_t *FindBraceSpan(int offset);
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
@@ -119,6 +132,10 @@ static int NestDepth;								// The file depth in includes, for nesting. ?
 static bool IncLineNumber;
 static VecStr FileNames;
 static size_t FileNamesLen;
+static int TokenStart;								// Offset of the first character of tk_Token
+static vector<braceSpan_t> BraceIndex;
+static bool BracesIndexed;
+static VecStr Dependencies;							// Every file read, for TK_WriteDepFile
 
 // Pascal 12/11/08
 // Include paths. Lowest is searched first.
@@ -284,11 +301,18 @@ static int SortKeywords(const void *a, const void *b)
 //==========================================================================
 void TK_OpenSource(string fileName)
 {
+	allocScope_t allocScope(ALLOC_LEXER);
+
 	TK_CloseSource();
 	MS_LoadFile(fileName, File);
+	Dependencies.clear();
+	TK_AddDependency(fileName);
+	ST_EnterFile(fileName);
+	BracesIndexed = false;
 	tk_SourceName = AddFileName(fileName);
 	SetLocalIncludePath(fileName);
 	SourceOpen = true;
+	Pos = 0;
 	tk_Line = 1;
 	tk_Token = TK_NONE;
 	AlreadyGot = false;
@@ -406,9 +430,9 @@ static void SetLocalIncludePath(string sourceName)
 //==========================================================================
 void TK_Include(string fileName)
 {
+	allocScope_t allocScope(ALLOC_LEXER);
 	string sourceName;
 	nestInfo_t *info;
-	bool foundfile = false;
 
 	Message(MSG_DEBUG, "*Including " + fileName);
 	if (NestDepth == MAX_NESTED_SOURCES) {
@@ -422,6 +446,47 @@ void TK_Include(string fileName)
 	info->incLineNumber = IncLineNumber;
 	info->lastChar = Chr;
 	info->imported = false;
+	info->braces = move(BraceIndex);
+	info->bracesIndexed = BracesIndexed;
+
+	if (!TK_FindInclude(fileName, sourceName)) {
+		ERR_ErrorAt(tk_SourceName, tk_Line);
+		ERR_Exit(ERR_CANT_FIND_INCLUDE, true, fileName, tk_SourceName, tk_Line);
+	}
+
+	Message(MSG_DEBUG, "*Include file found at " + sourceName);
+	TK_AddDependency(sourceName);
+	ST_EnterFile(sourceName);
+	ST_TraceBegin("include", ST_TraceArg("file", sourceName));
+
+	// Now change the first include path to the file directory
+	SetLocalIncludePath(sourceName);
+
+	tk_SourceName = AddFileName(sourceName);
+
+	MS_LoadFile(tk_SourceName, File.data());
+	BraceIndex.clear();
+	BracesIndexed = false;
+	Pos = 0;
+	tk_Line = 1;
+	IncLineNumber = false;
+	tk_Token = TK_NONE;
+	AlreadyGot = false;
+	BumpMasterSourceLine('x', true); // dummy x
+	NextChr();
+}
+
+//==========================================================================
+//
+// TK_FindInclude
+//
+// Resolves an #include or #import file name the same way TK_Include
+// does, without opening it.
+//
+//==========================================================================
+bool TK_FindInclude(string fileName, string &sourceName)
+{
+	bool foundfile = false;
 
 	// Pascal 30/11/08
 	// Handle absolute paths
@@ -440,7 +505,7 @@ void TK_Include(string fileName)
 		}
 		sourceName += fileName;
 #else
-		strcpy(sourceName, fileName);
+		sourceName = fileName;
 #endif
 		foundfile = MS_FileExists(sourceName);
 	} else {
@@ -451,32 +516,14 @@ void TK_Include(string fileName)
 			src += fileName;
 			if (MS_FileExists(src))
 			{
+				sourceName = src;
 				foundfile = true;
 				break;
 			}
 		}
 	}
 
-	if (!foundfile) {
-		ERR_ErrorAt(tk_SourceName, tk_Line);
-		ERR_Exit(ERR_CANT_FIND_INCLUDE, true, fileName, tk_SourceName, tk_Line);
-	}
-
-	Message(MSG_DEBUG, "*Include file found at " + sourceName);
-
-	// Now change the first include path to the file directory
-	SetLocalIncludePath(sourceName);
-
-	tk_SourceName = AddFileName(sourceName);
-
-	MS_LoadFile(tk_SourceName, File.data());
-	Pos = 0;
-	tk_Line = 1;
-	IncLineNumber = false;
-	tk_Token = TK_NONE;
-	AlreadyGot = false;
-	BumpMasterSourceLine('x', true); // dummy x
-	NextChr();
+	return foundfile;
 }
 
 //==========================================================================
@@ -485,6 +532,7 @@ void TK_Include(string fileName)
 //
 //==========================================================================
 void TK_Import(string fileName, ImportModes prevMode) {
+	ST_TraceBegin("import", ST_TraceArg("file", fileName));
 	TK_Include(fileName);
 	OpenFiles[NestDepth - 1].imported = true;
 	OpenFiles[NestDepth - 1].prevMode = prevMode;
@@ -499,6 +547,8 @@ void TK_Import(string fileName, ImportModes prevMode) {
 static int PopNestedSource(ImportModes *prevMode)
 {
 	Message(MSG_DEBUG, "*Leaving " + tk_SourceName);
+	ST_LeaveFile();
+	ST_TraceEnd();
 	sym_(NestDepth);
 
 	nestInfo_t *info = &OpenFiles[--NestDepth];
@@ -511,6 +561,8 @@ static int PopNestedSource(ImportModes *prevMode)
 	tk_Line = info->line;
 	IncLineNumber = info->incLineNumber;
 	Chr = info->lastChar;
+	BraceIndex = move(info->braces);
+	BracesIndexed = info->bracesIndexed;
 	tk_Token = TK_NONE;
 	AlreadyGot = false;
 
@@ -519,6 +571,10 @@ static int PopNestedSource(ImportModes *prevMode)
 	SetLocalIncludePath(tk_SourceName);
 
 	*prevMode = info->prevMode;
+	if (info->imported)
+	{
+		ST_TraceEnd();
+	}
 	return info->imported ? 2 : 0;
 }
 
@@ -536,6 +592,66 @@ void TK_CloseSource()
 	}
 }
 
+//==========================================================================
+//
+// TK_AddDependency
+//
+// Records a file the object depends on. Included and imported sources
+// are added by TK_Include; imports read from an object or interface
+// file add those themselves.
+//
+//==========================================================================
+void TK_AddDependency(const string &fileName)
+{
+	for (string &name : Dependencies)
+	{
+		if (name == fileName)
+			return;
+	}
+	Dependencies.add(fileName);
+}
+
+//==========================================================================
+//
+// TK_WriteDepFile
+//
+// Writes a make rule for the target that lists every file recorded
+// by TK_AddDependency. Each file besides the main source also gets an
+// empty rule, so make doesn't fail when a header is removed.
+//
+//==========================================================================
+bool TK_WriteDepFile(const string &fileName, const string &target)
+{
+	ofstream file(fileName, ios::out | ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	file << MS_EscapeMakePath(target) << ":";
+	for (string &name : Dependencies)
+		file << " \\" << endl << "  " << MS_EscapeMakePath(name);
+	file << endl;
+
+	for (int i = 1; i < Dependencies.size(); i++)
+		file << endl << MS_EscapeMakePath(Dependencies[i]) << ":" << endl;
+
+	file.close();
+	return !file.fail();
+}
+
+//==========================================================================
+//
+// TK_GetDependencies
+//
+// Every file recorded by TK_AddDependency, the main source first.
+//
+//==========================================================================
+
+const VecStr &TK_GetDependencies()
+{
+	return Dependencies;
+}
+
 //==========================================================================
 //
 // TK_GetDepth
@@ -567,11 +683,14 @@ tokenType_t TK_NextToken()
 		return tk_Token;
 	}
 	PrevMasterSourcePos = MasterSourcePos;
+	allocScope_t allocScope(ALLOC_LEXER);
+	ST_StartPhase(PHASE_LEX);
 	do {
 		while (Chr == ASCII_SPACE)
 		{
 			NextChr();
 		}
+		TokenStart = Pos - 1;
 		switch (ASCIIToChrCode[Chr])
 		{
 			case CHR_EOF:
@@ -606,6 +725,8 @@ tokenType_t TK_NextToken()
 		} else
 			validToken = true;
 	} while (validToken == false);
+	st_Counters[STAT_TOKENS]++;
+	ST_EndPhase(PHASE_LEX);
 	return tk_Token;
 }
 
@@ -643,6 +764,149 @@ void TK_SkipPast(int token) {
 	TK_NextToken();
 }
 
+//==========================================================================
+//
+// TK_SkipToMatchingBrace
+//
+// Called with a freshly read { as the current token. Jumps straight to
+// the matching } using the brace index instead of lexing everything in
+// between, and leaves the } as the current token. Returns false if the
+// block can't be skipped this way, and nothing is consumed.
+//
+//==========================================================================
+
+bool TK_SkipToMatchingBrace()
+{
+	if (tk_Token != TK_LBRACE || AlreadyGot)
+		return false;
+
+	if (!BracesIndexed)
+		IndexBraces();
+
+	const braceSpan_t *span = FindBraceSpan(TokenStart);
+
+	if (span == NULL || span->close < 0)
+		return false;
+
+	// The current line is the one holding the {, since a pending
+	// newline isn't counted until the character after it is read.
+	tk_Line += span->lines;
+	IncLineNumber = false;
+	BumpMasterSourceLine('x', true); // dummy x
+	Pos = span->close + 1;
+	TokenStart = span->close;
+	tk_Token = TK_RBRACE;
+	NextChr();
+	return true;
+}
+
+//==========================================================================
+//
+// IndexBraces
+//
+// One pass over the current file, pairing up every { with its }.
+// Comments, strings and character constants are stepped over so their
+// contents don't disturb the nesting.
+//
+//==========================================================================
+
+static void IndexBraces()
+{
+	VecInt open;
+	int size = File.size();
+	int lines = 0;
+
+	BraceIndex.clear();
+	BracesIndexed = true;
+
+	for (int i = 0; i < size; i++)
+	{
+		switch (File[i])
+		{
+		case '\n':
+			lines++;
+			break;
+
+		case '/':
+			if (i + 1 < size && File[i + 1] == '/')
+			{
+				while (i + 1 < size && File[i + 1] != '\n')
+					i++;
+			}
+			else if (i + 1 < size && File[i + 1] == '*')
+			{
+				for (i += 2; i < size; i++)
+				{
+					if (File[i] == '\n')
+						lines++;
+					else if (File[i] == '*' && i + 1 < size && File[i + 1] == '/')
+					{
+						i++;
+						break;
+					}
+				}
+			}
+			break;
+
+		case '"':
+		case '\'':
+		{
+			char quote = File[i];
+
+			for (i++; i < size && File[i] != quote; i++)
+			{
+				if (File[i] == '\\')
+					i++;
+				else if (File[i] == '\n')
+				{
+					// Unterminated; let the lexer complain about it
+					lines++;
+					if (quote == '\'')
+						break;
+				}
+			}
+			break;
+		}
+
+		case '{':
+			open.add(BraceIndex.size());
+			BraceIndex.add({ i, -1, lines });
+			break;
+
+		case '}':
+			if (!open.empty())
+			{
+				braceSpan_t &span = BraceIndex.at(open.back());
+
+				open.pop_back();
+				span.close = i;
+				span.lines = lines - span.lines;
+			}
+			break;
+		}
+	}
+}
+
+//==========================================================================
+//
+// FindBraceSpan
+//
+// The index is built in source order, so a binary search on the offset
+// of the { finds it.
+//
+//==========================================================================
+
+static const braceSpan_t *FindBraceSpan(int offset)
+{
+	auto span = std::lower_bound(BraceIndex.begin(), BraceIndex.end(), offset,
+		[](const braceSpan_t &a, int b) { return a.open < b; });
+
+	if (span == BraceIndex.end() || span->open != offset)
+		return NULL;
+
+	return &*span;
+}
+
 //==========================================================================
 //
 // TK_SkipTo
@@ -1266,7 +1530,7 @@ static void ProcessSpecialToken()
 //==========================================================================
 
 static void NextChr() {
-	if (Pos + 1 >= File.size()) {
+	if (Pos >= File.size()) {
 		Chr = EOF_CHARACTER;
 		return;
 	}
@@ -1275,7 +1539,7 @@ static void NextChr() {
 		IncLineNumber = false;
 		BumpMasterSourceLine('x', true); // dummy x
 	}
-	Chr = File[Pos + 1];
+	Chr = File[Pos++];
 	if (Chr < ASCII_SPACE && Chr >= 0) // Allow high ASCII characters
 	{
 		if (Chr == '\n') {
@@ -1294,10 +1558,10 @@ static void NextChr() {
 
 static char PeekChr()
 {
-	if (Pos + 1 >= File.size)
+	if (Pos >= File.size())
 		return EOF_CHARACTER;
 
-	char ch = File[Pos + 1];
+	char ch = File[Pos];
 
 	if (ch < ASCII_SPACE && ch >= 0) // Allow high ASCII characters
 		ch = ASCII_SPACE;
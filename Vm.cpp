@@ -0,0 +1,1538 @@
+//**************************************************************************
+//**
+//** vm.cpp
+//**
+//** A reference interpreter for compiled objects, used by -run. It runs
+//** scripts the way ZDoom does, but anything that would touch the game
+//** goes to a table of builtins. By default these only record the call,
+//** so two builds of the same source can be checked for doing the same
+//** things, and compared by the instructions they took.
+//**
+//**************************************************************************
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
+#include <cmath>
+#include <iomanip>
+#include "common.h"
+#include "vm.h"
+#include "pcode.h"
+#include "object.h"
+
+// MACROS ------------------------------------------------------------------
+
+#ifdef __GNUC__
+#define VM_COMPUTED_GOTO	// Dispatch through a table of label addresses
+#endif
+
+#define STACK_GUARD		16		// Slots below the stack, so a bad pop stays inside it
+#define STACK_SLACK		256		// Slots above it, for PCD_PUSHBYTES
+#define CODE_PADDING	1024	// Zeroes after the object, so operands can be read unchecked
+#define MAX_NESTING		16		// ACS_ExecuteWithResult calls inside each other
+#define PI				3.14159265358979323846
+
+// Used by VM_Run
+#define STACK(n)		(stack[sp - (n)])
+#define PUSH(value)		(stack[sp++] = (value))
+#define NEXTBYTE		(code[pc++])
+#define NEXTINT			(pc += 4, ReadInt(code + pc - 4))
+#define NEXTARG			(compact ? NEXTBYTE : NEXTINT)
+#define NEXTWORD		(compact ? (pc += 2, code[pc - 2] | (code[pc - 1] << 8)) : NEXTINT)
+
+#define SCRIPTVAR		((unsigned)(temp = NEXTARG) < (unsigned)localCount ? locals + temp : NULL)
+#define MAPVAR			((unsigned)(temp = NEXTARG) < MAX_MAP_VARIABLES ? vm.mapVars + temp : NULL)
+#define WORLDVAR		((unsigned)(temp = NEXTARG) < MAX_WORLD_VARIABLES ? vm.worldVars + temp : NULL)
+#define GLOBALVAR		((unsigned)(temp = NEXTARG) < MAX_GLOBAL_VARIABLES ? vm.globalVars + temp : NULL)
+#define MAPARRAY(i)		MapElement(vm, NEXTARG, i)
+#define WORLDARRAY(i)	SparseElement(vm.worldArrays, MAX_WORLD_VARIABLES, NEXTARG, i)
+#define GLOBALARRAY(i)	SparseElement(vm.globalArrays, MAX_GLOBAL_VARIABLES, NEXTARG, i)
+
+#ifdef VM_COMPUTED_GOTO
+#define OP(name)		Op_##name:
+#define NEXT			{ DISPATCH(); goto *Labels[cmd]; }
+#else
+#define OP(name)		case PCD_##name:
+#define NEXT			goto dispatch
+#endif
+
+// Checks the thread can go on, then fetches the next pcode
+#define DISPATCH() \
+	if ((unsigned)pc >= (unsigned)codeSize) goto badAddress; \
+	hits[pc]++; \
+	if ((unsigned)sp > VM_STACK_SIZE) goto badStack; \
+	if (++executed > VM_RUNAWAY_LIMIT) goto runaway; \
+	cmd = compact ? NEXTBYTE : NEXTINT; \
+	if (compact && cmd >= 256 - 16) \
+		cmd = (256 - 16) + ((cmd - (256 - 16)) << 8) + NEXTBYTE; \
+	if ((unsigned)cmd >= PCODE_COMMAND_COUNT) goto badCommand; \
+	commands[cmd]++
+
+// Each kind of variable has the same fourteen operators
+#define VAR_OP(name, kind, action) \
+	OP(name) if ((var = kind) == NULL) goto badVariable; action; NEXT;
+#define VAR_OPS(kind) \
+	VAR_OP(ASSIGN##kind, kind, *var = STACK(1); sp--) \
+	VAR_OP(PUSH##kind, kind, PUSH(*var)) \
+	VAR_OP(ADD##kind, kind, *var = Add(*var, STACK(1)); sp--) \
+	VAR_OP(SUB##kind, kind, *var = Sub(*var, STACK(1)); sp--) \
+	VAR_OP(MUL##kind, kind, *var = Mul(*var, STACK(1)); sp--) \
+	VAR_OP(DIV##kind, kind, if (STACK(1) == 0) goto divideByZero; *var = Div(*var, STACK(1)); sp--) \
+	VAR_OP(MOD##kind, kind, if (STACK(1) == 0) goto divideByZero; *var = Mod(*var, STACK(1)); sp--) \
+	VAR_OP(INC##kind, kind, *var = Add(*var, 1)) \
+	VAR_OP(DEC##kind, kind, *var = Sub(*var, 1)) \
+	VAR_OP(AND##kind, kind, *var &= STACK(1); sp--) \
+	VAR_OP(EOR##kind, kind, *var ^= STACK(1); sp--) \
+	VAR_OP(OR##kind, kind, *var |= STACK(1); sp--) \
+	VAR_OP(LS##kind, kind, *var = ShiftLeft(*var, STACK(1)); sp--) \
+	VAR_OP(RS##kind, kind, *var = ShiftRight(*var, STACK(1)); sp--)
+
+// Array elements are never missing: out of range reads give 0, and
+// writes are dropped, as in ZDoom
+#define ARRAY_OP(name, kind, action) \
+	OP(name) action; NEXT;
+#define ARRAY_OPS(kind) \
+	ARRAY_OP(PUSH##kind, kind, STACK(1) = *kind(STACK(1))) \
+	ARRAY_OP(ASSIGN##kind, kind, *kind(STACK(2)) = STACK(1); sp -= 2) \
+	ARRAY_OP(ADD##kind, kind, var = kind(STACK(2)); *var = Add(*var, STACK(1)); sp -= 2) \
+	ARRAY_OP(SUB##kind, kind, var = kind(STACK(2)); *var = Sub(*var, STACK(1)); sp -= 2) \
+	ARRAY_OP(MUL##kind, kind, var = kind(STACK(2)); *var = Mul(*var, STACK(1)); sp -= 2) \
+	ARRAY_OP(DIV##kind, kind, if (STACK(1) == 0) goto divideByZero; var = kind(STACK(2)); *var = Div(*var, STACK(1)); sp -= 2) \
+	ARRAY_OP(MOD##kind, kind, if (STACK(1) == 0) goto divideByZero; var = kind(STACK(2)); *var = Mod(*var, STACK(1)); sp -= 2) \
+	ARRAY_OP(INC##kind, kind, var = kind(STACK(1)); *var = Add(*var, 1); sp--) \
+	ARRAY_OP(DEC##kind, kind, var = kind(STACK(1)); *var = Sub(*var, 1); sp--) \
+	ARRAY_OP(AND##kind, kind, var = kind(STACK(2)); *var &= STACK(1); sp -= 2) \
+	ARRAY_OP(EOR##kind, kind, var = kind(STACK(2)); *var ^= STACK(1); sp -= 2) \
+	ARRAY_OP(OR##kind, kind, var = kind(STACK(2)); *var |= STACK(1); sp -= 2) \
+	ARRAY_OP(LS##kind, kind, var = kind(STACK(2)); *var = ShiftLeft(*var, STACK(1)); sp -= 2) \
+	ARRAY_OP(RS##kind, kind, var = kind(STACK(2)); *var = ShiftRight(*var, STACK(1)); sp -= 2)
+
+#define FAMILY_NAMES(X, kind) \
+	X(ASSIGN##kind) X(PUSH##kind) X(ADD##kind) X(SUB##kind) X(MUL##kind) \
+	X(DIV##kind) X(MOD##kind) X(INC##kind) X(DEC##kind) X(AND##kind) \
+	X(EOR##kind) X(OR##kind) X(LS##kind) X(RS##kind)
+
+// Pcodes VM_Run handles itself. The rest go to the builtins.
+#define NATIVE_COMMANDS(X) \
+	X(NOP) X(TERMINATE) X(SUSPEND) X(RESTART) \
+	X(PUSHNUMBER) X(PUSHBYTE) X(PUSHBYTES) X(PUSH2BYTES) X(PUSH3BYTES) X(PUSH4BYTES) X(PUSH5BYTES) \
+	X(ADD) X(SUBTRACT) X(MULTIPLY) X(DIVIDE) X(MODULUS) \
+	X(EQ) X(NE) X(LT) X(GT) X(LE) X(GE) \
+	X(ANDLOGICAL) X(ORLOGICAL) X(ANDBITWISE) X(ORBITWISE) X(EORBITWISE) \
+	X(NEGATELOGICAL) X(NEGATEBINARY) X(LSHIFT) X(RSHIFT) X(UNARYMINUS) \
+	X(FIXEDMUL) X(FIXEDDIV) X(SIN) X(COS) X(VECTORANGLE) \
+	X(DROP) X(DUP) X(SWAP) \
+	X(GOTO) X(IFGOTO) X(IFNOTGOTO) X(CASEGOTO) X(CASEGOTOSORTED) \
+	X(DELAY) X(DELAYDIRECT) X(DELAYDIRECTB) X(TAGWAIT) X(TAGWAITDIRECT) \
+	X(POLYWAIT) X(POLYWAITDIRECT) X(SCRIPTWAIT) X(SCRIPTWAITDIRECT) X(SCRIPTWAITNAMED) \
+	X(RANDOM) X(RANDOMDIRECT) X(RANDOMDIRECTB) \
+	X(CALL) X(CALLDISCARD) X(CALLSTACK) X(PUSHFUNCTION) X(RETURNVOID) X(RETURNVAL) \
+	X(BEGINPRINT) X(PRINTSTRING) X(PRINTLOCALIZED) X(PRINTNUMBER) X(PRINTCHARACTER) \
+	X(PRINTFIXED) X(PRINTHEX) X(PRINTBINARY) \
+	X(PRINTMAPCHARARRAY) X(PRINTWORLDCHARARRAY) X(PRINTGLOBALCHARARRAY) \
+	X(ENDPRINT) X(ENDPRINTBOLD) X(ENDLOG) X(MOREHUDMESSAGE) X(OPTHUDMESSAGE) \
+	X(ENDHUDMESSAGE) X(ENDHUDMESSAGEBOLD) X(SAVESTRING) X(STRLEN) X(TAGSTRING) X(SETRESULTVALUE) \
+	FAMILY_NAMES(X, SCRIPTVAR) FAMILY_NAMES(X, MAPVAR) FAMILY_NAMES(X, WORLDVAR) FAMILY_NAMES(X, GLOBALVAR) \
+	FAMILY_NAMES(X, MAPARRAY) FAMILY_NAMES(X, WORLDARRAY) FAMILY_NAMES(X, GLOBALARRAY)
+
+// TYPES -------------------------------------------------------------------
+
+// PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
+
+static void LoadScripts(vmState_t &vm);
+static void LoadFunctions(vmState_t &vm);
+static void LoadVariables(vmState_t &vm);
+static int LineSpecial(vmState_t &vm, int thread, const int *args, int argCount);
+static bool ThreadReady(const vmState_t &vm, const vmThread_t &thread, int &readyTic);
+static void ThreadEnded(vmState_t &vm, vmThread_t &thread);
+static void ReleaseThread(vmThread_t &thread);
+static long long ThreadBytes(const vmThread_t &thread);
+static long long TicPercentile(const vmState_t &vm, int percent);
+static double Change(long long before, long long after);
+static int ReadInt(const byte *data);
+static int Add(int a, int b);
+static int Sub(int a, int b);
+static int Mul(int a, int b);
+static int Div(int a, int b);
+static int FixedDiv(int a, int b);
+static int Mod(int a, int b);
+static int ShiftLeft(int a, int b);
+static int ShiftRight(int a, int b);
+static int Random(vmState_t &vm, int min, int max);
+static int *MapElement(vmState_t &vm, int var, int index);
+static int *SparseElement(std::map<int, int> *arrays, int count, int var, int index);
+static const string &String(const vmState_t &vm, int index);
+static string Quote(const string &text);
+static string ArgList(const int *args, int argCount);
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static int Scratch;		// Where out of range array elements go
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// VM_Load
+//
+// Reads the scripts, functions, strings and initial variables from an
+// object. Libraries it imports aren't loaded, so their functions and
+// variables can't be used.
+//
+//==========================================================================
+bool VM_Load(vmState_t &vm, const acsObject_t &object)
+{
+	if (object.format == OBJ_FORMAT_NONE)
+		return false;
+
+	vm.object = &object;
+	vm.codeSize = object.data.size();
+	vm.code.assign(object.data.begin(), object.data.end());
+	vm.code.resize(vm.codeSize + CODE_PADDING);
+	vm.compact = object.format == OBJ_FORMAT_ACSe;
+	vm.strings = OBJ_ReadStrings(object);
+	vm.threads.clear();
+	vm.events.clear();
+	vm.random = 1;
+	vm.nesting = 0;
+	vm.executed = 0;
+	vm.commands.assign(PCODE_COMMAND_COUNT, 0);
+	vm.hits.assign(vm.codeSize, 0);
+	vm.tic = 0;
+	vm.maxTics = VM_DEFAULT_TICS;
+	vm.players = 1;
+	vm.ticExecuted.clear();
+	vm.peakThreads = 0;
+	vm.peakThreadBytes = 0;
+	vm.peakTic = 0;
+	for (int i = 0; i < PCODE_COMMAND_COUNT; i++)
+		vm.builtins[i] = VM_DefaultBuiltin;
+
+	LoadScripts(vm);
+	LoadFunctions(vm);
+	LoadVariables(vm);
+	return true;
+}
+
+//==========================================================================
+//
+// LoadScripts
+//
+// From the Hexen directory, or from SPTR and SVCT.
+//
+//==========================================================================
+static void LoadScripts(vmState_t &vm)
+{
+	const acsObject_t &object = *vm.object;
+	vmScript_t script;
+
+	vm.scripts.clear();
+	script.varCount = MAX_SCRIPT_VARIABLES;
+	script.executed = 0;
+	script.runs = 0;
+	script.live = 0;
+	script.finishedTic = 0;
+	script.wakes = 0;
+	script.latency = 0;
+	script.maxLatency = 0;
+	script.maxSlice = 0;
+
+	if (object.format == OBJ_FORMAT_ACS0)
+	{
+		int count = OBJ_ReadInt(object, object.dirOffset);
+
+		for (int i = 0; i < count && object.dirOffset + 16 + i * 12 <= vm.codeSize; i++)
+		{
+			int entry = object.dirOffset + 4 + i * 12;
+
+			script.number = OBJ_ReadInt(object, entry) % 1000;
+			script.type = OBJ_ReadInt(object, entry) / 1000;
+			script.address = OBJ_ReadInt(object, entry + 4);
+			script.argCount = OBJ_ReadInt(object, entry + 8);
+			script.name = "script " + string(script.number);
+			vm.scripts.add(script);
+		}
+		return;
+	}
+
+	VecStr names = OBJ_ReadStringList(object, OBJ_FindChunk(object, MAKE4CC('S', 'N', 'A', 'M')));
+	const objChunk_t *chunk = OBJ_FindChunk(object, MAKE4CC('S', 'P', 'T', 'R'));
+
+	for (int i = 0; chunk != NULL && i < chunk->size / 8; i++)
+	{
+		int entry = chunk->offset + i * 8;
+
+		script.number = OBJ_ReadWord(object, entry);
+		script.type = OBJ_ReadByte(object, entry + 2);
+		script.argCount = OBJ_ReadByte(object, entry + 3);
+		script.address = OBJ_ReadInt(object, entry + 4);
+		script.name = "script " + string(script.number);
+		if (script.number < 0 && -1 - script.number < names.size())
+			script.name = "script \"" + names[-1 - script.number] + "\"";
+		vm.scripts.add(script);
+	}
+
+	chunk = OBJ_FindChunk(object, MAKE4CC('S', 'V', 'C', 'T'));
+	for (int i = 0; chunk != NULL && i < chunk->size / 4; i++)
+	{
+		int found = VM_FindScript(vm, OBJ_ReadWord(object, chunk->offset + i * 4));
+
+		if (found >= 0)
+			vm.scripts[found].varCount = OBJ_ReadWord(object, chunk->offset + i * 4 + 2) & 0xffff;
+	}
+}
+
+//==========================================================================
+//
+// LoadFunctions
+//
+//==========================================================================
+static void LoadFunctions(vmState_t &vm)
+{
+	const acsObject_t &object = *vm.object;
+	const objChunk_t *chunk = OBJ_FindChunk(object, MAKE4CC('F', 'U', 'N', 'C'));
+	VecStr names = OBJ_ReadStringList(object, OBJ_FindChunk(object, MAKE4CC('F', 'N', 'A', 'M')));
+
+	vm.functions.clear();
+	for (int i = 0; chunk != NULL && i < chunk->size / 8; i++)
+	{
+		int entry = chunk->offset + i * 8;
+		vmFunction_t function;
+
+		function.name = i < names.size() && !names[i].empty() ? names[i] : "function " + string(i);
+		function.argCount = OBJ_ReadByte(object, entry);
+		function.localCount = OBJ_ReadByte(object, entry + 1);
+		function.hasReturn = OBJ_ReadByte(object, entry + 2) != 0;
+		function.address = OBJ_ReadInt(object, entry + 4);
+		vm.functions.add(function);
+	}
+}
+
+//==========================================================================
+//
+// LoadVariables
+//
+// Map variables start from MINI. An array is numbered by its place in
+// ARAY, and the map variable it's declared as holds that number, which
+// is how ZDoom finds it.
+//
+//==========================================================================
+static void LoadVariables(vmState_t &vm)
+{
+	const acsObject_t &object = *vm.object;
+	const objChunk_t *chunk = NULL;
+
+	memset(vm.mapVars, 0, sizeof(vm.mapVars));
+	memset(vm.worldVars, 0, sizeof(vm.worldVars));
+	memset(vm.globalVars, 0, sizeof(vm.globalVars));
+	vm.mapArrays.clear();
+	for (int i = 0; i < MAX_WORLD_VARIABLES; i++)
+		vm.worldArrays[i].clear();
+	for (int i = 0; i < MAX_GLOBAL_VARIABLES; i++)
+		vm.globalArrays[i].clear();
+	if (object.format == OBJ_FORMAT_ACS0)
+		return;
+
+	while ((chunk = OBJ_FindChunk(object, MAKE4CC('M', 'I', 'N', 'I'), chunk)) != NULL)
+	{
+		int first = OBJ_ReadInt(object, chunk->offset);
+
+		for (int i = 0; i < chunk->size / 4 - 1; i++)
+		{
+			if ((unsigned)(first + i) < MAX_MAP_VARIABLES)
+				vm.mapVars[first + i] = OBJ_ReadInt(object, chunk->offset + 4 + i * 4);
+		}
+	}
+
+	VecInt arrayVars;
+
+	chunk = OBJ_FindChunk(object, MAKE4CC('A', 'R', 'A', 'Y'));
+	for (int i = 0; chunk != NULL && i < chunk->size / 8; i++)
+	{
+		int var = OBJ_ReadInt(object, chunk->offset + i * 8);
+		int size = OBJ_ReadInt(object, chunk->offset + i * 8 + 4);
+
+		arrayVars.add(var);
+		vm.mapArrays.add(VecInt());
+		vm.mapArrays.lastAdded().resize(std::max(0, std::min(size, vm.codeSize)));
+		if ((unsigned)var < MAX_MAP_VARIABLES)
+			vm.mapVars[var] = i;
+	}
+
+	chunk = NULL;
+	while ((chunk = OBJ_FindChunk(object, MAKE4CC('A', 'I', 'N', 'I'), chunk)) != NULL)
+	{
+		int var = OBJ_ReadInt(object, chunk->offset);
+
+		for (int i = 0; i < arrayVars.size(); i++)
+		{
+			if (arrayVars[i] != var)
+				continue;
+			for (int j = 0; j < chunk->size / 4 - 1 && j < vm.mapArrays[i].size(); j++)
+				vm.mapArrays[i][j] = OBJ_ReadInt(object, chunk->offset + 4 + j * 4);
+		}
+	}
+}
+
+//==========================================================================
+//
+// VM_SetBuiltin
+//
+//==========================================================================
+void VM_SetBuiltin(vmState_t &vm, int cmd, vmBuiltin_t builtin)
+{
+	if (cmd >= 0 && cmd < PCODE_COMMAND_COUNT)
+		vm.builtins[cmd] = builtin;
+}
+
+//==========================================================================
+//
+// VM_FindScript
+//
+// Returns the index in vm.scripts, or -1.
+//
+//==========================================================================
+int VM_FindScript(const vmState_t &vm, int number)
+{
+	for (int i = 0; i < vm.scripts.size(); i++)
+	{
+		if (vm.scripts.at(i).number == number)
+			return i;
+	}
+	return -1;
+}
+
+int VM_FindScript(const vmState_t &vm, const string &name)
+{
+	string wanted = "script \"" + name + "\"";
+
+	for (int i = 0; i < vm.scripts.size(); i++)
+	{
+		if (vm.scripts.at(i).name == wanted)
+			return i;
+	}
+	return -1;
+}
+
+//==========================================================================
+//
+// VM_ScriptRunning
+//
+// True if a thread of the script hasn't finished, which is what
+// scriptwait waits for.
+//
+//==========================================================================
+bool VM_ScriptRunning(const vmState_t &vm, int number)
+{
+	int script = VM_FindScript(vm, number);
+
+	return script >= 0 && vm.scripts.at(script).live > 0;
+}
+
+//==========================================================================
+//
+// VM_StartScript
+//
+// Makes a thread for a script, with the arguments in its first
+// variables. It doesn't run until VM_Run is called. Returns the
+// thread's index in vm.threads.
+//
+//==========================================================================
+int VM_StartScript(vmState_t &vm, int script, const int *args, int argCount)
+{
+	vmScript_t &info = vm.scripts[script];
+	vmThread_t thread;
+
+	thread.script = script;
+	thread.status = VM_RUNNING;
+	thread.pc = info.address;
+	thread.sp = 0;
+	thread.stack.resize(STACK_GUARD + VM_STACK_SIZE + STACK_SLACK);
+	thread.localBase = 0;
+	thread.localCount = std::max(info.varCount, info.argCount);
+	thread.locals.resize(thread.localCount);
+	for (int i = 0; i < argCount && i < thread.localCount; i++)
+		thread.locals[i] = args[i];
+	thread.waitCommand = PCD_NOP;
+	thread.wait = 0;
+	thread.waitScript = -1;
+	thread.wakeTic = 0;
+	thread.ended = false;
+	thread.result = 0;
+	thread.hudOptions = -1;
+	thread.executed = 0;
+	info.runs++;
+	info.live++;
+	vm.threads.add(thread);
+	return vm.threads.size() - 1;
+}
+
+//==========================================================================
+//
+// VM_Run
+//
+// Runs a thread until it finishes, fails or has to wait. Every pcode is
+// counted, in the thread, its script and vm.commands.
+//
+//==========================================================================
+VmStatus VM_Run(vmState_t &vm, int index)
+{
+#ifdef VM_COMPUTED_GOTO
+	static void *Labels[PCODE_COMMAND_COUNT];
+
+	if (Labels[0] == NULL)
+	{
+		for (int i = 0; i < PCODE_COMMAND_COUNT; i++)
+			Labels[i] = &&builtin;
+#define LABEL(name) Labels[PCD_##name] = &&Op_##name;
+		NATIVE_COMMANDS(LABEL)
+#undef LABEL
+	}
+#endif
+
+	vmThread_t *thread = &vm.threads[index];
+
+	if (thread->status != VM_RUNNING)
+		return thread->status;
+
+	const byte *code = vm.code.data();
+	const int codeSize = vm.codeSize;
+	const bool compact = vm.compact;
+	long long *commands = vm.commands.data();
+	long long *hits = vm.hits.data();
+	long long executed = 0;
+	int pc = thread->pc;
+	int sp = thread->sp;
+	int *stack = thread->stack.data() + STACK_GUARD;
+	int *locals = thread->locals.data() + thread->localBase;
+	int localCount = thread->localCount;
+	int cmd, temp, *var;
+	bool discard;
+	string text;
+
+#ifdef VM_COMPUTED_GOTO
+	NEXT;
+#else
+dispatch:
+	DISPATCH();
+	switch (cmd)
+	{
+	default:
+		goto builtin;
+#endif
+
+	OP(NOP)				NEXT;
+	OP(TERMINATE)		thread->status = VM_FINISHED; goto stop;
+	OP(SUSPEND)			thread->status = VM_SUSPENDED; goto stop;
+	OP(RESTART)			pc = vm.scripts[thread->script].address; NEXT;
+
+	OP(PUSHNUMBER)		PUSH(NEXTINT); NEXT;
+	OP(PUSHBYTE)		PUSH(NEXTBYTE); NEXT;
+	OP(PUSHBYTES)		for (temp = NEXTBYTE; temp > 0; temp--) PUSH(NEXTBYTE); NEXT;
+	OP(PUSH2BYTES)		PUSH(code[pc]); PUSH(code[pc + 1]); pc += 2; NEXT;
+	OP(PUSH3BYTES)		PUSH(code[pc]); PUSH(code[pc + 1]); PUSH(code[pc + 2]); pc += 3; NEXT;
+	OP(PUSH4BYTES)		for (temp = 0; temp < 4; temp++) PUSH(NEXTBYTE); NEXT;
+	OP(PUSH5BYTES)		for (temp = 0; temp < 5; temp++) PUSH(NEXTBYTE); NEXT;
+
+	OP(ADD)				STACK(2) = Add(STACK(2), STACK(1)); sp--; NEXT;
+	OP(SUBTRACT)		STACK(2) = Sub(STACK(2), STACK(1)); sp--; NEXT;
+	OP(MULTIPLY)		STACK(2) = Mul(STACK(2), STACK(1)); sp--; NEXT;
+	OP(DIVIDE)			if (STACK(1) == 0) goto divideByZero; STACK(2) = Div(STACK(2), STACK(1)); sp--; NEXT;
+	OP(MODULUS)			if (STACK(1) == 0) goto divideByZero; STACK(2) = Mod(STACK(2), STACK(1)); sp--; NEXT;
+	OP(EQ)				STACK(2) = STACK(2) == STACK(1); sp--; NEXT;
+	OP(NE)				STACK(2) = STACK(2) != STACK(1); sp--; NEXT;
+	OP(LT)				STACK(2) = STACK(2) < STACK(1); sp--; NEXT;
+	OP(GT)				STACK(2) = STACK(2) > STACK(1); sp--; NEXT;
+	OP(LE)				STACK(2) = STACK(2) <= STACK(1); sp--; NEXT;
+	OP(GE)				STACK(2) = STACK(2) >= STACK(1); sp--; NEXT;
+	OP(ANDLOGICAL)		STACK(2) = STACK(2) && STACK(1); sp--; NEXT;
+	OP(ORLOGICAL)		STACK(2) = STACK(2) || STACK(1); sp--; NEXT;
+	OP(ANDBITWISE)		STACK(2) &= STACK(1); sp--; NEXT;
+	OP(ORBITWISE)		STACK(2) |= STACK(1); sp--; NEXT;
+	OP(EORBITWISE)		STACK(2) ^= STACK(1); sp--; NEXT;
+	OP(LSHIFT)			STACK(2) = ShiftLeft(STACK(2), STACK(1)); sp--; NEXT;
+	OP(RSHIFT)			STACK(2) = ShiftRight(STACK(2), STACK(1)); sp--; NEXT;
+	OP(NEGATELOGICAL)	STACK(1) = !STACK(1); NEXT;
+	OP(NEGATEBINARY)	STACK(1) = ~STACK(1); NEXT;
+	OP(UNARYMINUS)		STACK(1) = Sub(0, STACK(1)); NEXT;
+
+	OP(FIXEDMUL)		STACK(2) = (int)(((long long)STACK(2) * STACK(1)) >> 16); sp--; NEXT;
+	OP(FIXEDDIV)		STACK(2) = FixedDiv(STACK(2), STACK(1)); sp--; NEXT;
+	OP(SIN)				STACK(1) = (int)(std::sin(STACK(1) * (2 * PI / 65536)) * 65536); NEXT;
+	OP(COS)				STACK(1) = (int)(std::cos(STACK(1) * (2 * PI / 65536)) * 65536); NEXT;
+	OP(VECTORANGLE)
+		STACK(2) = (int)(std::atan2((double)STACK(1), (double)STACK(2)) * (65536 / (2 * PI))) & 0xffff;
+		sp--;
+		NEXT;
+
+	OP(DROP)			sp--; NEXT;
+	OP(DUP)				PUSH(STACK(1)); NEXT;
+	OP(SWAP)			temp = STACK(2); STACK(2) = STACK(1); STACK(1) = temp; NEXT;
+
+	OP(GOTO)			pc = ReadInt(code + pc); NEXT;
+	OP(IFGOTO)			temp = NEXTINT; if (STACK(1)) pc = temp; sp--; NEXT;
+	OP(IFNOTGOTO)		temp = NEXTINT; if (!STACK(1)) pc = temp; sp--; NEXT;
+	OP(CASEGOTO)
+		if (STACK(1) == ReadInt(code + pc))
+		{
+			pc = ReadInt(code + pc + 4);
+			sp--;
+		}
+		else
+		{
+			pc += 8;
+		}
+		NEXT;
+	OP(CASEGOTOSORTED)
+		// The table is aligned and sorted by value
+		pc = (pc + 3) & ~3;
+		temp = NEXTINT;
+		if (temp < 0 || pc + temp * 8 > codeSize)
+			goto badAddress;
+		{
+			int low = 0, high = temp - 1;
+
+			while (low <= high)
+			{
+				int middle = (low + high) / 2;
+				int value = ReadInt(code + pc + middle * 8);
+
+				if (value == STACK(1))
+				{
+					pc = ReadInt(code + pc + middle * 8 + 4);
+					sp--;
+					NEXT;
+				}
+				if (value < STACK(1))
+					low = middle + 1;
+				else
+					high = middle - 1;
+			}
+		}
+		pc += temp * 8;
+		NEXT;
+
+	OP(DELAY)			temp = STACK(1); sp--; goto delay;
+	OP(DELAYDIRECT)		temp = NEXTINT; goto delay;
+	OP(DELAYDIRECTB)	temp = NEXTBYTE; goto delay;
+	OP(TAGWAIT)			temp = STACK(1); sp--; goto wait;
+	OP(TAGWAITDIRECT)	temp = NEXTINT; goto wait;
+	OP(POLYWAIT)		temp = STACK(1); sp--; goto wait;
+	OP(POLYWAITDIRECT)	temp = NEXTINT; goto wait;
+	OP(SCRIPTWAIT)		temp = VM_FindScript(vm, STACK(1)); sp--; goto scriptWait;
+	OP(SCRIPTWAITDIRECT) temp = VM_FindScript(vm, NEXTINT); goto scriptWait;
+	OP(SCRIPTWAITNAMED)	temp = VM_FindScript(vm, String(vm, STACK(1))); sp--; goto scriptWait;
+
+	OP(RANDOM)			STACK(2) = Random(vm, STACK(2), STACK(1)); sp--; NEXT;
+	OP(RANDOMDIRECT)	temp = NEXTINT; PUSH(Random(vm, temp, NEXTINT)); NEXT;
+	OP(RANDOMDIRECTB)	temp = NEXTBYTE; PUSH(Random(vm, temp, NEXTBYTE)); NEXT;
+
+	OP(CALL)			temp = NEXTARG; discard = false; goto call;
+	OP(CALLDISCARD)		temp = NEXTARG; discard = true; goto call;
+	OP(CALLSTACK)		temp = STACK(1); sp--; discard = false; goto call;
+	OP(PUSHFUNCTION)	PUSH(NEXTARG); NEXT;
+	OP(RETURNVOID)		discard = true; goto functionReturn;
+	OP(RETURNVAL)		discard = false; goto functionReturn;
+
+	OP(BEGINPRINT)		thread->print.clear(); NEXT;
+	OP(PRINTSTRING)		thread->print += String(vm, STACK(1)); sp--; NEXT;
+	OP(PRINTLOCALIZED)	thread->print += String(vm, STACK(1)); sp--; NEXT;
+	OP(PRINTNUMBER)		thread->print += string(STACK(1)); sp--; NEXT;
+	OP(PRINTCHARACTER)	thread->print += (char)STACK(1); sp--; NEXT;
+	OP(PRINTFIXED)
+		{
+			char number[32];
+
+			snprintf(number, sizeof(number), "%g", STACK(1) / 65536.0);
+			thread->print += number;
+		}
+		sp--;
+		NEXT;
+	OP(PRINTHEX)
+		{
+			char number[16];
+
+			snprintf(number, sizeof(number), "%X", (unsigned)STACK(1));
+			thread->print += number;
+		}
+		sp--;
+		NEXT;
+	OP(PRINTBINARY)
+		for (temp = 31; temp > 0 && !((unsigned)STACK(1) >> temp); temp--)
+			;
+		for (; temp >= 0; temp--)
+			thread->print += (char)('0' + (((unsigned)STACK(1) >> temp) & 1));
+		sp--;
+		NEXT;
+	OP(PRINTMAPCHARARRAY)
+		for (temp = 0; temp < 65536 && *MapElement(vm, STACK(1), STACK(2) + temp) != 0; temp++)
+			thread->print += (char)*MapElement(vm, STACK(1), STACK(2) + temp);
+		sp -= 2;
+		NEXT;
+	OP(PRINTWORLDCHARARRAY)
+		for (temp = 0; temp < 65536 && *SparseElement(vm.worldArrays, MAX_WORLD_VARIABLES, STACK(1), STACK(2) + temp) != 0; temp++)
+			thread->print += (char)*SparseElement(vm.worldArrays, MAX_WORLD_VARIABLES, STACK(1), STACK(2) + temp);
+		sp -= 2;
+		NEXT;
+	OP(PRINTGLOBALCHARARRAY)
+		for (temp = 0; temp < 65536 && *SparseElement(vm.globalArrays, MAX_GLOBAL_VARIABLES, STACK(1), STACK(2) + temp) != 0; temp++)
+			thread->print += (char)*SparseElement(vm.globalArrays, MAX_GLOBAL_VARIABLES, STACK(1), STACK(2) + temp);
+		sp -= 2;
+		NEXT;
+	OP(ENDPRINT)		text = "print "; goto endPrint;
+	OP(ENDPRINTBOLD)	text = "printbold "; goto endPrint;
+	OP(ENDLOG)			text = "log "; goto endPrint;
+	OP(MOREHUDMESSAGE)	thread->hudOptions = -1; NEXT;
+	OP(OPTHUDMESSAGE)	thread->hudOptions = sp; NEXT;
+	OP(ENDHUDMESSAGE)	text = "hudmessage"; goto endHudMessage;
+	OP(ENDHUDMESSAGEBOLD) text = "hudmessagebold"; goto endHudMessage;
+	OP(SAVESTRING)		vm.strings.add(thread->print); thread->print.clear(); PUSH(vm.strings.size() - 1); NEXT;
+	OP(STRLEN)			STACK(1) = String(vm, STACK(1)).length(); NEXT;
+	OP(TAGSTRING)		NEXT;
+	OP(SETRESULTVALUE)	thread->result = STACK(1); sp--; NEXT;
+
+	VAR_OPS(SCRIPTVAR)
+	VAR_OPS(MAPVAR)
+	VAR_OPS(WORLDVAR)
+	VAR_OPS(GLOBALVAR)
+	ARRAY_OPS(MAPARRAY)
+	ARRAY_OPS(WORLDARRAY)
+	ARRAY_OPS(GLOBALARRAY)
+
+#ifndef VM_COMPUTED_GOTO
+	}
+#endif
+
+builtin:
+	// Operands come first, then the values popped. Only PCD_CALLFUNC pops
+	// a varying number, given by its first operand.
+	{
+		const pcodeInfo_t &info = pCode_Info[cmd];
+		int args[VM_MAX_ARGS];
+		int argCount = 0;
+		int pops;
+
+		for (const char *op = info.operands; *op != 0; op++)
+		{
+			switch (*op)
+			{
+			case 'i': args[argCount++] = NEXTINT; break;
+			case 'c': args[argCount++] = NEXTARG; break;
+			case 'w': args[argCount++] = NEXTWORD; break;
+			case 'b': args[argCount++] = NEXTBYTE; break;
+			default: goto badCommand;
+			}
+		}
+		pops = info.pops == PCODE_VARIES ? args[0] : info.pops;
+		if (pops < 0 || pops > sp || argCount + pops > VM_MAX_ARGS)
+			goto badStack;
+		for (int i = 0; i < pops; i++)
+			args[argCount++] = stack[sp - pops + i];
+		sp -= pops;
+
+		thread->pc = pc;
+		thread->sp = sp;
+		temp = vm.builtins[cmd](vm, index, cmd, args, argCount);
+
+		// The builtin may have started scripts, moving the threads
+		thread = &vm.threads[index];
+		stack = thread->stack.data() + STACK_GUARD;
+		locals = thread->locals.data() + thread->localBase;
+		if (info.pushes == 1)
+			PUSH(temp);
+		if (thread->status != VM_RUNNING)
+			goto stop;
+	}
+	NEXT;
+
+call:
+	if ((unsigned)temp >= (unsigned)vm.functions.size() || vm.functions[temp].address == 0)
+	{
+		thread->error = "Call to missing or imported function " + string(temp);
+		goto fail;
+	}
+	if (thread->frames.size() >= VM_MAX_CALL_DEPTH)
+	{
+		thread->error = "Calls nested too deeply";
+		goto fail;
+	}
+	{
+		vmFunction_t &function = vm.functions[temp];
+		vmFrame_t frame;
+
+		if (sp < function.argCount)
+			goto badStack;
+		frame.returnAddress = pc;
+		frame.localBase = thread->localBase;
+		frame.localCount = localCount;
+		frame.discard = discard;
+		thread->frames.add(frame);
+
+		thread->localBase += localCount;
+		localCount = function.argCount + function.localCount;
+		thread->locals.resize(thread->localBase + localCount);
+		locals = thread->locals.data() + thread->localBase;
+		for (int i = 0; i < localCount; i++)
+			locals[i] = i < function.argCount ? stack[sp - function.argCount + i] : 0;
+		sp -= function.argCount;
+		pc = function.address;
+	}
+	NEXT;
+
+functionReturn:
+	if (thread->frames.empty())
+	{
+		thread->error = "Return outside a function";
+		goto fail;
+	}
+	{
+		vmFrame_t frame = thread->frames.back();
+
+		thread->frames.pop_back();
+		if (!discard)
+		{
+			temp = STACK(1);
+			sp--;
+		}
+		pc = frame.returnAddress;
+		thread->localBase = frame.localBase;
+		localCount = frame.localCount;
+		thread->locals.resize(thread->localBase + localCount);
+		locals = thread->locals.data() + thread->localBase;
+		if (!discard && !frame.discard)
+			PUSH(temp);
+	}
+	NEXT;
+
+delay:
+	if (temp <= 0)
+		NEXT;
+	thread->status = VM_DELAYED;
+	thread->wait = temp;
+	thread->wakeTic = vm.tic + temp;
+	goto stop;
+
+wait:
+	thread->status = VM_WAITING;
+	thread->waitCommand = cmd;
+	thread->wait = temp;
+	thread->wakeTic = vm.tic + VM_MOVE_TICS;
+	VM_Event(vm, index, pCode_Names[cmd].substr(4) + "(" + string(temp) + ")");
+	goto stop;
+
+scriptWait:
+	// temp is the script's index
+	if (temp < 0 || vm.scripts[temp].live == 0)
+		NEXT;
+	thread->status = VM_WAITING;
+	thread->waitCommand = PCD_SCRIPTWAIT;
+	thread->wait = vm.scripts[temp].number;
+	thread->waitScript = temp;
+	goto stop;
+
+endPrint:
+	text += Quote(thread->print);
+	VM_Event(vm, index, text);
+	thread->print.clear();
+	NEXT;
+
+endHudMessage:
+	temp = thread->hudOptions < 0 ? sp : thread->hudOptions;
+	if (temp < 6 || temp > sp)
+		goto badStack;
+	text += ArgList(stack + temp - 6, sp - temp + 6);
+	text += " " + Quote(thread->print);
+	VM_Event(vm, index, text);
+	sp = temp - 6;
+	thread->print.clear();
+	thread->hudOptions = -1;
+	NEXT;
+
+divideByZero:
+	thread->error = "Division by zero";
+	goto fail;
+badVariable:
+	thread->error = "Variable " + string(temp) + " out of range";
+	goto fail;
+badAddress:
+	thread->error = "Jump outside the object";
+	goto fail;
+badStack:
+	thread->error = sp < 0 ? "Stack underflow" : "Stack overflow";
+	goto fail;
+badCommand:
+	thread->error = "Unknown pcode " + string(cmd);
+	goto fail;
+runaway:
+	thread->error = "Runaway script";
+	executed--;
+fail:
+	// No address: the same error at a different offset is the same behaviour
+	thread->status = VM_FAILED;
+	VM_Event(vm, index, "error: " + thread->error);
+
+stop:
+	thread->pc = pc;
+	thread->sp = sp;
+	thread->localCount = localCount;
+	thread->executed += executed;
+	vm.scripts[thread->script].executed += executed;
+	vm.executed += executed;
+	if (thread->status == VM_FINISHED || thread->status == VM_FAILED)
+		ThreadEnded(vm, *thread);
+	return thread->status;
+}
+
+//==========================================================================
+//
+// VM_RunTic
+//
+// Gives every thread that can go on its turn, in the order they were
+// started, as ZDoom's script thinker does. Threads started during the
+// tic get their turn in it too. Returns false once no thread is left
+// that could go on without being started again.
+//
+//==========================================================================
+bool VM_RunTic(vmState_t &vm)
+{
+	long long executed = vm.executed;
+	int alive = 0;
+	int active = 0;
+	long long bytes = 0;
+
+	for (int i = 0; i < vm.threads.size(); i++)
+	{
+		vmThread_t &thread = vm.threads[i];
+		int readyTic;
+
+		if (!ThreadReady(vm, thread, readyTic))
+			continue;
+		if (thread.status != VM_RUNNING)
+		{
+			vmScript_t &script = vm.scripts[thread.script];
+			int latency = std::max(0, vm.tic - readyTic);
+
+			script.wakes++;
+			script.latency += latency;
+			script.maxLatency = std::max(script.maxLatency, latency);
+			thread.status = VM_RUNNING;
+		}
+
+		long long start = thread.executed;
+
+		VM_Run(vm, i);
+
+		// The thread may have started others, moving it
+		vmThread_t &ran = vm.threads[i];
+		vmScript_t &script = vm.scripts[ran.script];
+
+		script.maxSlice = std::max(script.maxSlice, ran.executed - start);
+	}
+
+	for (vmThread_t &thread : vm.threads)
+	{
+		if (thread.ended)
+		{
+			ReleaseThread(thread);
+			continue;
+		}
+		alive++;
+		bytes += ThreadBytes(thread);
+		if (thread.status != VM_SUSPENDED)
+			active++;
+	}
+	if (alive > vm.peakThreads)
+	{
+		vm.peakThreads = alive;
+		vm.peakThreadBytes = bytes;
+		vm.peakTic = vm.tic;
+	}
+	vm.ticExecuted.add(vm.executed - executed);
+	vm.tic++;
+	return active > 0;
+}
+
+//==========================================================================
+//
+// VM_RunMap
+//
+// Starts the open scripts, then the enter scripts once for each player,
+// and runs tics until no thread can go on or vm.maxTics have passed.
+//
+//==========================================================================
+void VM_RunMap(vmState_t &vm)
+{
+	for (int i = 0; i < vm.scripts.size(); i++)
+	{
+		if (vm.scripts[i].type == ST_OPEN)
+			VM_StartScript(vm, i, NULL, 0);
+	}
+	for (int player = 0; player < vm.players; player++)
+	{
+		for (int i = 0; i < vm.scripts.size(); i++)
+		{
+			if (vm.scripts[i].type == ST_ENTER)
+				VM_StartScript(vm, i, NULL, 0);
+		}
+	}
+
+	while (vm.tic < vm.maxTics)
+	{
+		if (!VM_RunTic(vm))
+			return;
+	}
+	VM_Event(vm, -1, "stopped after " + string(vm.maxTics) + " tics");
+}
+
+//==========================================================================
+//
+// ThreadReady
+//
+// True if the thread can run this tic. readyTic is when it could first
+// have gone on, so a thread kept waiting past it can be measured.
+//
+//==========================================================================
+static bool ThreadReady(const vmState_t &vm, const vmThread_t &thread, int &readyTic)
+{
+	switch (thread.status)
+	{
+	case VM_RUNNING:
+		readyTic = vm.tic;
+		return true;
+
+	case VM_DELAYED:
+		readyTic = thread.wakeTic;
+		return vm.tic >= thread.wakeTic;
+
+	case VM_WAITING:
+		if (thread.waitCommand == PCD_SCRIPTWAIT)
+		{
+			const vmScript_t &script = vm.scripts.at(thread.waitScript);
+
+			readyTic = script.finishedTic;
+			return script.live == 0;
+		}
+		readyTic = thread.wakeTic;
+		return vm.tic >= thread.wakeTic;
+
+	default:
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// ThreadEnded
+//
+// Called once a thread finishes or fails, however it was stopped.
+//
+//==========================================================================
+static void ThreadEnded(vmState_t &vm, vmThread_t &thread)
+{
+	if (thread.ended)
+		return;
+	thread.ended = true;
+	vm.scripts[thread.script].live--;
+	vm.scripts[thread.script].finishedTic = vm.tic;
+}
+
+//==========================================================================
+//
+// ReleaseThread
+//
+// Frees a finished thread's stack and locals. Only done between turns,
+// since VM_Run keeps pointers into them.
+//
+//==========================================================================
+static void ReleaseThread(vmThread_t &thread)
+{
+	if (thread.stack.empty())
+		return;
+	thread.stack = VecInt();
+	thread.locals = VecInt();
+	thread.frames = vector<vmFrame_t>();
+	thread.print = string();
+}
+
+//==========================================================================
+//
+// ThreadBytes
+//
+//==========================================================================
+static long long ThreadBytes(const vmThread_t &thread)
+{
+	return sizeof(vmThread_t) + (thread.stack.capacity() + thread.locals.capacity()) * sizeof(int) +
+		thread.frames.capacity() * sizeof(vmFrame_t) + thread.print.capacity();
+}
+
+//==========================================================================
+//
+// VM_Event
+//
+// Records something a game would see, prefixed with the tic and the
+// script doing it.
+//
+//==========================================================================
+void VM_Event(vmState_t &vm, int thread, const string &text)
+{
+	string event = "tic " + string(vm.tic) + ": ";
+
+	if (thread >= 0)
+	{
+		event += vm.scripts[vm.threads[thread].script].name;
+		event += ": ";
+	}
+	event += text;
+	vm.events.add(event);
+}
+
+//==========================================================================
+//
+// VM_DefaultBuiltin
+//
+// Records the call and returns 0. The specials that start and stop
+// scripts are carried out too, since later events depend on them.
+//
+//==========================================================================
+int VM_DefaultBuiltin(vmState_t &vm, int thread, int cmd, const int *args, int argCount)
+{
+	switch (cmd)
+	{
+	case PCD_LSPEC1: case PCD_LSPEC2: case PCD_LSPEC3: case PCD_LSPEC4: case PCD_LSPEC5:
+	case PCD_LSPEC1DIRECT: case PCD_LSPEC2DIRECT: case PCD_LSPEC3DIRECT:
+	case PCD_LSPEC4DIRECT: case PCD_LSPEC5DIRECT:
+	case PCD_LSPEC1DIRECTB: case PCD_LSPEC2DIRECTB: case PCD_LSPEC3DIRECTB:
+	case PCD_LSPEC4DIRECTB: case PCD_LSPEC5DIRECTB:
+	case PCD_LSPEC5RESULT:
+		VM_Event(vm, thread, "special " + string(args[0]) + ArgList(args + 1, argCount - 1));
+		return LineSpecial(vm, thread, args, argCount);
+	default:
+		VM_Event(vm, thread, pCode_Names[cmd].substr(4) + ArgList(args, argCount));
+		return 0;
+	}
+}
+
+//==========================================================================
+//
+// LineSpecial
+//
+// ACS_Execute and friends. Only the current map's scripts can be run.
+//
+//==========================================================================
+static int LineSpecial(vmState_t &vm, int thread, const int *args, int argCount)
+{
+	int special = args[0];
+	int number = argCount > 1 ? args[1] : 0;
+	int map = argCount > 2 ? args[2] : 0;
+	int script = VM_FindScript(vm, number);
+	int started;
+
+	if (script < 0)
+		return 0;
+
+	switch (special)
+	{
+	case 80:	// ACS_Execute
+	case 83:	// ACS_LockedExecute
+		if (map != 0)
+			return 0;
+		for (vmThread_t &other : vm.threads)
+		{
+			if (other.script == script && other.status == VM_SUSPENDED)
+			{
+				other.status = VM_RUNNING;
+				return 1;
+			}
+		}
+		if (VM_ScriptRunning(vm, number))
+			return 0;
+		VM_StartScript(vm, script, args + 3, std::max(0, argCount - 3));
+		return 1;
+
+	case 226:	// ACS_ExecuteAlways
+		if (map != 0)
+			return 0;
+		VM_StartScript(vm, script, args + 3, std::max(0, argCount - 3));
+		return 1;
+
+	case 84:	// ACS_ExecuteWithResult, run at once
+		started = VM_StartScript(vm, script, args + 2, std::max(0, argCount - 2));
+		if (vm.nesting < MAX_NESTING)
+		{
+			vm.nesting++;
+			VM_Run(vm, started);
+			vm.nesting--;
+		}
+		return vm.threads[started].result;
+
+	case 81:	// ACS_Suspend
+	case 82:	// ACS_Terminate
+		if (map != 0)
+			return 0;
+		for (vmThread_t &other : vm.threads)
+		{
+			if (other.script != script || other.status == VM_FINISHED || other.status == VM_FAILED)
+				continue;
+			other.status = special == 81 ? VM_SUSPENDED : VM_FINISHED;
+			if (special == 82)
+				ThreadEnded(vm, other);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+//==========================================================================
+//
+// VM_Observed
+//
+// The events, then every variable that isn't 0 at the end: what two
+// builds of the same source must agree on.
+//
+//==========================================================================
+VecStr VM_Observed(const vmState_t &vm)
+{
+	VecStr lines = vm.events;
+
+	for (int i = 0; i < MAX_MAP_VARIABLES; i++)
+	{
+		if (vm.mapVars[i] != 0)
+			lines.add("map " + string(i) + " = " + string(vm.mapVars[i]));
+	}
+	for (int i = 0; i < vm.mapArrays.size(); i++)
+	{
+		const VecInt &array = vm.mapArrays.at(i);
+
+		for (int j = 0; j < array.size(); j++)
+		{
+			if (array.at(j) != 0)
+				lines.add("map array " + string(i) + "[" + string(j) + "] = " + string(array.at(j)));
+		}
+	}
+	for (int i = 0; i < MAX_WORLD_VARIABLES; i++)
+	{
+		if (vm.worldVars[i] != 0)
+			lines.add("world " + string(i) + " = " + string(vm.worldVars[i]));
+		for (const auto &element : vm.worldArrays[i])
+		{
+			if (element.second != 0)
+				lines.add("world array " + string(i) + "[" + string(element.first) + "] = " + string(element.second));
+		}
+	}
+	for (int i = 0; i < MAX_GLOBAL_VARIABLES; i++)
+	{
+		if (vm.globalVars[i] != 0)
+			lines.add("global " + string(i) + " = " + string(vm.globalVars[i]));
+		for (const auto &element : vm.globalArrays[i])
+		{
+			if (element.second != 0)
+				lines.add("global array " + string(i) + "[" + string(element.first) + "] = " + string(element.second));
+		}
+	}
+	return lines;
+}
+
+//==========================================================================
+//
+// VM_Report
+//
+// What the run did, then for each script the instructions it took, how
+// often its threads woke, the mean and longest wait after they could
+// have gone on, in tics, and the most instructions run in one turn.
+// Then the instructions per tic, the threads alive at once and the
+// pcodes that took the most.
+//
+//==========================================================================
+void VM_Report(const vmState_t &vm, ostream &out)
+{
+	for (const string &text : VM_Observed(vm))
+		out << text << endl;
+
+	out << endl << "  instructions  runs   wakes  latency  max     slice  script" << endl;
+	out << std::fixed << std::setprecision(2);
+	for (const vmScript_t &script : vm.scripts)
+	{
+		if (script.runs == 0)
+			continue;
+		out << std::setw(14) << script.executed << std::setw(6) << script.runs << std::setw(8) << script.wakes
+			<< std::setw(9) << (script.wakes ? (double)script.latency / script.wakes : 0.0)
+			<< std::setw(5) << script.maxLatency << std::setw(10) << script.maxSlice << "  " << script.name << endl;
+	}
+	out << std::setw(14) << vm.executed << "        total" << endl;
+
+	out << endl << vm.tic << " tics, " << (double)vm.tic / VM_TIC_RATE << " seconds" << endl;
+	out << "  instructions per tic: " << (vm.tic ? (double)vm.executed / vm.tic : 0.0) << " mean, "
+		<< TicPercentile(vm, 99) << " at the 99th percentile, " << TicPercentile(vm, 100) << " at most" << endl;
+	out << "  threads: " << vm.peakThreads << " alive at most, in tic " << vm.peakTic << ", using "
+		<< vm.peakThreadBytes << " bytes" << endl;
+
+	VecInt order;
+
+	for (int i = 0; i < PCODE_COMMAND_COUNT; i++)
+	{
+		if (vm.commands.at(i) > 0)
+			order.add(i);
+	}
+	std::stable_sort(order.begin(), order.end(),
+		[&](int a, int b) { return vm.commands.at(a) > vm.commands.at(b); });
+	out << endl << "  instructions  pcode" << endl;
+	for (int cmd : order)
+		out << std::setw(14) << vm.commands.at(cmd) << "  " << pCode_Names[cmd] << endl;
+}
+
+//==========================================================================
+//
+// VM_Compare
+//
+// Two runs behave the same if they record the same events and leave
+// the same variables. Instructions are compared script by script, then
+// for the busiest tics. Returns true if the behaviour matches.
+//
+//==========================================================================
+bool VM_Compare(const vmState_t &before, const vmState_t &after, ostream &out)
+{
+	VecStr a = VM_Observed(before);
+	VecStr b = VM_Observed(after);
+	bool same = a == b;
+
+	if (same)
+	{
+		out << "Same behaviour, " << a.size() << " events and variables" << endl;
+	}
+	else
+	{
+		int i = 0;
+
+		while (i < a.size() && i < b.size() && a[i] == b[i])
+			i++;
+		out << "Behaviour differs at line " << i + 1 << ":" << endl;
+		out << "- " << (i < a.size() ? a[i] : string("(end)")) << endl;
+		out << "+ " << (i < b.size() ? b[i] : string("(end)")) << endl;
+	}
+
+	out << endl << "        before         after  change  script" << endl;
+	for (const vmScript_t &script : before.scripts)
+	{
+		long long executed = 0;
+
+		for (const vmScript_t &other : after.scripts)
+		{
+			if (other.name == script.name)
+				executed = other.executed;
+		}
+		if (script.executed == 0 && executed == 0)
+			continue;
+		out << std::setw(14) << script.executed << std::setw(14) << executed << std::setw(7) << std::fixed
+			<< std::setprecision(1) << Change(script.executed, executed) << "%  " << script.name << endl;
+	}
+	out << std::setw(14) << before.executed << std::setw(14) << after.executed << std::setw(7)
+		<< Change(before.executed, after.executed) << "%  total" << endl;
+
+	for (int percent : { 99, 100 })
+	{
+		long long beforeTic = TicPercentile(before, percent);
+		long long afterTic = TicPercentile(after, percent);
+
+		out << std::setw(14) << beforeTic << std::setw(14) << afterTic << std::setw(7) << Change(beforeTic, afterTic)
+			<< (percent == 100 ? "%  busiest tic" : "%  99th percentile tic") << endl;
+	}
+	return same;
+}
+
+//==========================================================================
+//
+// TicPercentile
+//
+// The instructions run in a tic that this percent of tics didn't exceed.
+//
+//==========================================================================
+static long long TicPercentile(const vmState_t &vm, int percent)
+{
+	vector<long long> tics = vm.ticExecuted;
+
+	if (tics.empty())
+		return 0;
+	std::sort(tics.begin(), tics.end());
+	return tics[(tics.size() - 1) * percent / 100];
+}
+
+//==========================================================================
+//
+// Change
+//
+// In percent.
+//
+//==========================================================================
+static double Change(long long before, long long after)
+{
+	return before ? (after - before) * 100.0 / before : 0.0;
+}
+
+//==========================================================================
+//
+// Arithmetic
+//
+// Wraps on overflow the way the engine's does, without undefined
+// behaviour.
+//
+//==========================================================================
+static int ReadInt(const byte *data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned)data[3] << 24);
+}
+
+static int Add(int a, int b)
+{
+	return (int)((unsigned)a + (unsigned)b);
+}
+
+static int Sub(int a, int b)
+{
+	return (int)((unsigned)a - (unsigned)b);
+}
+
+static int Mul(int a, int b)
+{
+	return (int)((unsigned)a * (unsigned)b);
+}
+
+static int Div(int a, int b)
+{
+	return b == -1 ? Sub(0, a) : a / b;
+}
+
+// Like the engine's FixedDiv, a quotient that doesn't fit saturates,
+// and so does dividing by zero
+static int FixedDiv(int a, int b)
+{
+	if (std::llabs(a) >> 15 >= std::llabs(b))
+		return (a ^ b) < 0 ? INT_MIN : INT_MAX;
+	return (int)(a * 65536LL / b);
+}
+
+static int Mod(int a, int b)
+{
+	return b == -1 ? 0 : a % b;
+}
+
+static int ShiftLeft(int a, int b)
+{
+	return (int)((unsigned)a << (b & 31));
+}
+
+static int ShiftRight(int a, int b)
+{
+	return a >> (b & 31);
+}
+
+//==========================================================================
+//
+// Random
+//
+// The same sequence every run, so runs can be compared.
+//
+//==========================================================================
+static int Random(vmState_t &vm, int min, int max)
+{
+	unsigned int range;
+
+	if (max < min)
+		std::swap(min, max);
+	vm.random = vm.random * 1103515245 + 12345;
+	range = (unsigned)max - (unsigned)min + 1;
+	if (range == 0)
+		return (int)vm.random;
+	return Add(min, (vm.random >> 8) % range);
+}
+
+//==========================================================================
+//
+// MapElement
+//
+// The map variable holds the array's number.
+//
+//==========================================================================
+static int *MapElement(vmState_t &vm, int var, int index)
+{
+	Scratch = 0;
+	if ((unsigned)var >= MAX_MAP_VARIABLES || (unsigned)vm.mapVars[var] >= (unsigned)vm.mapArrays.size())
+		return &Scratch;
+
+	VecInt &array = vm.mapArrays[vm.mapVars[var]];
+
+	if ((unsigned)index >= (unsigned)array.size())
+		return &Scratch;
+	return array.data() + index;
+}
+
+//==========================================================================
+//
+// SparseElement
+//
+// World and global arrays have no size, so they're kept as maps.
+//
+//==========================================================================
+static int *SparseElement(std::map<int, int> *arrays, int count, int var, int index)
+{
+	Scratch = 0;
+	if ((unsigned)var >= (unsigned)count)
+		return &Scratch;
+	return &arrays[var][index];
+}
+
+//==========================================================================
+//
+// String
+//
+//==========================================================================
+static const string &String(const vmState_t &vm, int index)
+{
+	static const string empty;
+
+	if ((unsigned)index >= (unsigned)vm.strings.size())
+		return empty;
+	return vm.strings.at(index);
+}
+
+//==========================================================================
+//
+// Quote
+//
+//==========================================================================
+static string Quote(const string &text)
+{
+	string quoted = "\"";
+
+	for (char c : text)
+	{
+		if (c == '\n')
+			quoted += "\\n";
+		else if (c == '"' || c == '\\')
+		{
+			quoted += '\\';
+			quoted += c;
+		}
+		else
+		{
+			quoted += c;
+		}
+	}
+	return quoted + "\"";
+}
+
+//==========================================================================
+//
+// ArgList
+//
+//==========================================================================
+static string ArgList(const int *args, int argCount)
+{
+	string text = "(";
+
+	for (int i = 0; i < argCount; i++)
+		text += (i ? ", " : "") + string(args[i]);
+	return text + ")";
+}
@@ -0,0 +1,25 @@
+//**************************************************************************
+//**
+//** cost.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+#include "object.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define CO_RUNAWAY_LIMIT	2000000		// Pcodes ZDoom runs in a tic before it stops a script
+#define CO_LARGE_TRIP_COUNT	1000		// Most times a loop with no wait runs without a warning
+
+// TYPES -------------------------------------------------------------------
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+bool CO_Report(const acsObject_t &object, ostream &out);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
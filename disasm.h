@@ -0,0 +1,23 @@
+//**************************************************************************
+//**
+//** disasm.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+#include "object.h"
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+void DA_Disassemble(const acsObject_t &object, ostream &out);
+bool DA_Diff(const acsObject_t &before, const acsObject_t &after, ostream &out);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
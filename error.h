@@ -155,6 +155,10 @@ enum ErrorNumber : int
 	ERR_ALREADY_DELETED,
 	ERR_CANNOT_MODIFY_CONST,
 	ERR_INVALID_ARRAY_SIZE,
+	ERR_SAVE_INTERFACE_FAILED,
+	ERR_IMPORT_CYCLE,
+	ERR_NOT_AN_OBJECT,
+	ERR_COUNTER_ARRAY_USED,
 };
 
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
@@ -8,6 +8,7 @@
 
 // HEADER FILES ------------------------------------------------------------
 
+#include <ctime>
 #include "error.h"
 
 // MACROS ------------------------------------------------------------------
@@ -27,10 +28,17 @@ short MS_LittleUWORD(short val);
 int MS_LittleUINT(int val);
 void MS_LoadFile(const string &name, vector<char>& DataReference);
 bool MS_FileExists(const string &name);
+time_t MS_FileTime(const string &name);
+const char *MS_MapFile(const string &name, int &size);
+void MS_UnmapFile(const char *data, int size);
+unsigned int MS_HashFile(const string &name);
+unsigned int MS_HashFiles(const VecStr &names);
+long long MS_PeakMemory();
 bool MS_SaveFile(const string &name, vector<char>& DataReference);
 void MS_SuggestFileExt(string &base, string&& extension);
 void MS_StripFileExt(string &name);
 bool MS_StripFilename(string &path);
+string MS_EscapeMakePath(const string &path);
 
 //TODO: Finish new message declarations
 void Message(MessageType msg, const string& text);
@@ -0,0 +1,116 @@
+//**************************************************************************
+//**
+//** object.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define INTERFACE_VERSION 2
+
+// TYPES -------------------------------------------------------------------
+
+enum ObjectFormat : int
+{
+	OBJ_FORMAT_NONE,	// Not an ACS object
+	OBJ_FORMAT_ACS0,	// Hexen format, no chunks
+	OBJ_FORMAT_ACSE,	// New format, #nocompact pcodes
+	OBJ_FORMAT_ACSe		// New format, compact pcodes
+};
+
+// A chunk in a new format object
+struct objChunk_t
+{
+	int id;				// MAKE4CC id
+	int size;			// Size of the data, not counting the 8 byte header
+	int offset;			// Offset of the data in the object
+};
+
+// A compiled object read back into memory
+struct acsObject_t
+{
+	string name;
+	vector<char> data;
+	ObjectFormat format;
+	int dirOffset;		// Offset of the Hexen script directory
+	vector<objChunk_t> chunks;
+};
+
+// A script or function body in an object
+struct objBody_t
+{
+	string name;		// "script 5", "script "name"" or the function's name
+	int address;
+	int size;			// Up to whatever comes next in the object
+	int type;			// ScriptActivation, for scripts
+	int argCount;
+	int function;		// Index in FUNC, or -1 for a script
+};
+
+// A pcode read from a body
+struct objInstr_t
+{
+	int address;
+	int cmd;			// -1 if it couldn't be decoded
+	int size;
+	VecInt operands;	// PUSHBYTES and CASEGOTOSORTED give a count, then the values
+};
+
+// What an importer needs to know about a library
+struct libFunction_t
+{
+	string name;
+	int argCount;
+	bool hasReturnValue;
+};
+
+struct libVariable_t
+{
+	string name;
+	bool isString;		// Holds strings, for MSTR/ASTR
+	int size;			// 0 for plain variables
+	VecInt dims;		// Array dimensions
+};
+
+struct libDefine_t
+{
+	string name;
+	int value;
+};
+
+struct libInterface_t
+{
+	string name;		// From #library
+	unsigned int sourceHash;	// Of all its sources, from MS_HashFiles
+	VecStr sources;		// Files it was built from, the main source first
+	vector<libFunction_t> functions;
+	vector<libVariable_t> variables;
+	vector<libDefine_t> defines;
+};
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+bool OBJ_Load(const string &name, acsObject_t &object);
+bool OBJ_Parse(acsObject_t &object);
+const objChunk_t *OBJ_FindChunk(const acsObject_t &object, int id, const objChunk_t *after = NULL);
+bool OBJ_IsLibrary(const acsObject_t &object);
+int OBJ_ReadInt(const acsObject_t &object, int offset);
+int OBJ_ReadWord(const acsObject_t &object, int offset);
+int OBJ_ReadByte(const acsObject_t &object, int offset);
+string OBJ_ReadString(const acsObject_t &object, int offset);
+VecStr OBJ_ReadStringList(const acsObject_t &object, const objChunk_t *chunk);
+VecStr OBJ_ReadStrings(const acsObject_t &object);
+void OBJ_FindBodies(const acsObject_t &object, vector<objBody_t> &bodies);
+int OBJ_OperandSize(char op, bool compact);
+bool OBJ_DecodeInstr(const byte *code, int size, int pos, int start, bool compact, objInstr_t &instr);
+bool OBJ_ReadLibrary(const acsObject_t &object, libInterface_t &library);
+bool OBJ_LoadInterface(const string &name, libInterface_t &library);
+bool OBJ_WriteInterface(const string &name, const libInterface_t &library);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
@@ -0,0 +1,65 @@
+//**************************************************************************
+//**
+//** opt.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define OPT_INLINE_MIN_CALLS	100		// Calls a site needs in the profile to be inlined
+#define OPT_INLINE_MAX_SIZE		40		// Most pcodes in a function that is inlined
+#define OPT_MAX_LOCALS			255		// Most variables a body can have
+#define OPT_MAX_PEELED_CASES	3		// Hot cases tested ahead of a sorted switch
+#define OPT_BUILTIN_WEIGHT		4		// Pcodes a pure builtin counts as when reusing its value
+#define OPT_MAX_ROTATED_SIZE	10		// Most pcodes in a loop test copied to the end of the loop
+#define OPT_GUESSED_TRIPS		10		// Trips a loop is taken to make without a profile
+#define OPT_MAX_GUESSED_DEPTH	6		// Deepest loop nesting those guesses multiply over
+
+// TYPES -------------------------------------------------------------------
+
+struct optInstr_t
+{
+	int cmd;
+	VecInt operands;	// As the disassembler reads them, but jumps hold block numbers
+	int address;		// Where it was read from, or -1 if the optimizer added it
+	int size;
+};
+
+struct optBlock_t
+{
+	vector<optInstr_t> code;
+	int next;			// Block it falls through to, or -1
+	long long count;	// Times it was entered in the profile, or -1
+};
+
+// A script or function body split into basic blocks. Blocks keep their
+// numbers while they are moved around; order is where each one goes.
+struct optBody_t
+{
+	int start;			// Address of the body
+	bool compact;
+	int argCount;		// The first of the locals
+	int varCount;		// Arguments and locals
+	vector<optBlock_t> blocks;	// The entry is block 0
+	VecInt order;
+	VecInt pending;		// Calls still to be filled in, by operand address
+};
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+bool OPT_Decode(const byte *code, int size, int start, bool compact, optBody_t &body);
+unsigned int OPT_Hash(const optBody_t &body);
+int OPT_Body(const string &name, int start, int argCount, int varCount, const VecInt &pending);
+void OPT_AddFunction(int number, int argCount);
+int OPT_NewAddress(int address);
+VecInt OPT_Successors(const optBlock_t &block);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
+
+extern bool opt_Enabled;
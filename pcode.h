@@ -12,8 +12,12 @@
 
 // MACROS ------------------------------------------------------------------
 
+#define PCODE_VARIES -1		// Stack effect depends on the operands
+
 // TYPES -------------------------------------------------------------------
 
+struct libInterface_t;
+
 // Values to indicate script flags (requires new-style .o)
 enum ScriptFlag : unsigned int
 {
@@ -426,6 +430,21 @@ enum pCode : int
 	PCODE_COMMAND_COUNT
 };
 
+// How a pcode is encoded, and what it does to the stack. The operand
+// letters are:
+//   i  int
+//   c  byte in a compact object, otherwise int
+//   w  word in a compact object, otherwise int
+//   b  byte
+//   n  byte count, then that many bytes
+//   s  the CASEGOTOSORTED table: aligned int count, then value/address pairs
+struct pcodeInfo_t
+{
+	const char *operands;
+	int pops;
+	int pushes;
+};
+
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
 
 void PC_OpenObject(string name, int size, int flags);
@@ -439,6 +458,12 @@ void pCode_AppendPadding(int bytes);
 void pCode_AppendPushVal(int val);
 void pCode_AppendShrink(byte val);
 void pCode_Skip(int size);
+vector<byte> pCode_ReadCode(int start);
+void pCode_ReplaceCode(int start, const vector<byte> &code);
+bool pCode_FindLine(int address, string &file, int &line);
+void pCode_MoveLines(int start, const VecInt &from, const VecInt &to);
+void pCode_AddLineBody(const string &name, int start);
+bool pCode_WriteLines(const string &fileName);
 void pCode_AddScript(int number, ScriptActivation type, ScriptFlag flags, int argCount);
 void pCode_SetScriptVarCount(int number, ScriptActivation type, int varCount);
 void pCode_AddFunction(ACS_Node *node);
@@ -447,6 +472,10 @@ void PC_NameMapVariable(int index, ACS_Node *node);
 void PC_AddArray(int index, int size);
 void PC_InitArray(int index, VecInt items, bool hasStrings);
 int  PC_AddImport(string name);
+void PC_SetArrayDims(int index, int ndim, int *dims);
+void PC_SetLibraryName(string name);
+void PC_AddLibDefine(string name, int value);
+void PC_GetInterface(libInterface_t &library);
 void pCode_HexenEnforcer();
 
 // PUBLIC DATA DECLARATIONS ------------------------------------------------
@@ -465,4 +494,7 @@ bool			pCode_HexenCase;			// ?
 bool			pCode_EnforceHexen;			// Error if the user utilizes items beyond the hexen spec
 bool			pCode_WarnNotHexen;			// ?
 bool			pCode_WadAuthor = true;		// Make WadAuthor compatible scripts
-bool			pCode_EncryptStrings;		// Prevent strings from being visible in the compiled file
\ No newline at end of file
+bool			pCode_EncryptStrings;		// Prevent strings from being visible in the compiled file
+extern bool		pCode_RecordLines;			// Keep the source line of each pcode, for -g and -instrument
+extern string	pCode_Names[PCODE_COMMAND_COUNT];	// Name of each pcode, for logs and reports
+extern const pcodeInfo_t pCode_Info[PCODE_COMMAND_COUNT];	// Operands and stack effect of each pcode
\ No newline at end of file
@@ -0,0 +1,43 @@
+//**************************************************************************
+//**
+//** profile.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define PF_COUNTER_ARRAY (MAX_GLOBAL_VARIABLES - 1)	// Global array -instrument counts in
+
+// TYPES -------------------------------------------------------------------
+
+struct vmState_t;
+
+// What one body did in a profiled run
+struct pfBody_t
+{
+	string name;		// As in the -s report
+	unsigned int hash;	// OPT_Hash of the body that was run
+	vector<long long> blocks;	// Times each basic block was entered
+	vector<long long> calls;	// Times each PCD_CALL or PCD_CALLDISCARD ran, in order
+};
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+bool PF_Load(const string &fileName);
+bool PF_Loaded();
+const pfBody_t *PF_FindBody(const string &name, unsigned int hash);
+bool PF_Write(const vmState_t &vm, const string &fileName);
+void PF_AddCounterBody(const string &name, unsigned int hash, int blockCount, const VecInt &callBlocks);
+int PF_AddCounter(int block, const string &file, int line);
+bool PF_WriteCounters(const string &fileName);
+bool PF_ConvertCounters(const string &countersName, const string &logName, const string &profileName);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
+
+extern bool pf_Instrument;
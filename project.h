@@ -0,0 +1,25 @@
+//**************************************************************************
+//**
+//** project.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define PROJECT_DEPFILE "acc.d"
+
+// TYPES -------------------------------------------------------------------
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+void PJ_AddSource(string sourceName);
+void PJ_AddOption(string option);
+int PJ_Build(string program, int jobs);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
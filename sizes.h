@@ -0,0 +1,23 @@
+//**************************************************************************
+//**
+//** sizes.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+bool SZ_WriteReport(const string &objectName, const string &fileName);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
+
+extern bool sz_Enabled;
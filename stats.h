@@ -0,0 +1,98 @@
+//**************************************************************************
+//**
+//** stats.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include "common.h"
+
+// MACROS ------------------------------------------------------------------
+
+// TYPES -------------------------------------------------------------------
+
+enum StatPhase : int
+{
+	PHASE_LEX,			// Inside TK_NextToken
+	PHASE_PARSE,		// PA_Parse, lexing included
+	PHASE_CLOSE,		// Chunk assembly in PC_CloseObject
+	PHASE_WRITE,		// Saving the object
+	NUM_PHASES
+};
+
+enum StatCounter : int
+{
+	STAT_TOKENS,			// Tokens lexed
+	STAT_SYMBOL_LOOKUPS,	// Symbol table searches
+	STAT_SYMBOL_PROBES,		// Nodes compared by those searches
+	STAT_STRING_LOOKUPS,	// String table searches
+	STAT_STRING_PROBES,		// Strings compared by those searches
+	STAT_FILLINS,			// Function calls patched after the function was defined
+	STAT_PEAK_PCODE,		// Largest pcode buffer, in bytes
+	STAT_PEAK_SYMBOLS,		// Most symbols at once
+	STAT_PEAK_NESTING,		// Deepest #include nesting
+	NUM_STAT_COUNTERS
+};
+
+// Subsystems that allocations are charged to
+enum AllocTag : int
+{
+	ALLOC_OTHER,
+	ALLOC_LEXER,
+	ALLOC_PARSER,
+	ALLOC_SYMBOLS,
+	ALLOC_STRINGS,
+	ALLOC_PCODE,
+	NUM_ALLOC_TAGS
+};
+
+// Charges allocations made until the end of its scope to a subsystem
+class allocScope_t
+{
+public:
+	allocScope_t(AllocTag tag);
+	~allocScope_t();
+
+private:
+	AllocTag previous;
+};
+
+// Records a trace span from construction to the end of its scope. If
+// given a size, the bytes it grew by are added to the span.
+class traceSpan_t
+{
+public:
+	traceSpan_t(const string &name, const int *size = NULL, const string &args = "");
+	~traceSpan_t();
+
+private:
+	const int *size;
+	int startSize;
+};
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+void ST_StartPhase(StatPhase phase);
+void ST_EndPhase(StatPhase phase);
+void ST_Peak(StatCounter counter, long long value);
+void ST_EnterFile(const string &fileName);
+void ST_LeaveFile();
+void ST_Report();
+bool ST_WriteJson(const string &fileName);
+void ST_TraceBegin(const string &name, const string &args = "");
+void ST_TraceEnd(const string &args = "");
+string ST_TraceArg(const string &key, const string &value);
+string ST_TraceArg(const string &key, int value);
+void ST_SetTrack(int track, const string &name);
+bool ST_WriteTrace(const string &fileName);
+void ST_AllocReport();
+long long ST_AllocCount();
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------
+
+extern bool st_Enabled;
+extern long long st_Counters[NUM_STAT_COUNTERS];
+extern bool st_Tracing;
@@ -151,6 +151,10 @@ enum tokenType_t : int
 void TK_Init();
 void TK_OpenSource(string fileName);
 void TK_Include(string fileName);
+bool TK_FindInclude(string fileName, string &sourceName);
+void TK_AddDependency(const string &fileName);
+bool TK_WriteDepFile(const string &fileName, const string &target);
+const VecStr &TK_GetDependencies();
 void TK_Import(string fileName, ImportModes prevMode);
 void TK_CloseSource();
 int TK_GetDepth();
@@ -163,6 +167,7 @@ void TK_Undo();
 void TK_SkipLine();
 void TK_SkipPast(int token);
 void TK_SkipTo(int token);
+bool TK_SkipToMatchingBrace();
 void TK_AddIncludePath(string sourceName);
 void TK_AddProgramIncludePath(string argv0);
 
@@ -0,0 +1,152 @@
+//**************************************************************************
+//**
+//** vm.h
+//**
+//**************************************************************************
+
+#pragma once
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <map>
+#include "common.h"
+#include "object.h"
+#include "pcode.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define VM_STACK_SIZE		4096		// Values a thread can push, as in ZDoom
+#define VM_MAX_CALL_DEPTH	1000
+#define VM_RUNAWAY_LIMIT	2000000		// Instructions in one run before a script is stopped
+#define VM_MAX_ARGS			(256 + 8)	// Most arguments a builtin can be given
+#define VM_TIC_RATE			35			// Tics in a second
+#define VM_DEFAULT_TICS		(VM_TIC_RATE * 60)	// How long VM_RunMap plays the map for
+#define VM_MOVE_TICS		VM_TIC_RATE	// How long a tagwait or polywait lasts, since nothing moves
+
+// TYPES -------------------------------------------------------------------
+
+enum VmStatus : int
+{
+	VM_RUNNING,
+	VM_DELAYED,			// For wait tics
+	VM_WAITING,			// On a tag, polyobject or script; see waitCommand
+	VM_SUSPENDED,		// By PCD_SUSPEND, until started again
+	VM_FINISHED,
+	VM_FAILED			// Stopped by an error, in error
+};
+
+struct vmScript_t
+{
+	int number;			// Negative for named scripts
+	string name;		// "script 5" or "script "name"", as in the -s report
+	int address;
+	int type;			// ScriptActivation
+	int argCount;
+	int varCount;
+	long long executed;	// Instructions run by all its threads
+	int runs;
+	int live;			// Threads that haven't finished
+	int finishedTic;	// When one of them last finished
+	long long wakes;	// Times a thread resumed after a delay or wait
+	long long latency;	// Tics those threads were kept waiting once they could go on
+	int maxLatency;
+	long long maxSlice;	// Most instructions a thread ran in one turn
+};
+
+struct vmFunction_t
+{
+	string name;
+	int address;		// 0 if imported
+	int argCount;
+	int localCount;		// Not counting the arguments
+	bool hasReturn;
+};
+
+struct vmFrame_t
+{
+	int returnAddress;
+	int localBase;
+	int localCount;
+	bool discard;		// Called by PCD_CALLDISCARD
+};
+
+struct vmThread_t
+{
+	int script;			// Index in vmState_t::scripts
+	VmStatus status;
+	int pc;
+	int sp;
+	VecInt stack;
+	VecInt locals;		// Every frame's, the current one last
+	int localBase;
+	int localCount;
+	vector<vmFrame_t> frames;
+	int waitCommand;	// Pcode a VM_WAITING thread is waiting in
+	int wait;			// Tics, tag, polyobject or script number
+	int waitScript;		// Index of the script PCD_SCRIPTWAIT waits for
+	int wakeTic;		// When a delay or a tag or polyobject wait ends
+	bool ended;			// Counted as finished in its script
+	int result;			// From PCD_SETRESULTVALUE
+	int hudOptions;		// Stack position of PCD_OPTHUDMESSAGE's arguments
+	string print;		// Text since PCD_BEGINPRINT
+	string error;
+	long long executed;
+};
+
+struct vmState_t;
+
+// A builtin gets the pcode's operands followed by the values it pops,
+// and returns the value to push, if it pushes one
+typedef int (*vmBuiltin_t)(vmState_t &vm, int thread, int cmd, const int *args, int argCount);
+
+// A loaded object, its variables and its threads
+struct vmState_t
+{
+	const acsObject_t *object;
+	vector<byte> code;	// The object, padded so operands can be read past its end
+	int codeSize;
+	bool compact;
+	VecStr strings;		// The object's, then those made by PCD_SAVESTRING
+	vector<vmScript_t> scripts;
+	vector<vmFunction_t> functions;
+	int mapVars[MAX_MAP_VARIABLES];
+	int worldVars[MAX_WORLD_VARIABLES];
+	int globalVars[MAX_GLOBAL_VARIABLES];
+	vector<VecInt> mapArrays;
+	std::map<int, int> worldArrays[MAX_WORLD_VARIABLES];
+	std::map<int, int> globalArrays[MAX_GLOBAL_VARIABLES];
+	vector<vmThread_t> threads;
+	vmBuiltin_t builtins[PCODE_COMMAND_COUNT];
+	VecStr events;		// What the scripts did that a game would see
+	unsigned int random;
+	int nesting;		// ACS_ExecuteWithResult calls in progress
+	long long executed;
+	vector<long long> commands;	// Instructions run, by pcode
+	vector<long long> hits;		// Instructions run at each address, for profiles
+	int tic;
+	int maxTics;		// When VM_RunMap stops
+	int players;		// Each runs the enter scripts
+	vector<long long> ticExecuted;	// Instructions run in each tic
+	int peakThreads;	// Most threads alive at the end of a tic
+	long long peakThreadBytes;
+	int peakTic;
+};
+
+// PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
+
+bool VM_Load(vmState_t &vm, const acsObject_t &object);
+void VM_SetBuiltin(vmState_t &vm, int cmd, vmBuiltin_t builtin);
+int VM_FindScript(const vmState_t &vm, int number);
+int VM_FindScript(const vmState_t &vm, const string &name);
+bool VM_ScriptRunning(const vmState_t &vm, int number);
+int VM_StartScript(vmState_t &vm, int script, const int *args, int argCount);
+VmStatus VM_Run(vmState_t &vm, int thread);
+bool VM_RunTic(vmState_t &vm);
+void VM_RunMap(vmState_t &vm);
+void VM_Event(vmState_t &vm, int thread, const string &text);
+int VM_DefaultBuiltin(vmState_t &vm, int thread, int cmd, const int *args, int argCount);
+VecStr VM_Observed(const vmState_t &vm);
+void VM_Report(const vmState_t &vm, ostream &out);
+bool VM_Compare(const vmState_t &before, const vmState_t &after, ostream &out);
+
+// PUBLIC DATA DECLARATIONS ------------------------------------------------